@@ -11,7 +11,9 @@
 
 #include <NetworkManager.h>
 
+#include "common/log.h"
 #include "common/nm-service-defines.h"
+#include "common/trace.h"
 
 using namespace std;
 
@@ -41,7 +43,7 @@ static void wait_for_quit_instruction(void)
 
 static void puts_secrets(map<string, string> secrets_map)
 {
-    g_debug("puts_secrets()  count: %d", secrets_map.size());
+    VPN_LOG_DEBUG("puts_secrets()", "count", secrets_map.size());
     // dump secrets:   key1\nvalue1\nkey2\nvalue2\n\n format
     for (auto entry : secrets_map) {
         cout << entry.first << endl << entry.second << endl << endl;
@@ -50,22 +52,38 @@ static void puts_secrets(map<string, string> secrets_map)
 
 int main(int argc, char **argv)
 {
+    gint64 main_start_us = g_get_real_time();
     g_log_writer_default_set_use_stderr(true);
 
     #ifdef DEBUG_SET_STDERR_TO_FILE
     dup2(fileno(fopen("/tmp/vpn-bundle-auth-dialog.stderr", "a")), STDERR_FILENO);
     #endif
-    char *pp_cmd;
-    g_file_get_contents(g_strdup_printf("/proc/%d/cmdline", getppid()), &pp_cmd, nullptr, nullptr);
-    g_debug("ARGS: %s \n\tPID: %d UID: %d EUID: %d CWD: %s\n\tParent: %d (%s)\n\tENV: %s\n",
-            g_strjoinv(" ", argv),
-            getpid(),
-            getuid(),
-            geteuid(),
-            g_get_current_dir(),
-            getppid(),
-            pp_cmd,
-            g_strjoinv(" ", environ));
+    if (VPN_LOG_IS_ENABLED(Debug)) {
+        char *pp_cmdline_path = g_strdup_printf("/proc/%d/cmdline", getppid());
+        char *pp_cmd = nullptr;
+        g_file_get_contents(pp_cmdline_path, &pp_cmd, nullptr, nullptr);
+        char *cwd = g_get_current_dir();
+        VPN_LOG_DEBUG("Started",
+                      "args",
+                      argv,
+                      "pid",
+                      getpid(),
+                      "uid",
+                      getuid(),
+                      "euid",
+                      geteuid(),
+                      "cwd",
+                      cwd,
+                      "parent_pid",
+                      getppid(),
+                      "parent_cmd",
+                      pp_cmd,
+                      "env",
+                      environ);
+        g_free(cwd);
+        g_free(pp_cmd);
+        g_free(pp_cmdline_path);
+    }
 
     bool reprompt = false, allow_interaction = false, external_ui_mode = false;
     char *vpn_name_cstr = nullptr;
@@ -93,9 +111,10 @@ int main(int argc, char **argv)
     string vpn_name = STR(vpn_name_cstr);
     string vpn_uuid = STR(vpn_uuid_cstr);
     string vpn_service = STR(vpn_service_cstr);
+    trace_connection_uuid() = vpn_uuid;
 
     if (reprompt) {
-        g_debug("reprompt argument (-r) is set, but this dialog does not support it");
+        VPN_LOG_DEBUG("reprompt argument (-r) is set, but this dialog does not support it");
         return 0;
     }
     if (vpn_name.empty()) {
@@ -112,13 +131,19 @@ int main(int argc, char **argv)
     }
 
     int hints_count = hints_cstr_array ? g_strv_length(hints_cstr_array) : 0;
-    g_info("Options: name=%s uuid=%s service=%s allow_interaction=%s external_ui_mode=%s hints=(%s)",
-           vpn_name.c_str(),
-           vpn_uuid.c_str(),
-           vpn_service.c_str(),
-           BOOL_STR(allow_interaction),
-           BOOL_STR(external_ui_mode),
-           hints_cstr_array ? g_strjoinv(", ", hints_cstr_array) : "");
+    VPN_LOG_INFO("Options",
+                 "name",
+                 vpn_name,
+                 "uuid",
+                 vpn_uuid,
+                 "service",
+                 vpn_service,
+                 "allow_interaction",
+                 allow_interaction,
+                 "external_ui_mode",
+                 external_ui_mode,
+                 "hints",
+                 hints_cstr_array);
 
     int ret = 0;
 
@@ -129,7 +154,8 @@ int main(int argc, char **argv)
         // Called by NetworkManager agent when VPN service emits NewSecrets signal while connecting
         ret = do_when_hints(vpn_name, vpn_uuid, vpn_service, allow_interaction, external_ui_mode, hints_cstr_array);
     }
-    g_debug("Exiting with retrun code: %d", ret);
+    VPN_LOG_DEBUG("Exiting", "code", ret);
+    trace_record("auth-dialog main", main_start_us, g_get_real_time());
     return ret;
 }
 
@@ -137,17 +163,16 @@ static int do_when_no_hints(string vpn_name, string vpn_uuid, string vpn_service
 {
     GHashTable *vpn_options, *vpn_secrets = nullptr;
     if (!nm_vpn_service_plugin_read_vpn_details(0, &vpn_options, &vpn_secrets)) {
-        g_critical("vpn: '%s' (%s) Failed to read  data and secrets from stdin.", vpn_name.c_str(), vpn_uuid.c_str());
+        VPN_LOG_CRITICAL("Failed to read data and secrets from stdin", "name", vpn_name, "uuid", vpn_uuid);
         return 1;
     }
 
-    std::stringstream ss;
-    ss << "vpn: '" << vpn_name << "' (" << vpn_uuid << ") vpn_options: {";
-    G_STRING_HASAHTABLE_DUMP_TO(vpn_options, ss);
-    ss << "} vpn_secrets: {";
-    G_STRING_HASAHTABLE_DUMP_TO(vpn_secrets, ss);
-    ss << "}";
-    g_info(ss.str().c_str());
+    if (VPN_LOG_IS_ENABLED(Info)) {
+        std::stringstream options_ss, secrets_ss;
+        G_STRING_HASAHTABLE_DUMP_TO(vpn_options, options_ss);
+        G_STRING_HASAHTABLE_DUMP_TO(vpn_secrets, secrets_ss);
+        VPN_LOG_INFO("Read vpn details", "name", vpn_name, "uuid", vpn_uuid, "vpn_options", options_ss.str(), "vpn_secrets", secrets_ss.str());
+    }
 
     if (allow_interaction) {
         g_critical("allow_interaction is unexped when no hints provided");
@@ -163,7 +188,7 @@ static int do_when_no_hints(string vpn_name, string vpn_uuid, string vpn_service
             // dump secrets:   key1\nvalue1\nkey2\nvalue2\n\n format
             cout << (char *)key << endl << (char *)value << endl << endl;
         },
-        &ss);
+        nullptr);
 
     return 0;
 }
@@ -191,12 +216,12 @@ static int do_when_hints(string vpn_name, string vpn_uuid, string vpn_service, b
     GError *e = nullptr;
     JsonParser *parser = json_parser_new();
     if (!json_parser_load_from_data(parser, auth_cfg_json.c_str(), -1, &e)) {
-        g_critical("Failed to parse auth config hint: %s", e->message);
+        VPN_LOG_CRITICAL("Failed to parse auth config hint", "error", e->message);
         return 1;
     }
     JsonObject *auth_cfg_obj = json_node_get_object(json_parser_get_root(parser));
     if (!auth_cfg_obj) {
-        g_critical("Invalid  auth config hint json: %s", auth_cfg_json.c_str());
+        VPN_LOG_CRITICAL("Invalid auth config hint json", "json", auth_cfg_json);
         return 1;
     }
     string message = STR(json_object_get_string_member_with_default(auth_cfg_obj, "message", ""));
@@ -210,7 +235,7 @@ static int do_when_hints(string vpn_name, string vpn_uuid, string vpn_service, b
         // https://gitlab.gnome.org/GNOME/gnome-shell/-/issues/6690
         wait_for_quit_instruction();
     } else {
-        g_debug("Running as external UI mode");
+        VPN_LOG_DEBUG("Running as external UI mode");
         GKeyFile *keyfile = g_key_file_new();
         g_key_file_set_integer(keyfile, AUTH_EXEC_EXTERNAL_UI_KEYFILE_GROUP, "Version", 2);
         g_key_file_set_string(keyfile, AUTH_EXEC_EXTERNAL_UI_KEYFILE_GROUP, "Description", message.c_str());
@@ -232,6 +257,8 @@ static int do_when_hints(string vpn_name, string vpn_uuid, string vpn_service, b
 
 static bool prompt_gtk_dialog(string vpn_name, string message, string qr_image_b64)
 {
+    TraceSpan prompt_span("auth-dialog prompt");
+    gint64 display_start_us = g_get_real_time();
     gtk_init(0, nullptr);
     GError *error = nullptr;
     GtkWidget *window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
@@ -254,7 +281,7 @@ static bool prompt_gtk_dialog(string vpn_name, string message, string qr_image_b
     g_signal_connect(G_OBJECT(lbl_promt),
                      "activate-link",
                      G_CALLBACK(+[](G_GNUC_UNUSED GtkLabel *self, G_GNUC_UNUSED gchar *uri, gpointer user_data) -> bool {
-                         g_debug("link cliked: %s", uri);
+                         VPN_LOG_DEBUG("Link clicked", "uri", uri);
                          return true;
                      }),
                      window);
@@ -275,10 +302,11 @@ static bool prompt_gtk_dialog(string vpn_name, string message, string qr_image_b
         gtk_box_pack_start(GTK_BOX(box), image, true, true, 10);
 
     } else
-        g_debug("No qr_image provided");
+        VPN_LOG_DEBUG("No qr_image provided");
 
     // show time
     gtk_widget_show_all(window);
+    trace_record("auth-dialog prompt display", display_start_us, g_get_real_time());
     gtk_main();
     return true;
 }
@@ -0,0 +1,75 @@
+"""
+End-to-end connect latency of plugin-service, against stand-in provider daemons (see bench/harness.py).
+
+    python bench/connect_latency.py [--providers tailscale,zerotier] [--cycles 20] [--delay tailscale.up=1.5 ...]
+
+Every cycle spawns a service (like NetworkManager does per activation), calls ConnectInteractive() and Disconnect(),
+and measures: bus name owned after spawn, time to StateChanged(STARTED) after ConnectInteractive(), time to
+StateChanged(STOPPED) after Disconnect(). Prints p50/p99 per provider.
+"""
+
+import argparse
+import json
+import sys
+
+from harness import ServiceInstance, Workspace, enter_namespace, format_ms, percentile
+
+PROVIDERS = ("tailscale", "zerotier", "tinc", "nebula", "n2n", "weron")
+
+
+def run_provider(workspace: Workspace, bus, provider: str, cycles: int):
+    samples = {"spawn": [], "connect": [], "disconnect": []}
+    failures = []
+    for i in range(cycles):
+        svc = ServiceInstance(workspace, bus, provider, i)
+        try:
+            samples["spawn"].append(svc.spawn())
+            samples["connect"].append(svc.connect())
+            samples["disconnect"].append(svc.disconnect())
+        except Exception as e:
+            failures.append(repr(e))
+            print(f"{provider}#{i}: {e!r}", file=sys.stderr)
+        finally:
+            svc.kill()
+    return samples, failures
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--providers", default=",".join(PROVIDERS))
+    parser.add_argument("--cycles", type=int, default=20)
+    parser.add_argument("--delay", action="append", default=[], help="Stand-in daemon delay: <step>=<seconds>")
+    parser.add_argument("--needs-login", action="store_true", help="tailscale up asks for interactive login")
+    parser.add_argument("--json", help="Write the raw samples to this file")
+    parser.add_argument("--keep", action="store_true", help="Keep the workspace (logs) for inspection")
+    args = parser.parse_args()
+
+    enter_namespace()
+    from pydbus import SystemBus
+
+    delays = {k: float(v) for k, _, v in (d.partition("=") for d in args.delay)}
+    results = {}
+    with Workspace(delays, keep=args.keep) as workspace:
+        if args.needs_login:
+            workspace.env["VPN_BUNDLE_STUB_NEEDS_LOGIN"] = "1"
+        bus = SystemBus()
+        print(
+            f"{'provider':<10} {'ok':>4} {'fail':>4}  {'spawn p50/p99':>15}  {'STARTED p50/p99':>17}  {'STOPPED p50/p99':>17}"
+        )
+        for provider in args.providers.split(","):
+            samples, failures = run_provider(workspace, bus, provider, args.cycles)
+            results[provider] = {"samples": samples, "failures": failures}
+            print(
+                f"{provider:<10} {len(samples['disconnect']):>4} {len(failures):>4}  "
+                + "  ".join(
+                    f"{format_ms(percentile(samples[k], 50)):>7}/{format_ms(percentile(samples[k], 99)):<7}"
+                    for k in ("spawn", "connect", "disconnect")
+                )
+            )
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(results, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
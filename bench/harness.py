@@ -0,0 +1,404 @@
+"""
+Shared pieces of the plugin-service benchmarks.
+
+- Runs everything in an unprivileged user + network namespace (`unshare -rn`): stand-in daemons can create tun devices
+  and nothing leaks to the host network.
+- Starts a private dbus-daemon; the service finds it through $DBUS_SYSTEM_BUS_ADDRESS (uid 0 in the namespace).
+- Puts bench/stubs/vpn_stub.py first in $PATH under the names of the provider binaries.
+- Spawns plugin-service/provider-exec per connection with a NetworkManager like bus name, and drives it over D-Bus.
+
+Needs dbus-daemon, iproute2, util-linux unshare, and the service requirements (pydbus, PyGObject, netifaces).
+"""
+
+import contextlib
+import json
+import math
+import os
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+from pathlib import Path
+
+REPO_DIR = Path(__file__).resolve().parent.parent
+PROVIDER_EXEC = REPO_DIR / "plugin-service" / "provider-exec"
+STUB = Path(__file__).resolve().parent / "stubs" / "vpn_stub.py"
+STUB_NAMES = ("tailscaled", "tailscale", "zerotier-one", "tincd", "tinc", "nebula", "edge", "weron")
+
+NM_VPN_OBJECT_PATH = "/org/freedesktop/NetworkManager/VPN/Plugin"
+NM_VPN_INTERFACE = "org.freedesktop.NetworkManager.VPN.Plugin"
+STATE_STARTED, STATE_STOPPED = 4, 6
+
+_DBUS_CONFIG = """<!DOCTYPE busconfig PUBLIC "-//freedesktop//DTD D-Bus Bus Configuration 1.0//EN"
+ "http://www.freedesktop.org/standards/dbus/1.0/busconfig.dtd">
+<busconfig>
+  <type>system</type>
+  <listen>unix:dir={dir}</listen>
+  <auth>EXTERNAL</auth>
+  <policy context="default">
+    <allow user="*"/>
+    <allow own="*"/>
+    <allow send_type="method_call"/>
+    <allow send_destination="*" eavesdrop="true"/>
+    <allow eavesdrop="true"/>
+  </policy>
+  <limit name="max_connections_per_user">100000</limit>
+  <limit name="max_names_per_connection">100000</limit>
+</busconfig>
+"""
+
+
+def enter_namespace():
+    """Re-executes the current script as root of a new user + network namespace, unless already done."""
+    if os.getenv("VPN_BUNDLE_BENCH_NS") == "1":
+        subprocess.run(["ip", "link", "set", "lo", "up"], check=True)
+        return
+    os.environ["VPN_BUNDLE_BENCH_NS"] = "1"
+    os.execvp("unshare", ["unshare", "--user", "--map-root-user", "--net", "--", sys.executable, *sys.argv])
+
+
+def percentile(values: list[float], p: float) -> float:
+    """Nearest-rank percentile."""
+    if not values:
+        return math.nan
+    ordered = sorted(values)
+    return ordered[max(0, math.ceil(p / 100 * len(ordered)) - 1)]
+
+
+def format_ms(sec: float) -> str:
+    return "-" if math.isnan(sec) else f"{sec * 1000:.0f}ms"
+
+
+class Workspace:
+    """Temporary bin/, runtime and state directories, a private bus and the environment for the services."""
+
+    def __init__(self, stub_delays: dict[str, float] = None, keep=False) -> None:
+        self.dir = Path(tempfile.mkdtemp(prefix="vpn-bundle-bench-"))
+        self.keep = keep
+        self.bin_dir = self.dir / "bin"
+        self.runtime_dir = self.dir / "run"
+        self.state_dir = self.dir / "state"
+        self.log_dir = self.dir / "log"
+        for d in (self.bin_dir, self.runtime_dir, self.state_dir, self.log_dir):
+            d.mkdir()
+        for name in STUB_NAMES:
+            (self.bin_dir / name).symlink_to(STUB)
+        self.env = dict(
+            os.environ,
+            PATH=f"{self.bin_dir}:{os.environ['PATH']}",
+            XDG_RUNTIME_DIR=str(self.runtime_dir),
+            VPN_BUNDLE_STUB_DELAYS=json.dumps(stub_delays or {}),
+        )
+        self._dbus_daemon: subprocess.Popen = None
+        self._zerotier_service: subprocess.Popen = None
+
+    def __enter__(self):
+        (self.dir / "dbus.conf").write_text(_DBUS_CONFIG.format(dir=self.dir))
+        self._dbus_daemon = subprocess.Popen(
+            ["dbus-daemon", f"--config-file={self.dir / 'dbus.conf'}", "--nofork", "--print-address=1"],
+            stdout=subprocess.PIPE,
+        )
+        address = self._dbus_daemon.stdout.readline().decode().strip()
+        if not address:
+            raise RuntimeError("dbus-daemon did not start")
+        for var in ("DBUS_SYSTEM_BUS_ADDRESS", "DBUS_SESSION_BUS_ADDRESS"):
+            os.environ[var] = self.env[var] = address
+        return self
+
+    def __exit__(self, *exc):
+        if self._zerotier_service:
+            self._zerotier_service.terminate()
+            self._zerotier_service.wait()
+        if self._dbus_daemon:
+            self._dbus_daemon.terminate()
+            self._dbus_daemon.wait()
+        if self.keep:
+            print(f"workspace kept: {self.dir}", file=sys.stderr)
+        else:
+            shutil.rmtree(self.dir, ignore_errors=True)
+
+    def zerotier_service(self) -> Path:
+        """Working directory of the zerotier-one service shared by all zerotier connections, started on first use."""
+        work_dir = self.state_dir / "zerotier-one"
+        if not self._zerotier_service:
+            work_dir.mkdir()
+            self._zerotier_service = subprocess.Popen(
+                [self.bin_dir / "zerotier-one", work_dir],
+                env=self.env,
+                stderr=open(self.log_dir / "zerotier-one.log", "wb"),
+            )
+            deadline = time.monotonic() + 10
+            while True:
+                try:
+                    socket.create_connection(("127.0.0.1", 9993), timeout=1).close()
+                    break
+                except OSError:
+                    if time.monotonic() > deadline or self._zerotier_service.poll() is not None:
+                        raise RuntimeError("zerotier-one did not start")
+                    time.sleep(0.01)
+        return work_dir
+
+    def vpn_data(self, provider: str, index: int, explicit_dev=True) -> dict[str, str]:
+        """
+        Minimal valid connection settings of `provider` for the stand-in daemons.
+        Without `explicit_dev` the service derives the interface name from the connection name.
+        """
+        data = self._vpn_data(provider, index)
+        if not explicit_dev:
+            for key in ("tun-device-name", "dev", "tun-dev"):
+                data.pop(key, None)
+        return data
+
+    def _vpn_data(self, provider: str, index: int) -> dict[str, str]:
+        dev = f"bench{index}"
+        if provider == "tailscale":
+            return {"tun-device-name": dev}
+        if provider == "zerotier":
+            return {
+                "network-id": f"{index:016x}",
+                "service-working-directory": str(self.zerotier_service()),
+            }
+        if provider == "tinc":
+            return {
+                "node-name": f"bench{index}",
+                "dev": dev,
+                "rsa-private-key": str(self.state_dir / "tinc.key"),
+                "cidrs": f"10.{100 + index // 250}.{index % 250}.1/24",
+                "external-address": "127.0.0.1",
+                "listen-port": str(20000 + index),
+                "peers": '["peer0 192.0.2.1:655 10.99.0.0/24,10.99.1.0/24 Cipher=aes-256-cbc AAAA"]',
+            }
+        if provider == "nebula":
+            return {
+                "tun-dev": dev,
+                "pki-ca": "/dev/null",
+                "pki-cert": "/dev/null",
+                "pki-key": "/dev/null",
+                "lighthouse-overlay-ip": "192.168.100.1",
+                "lighthouse-host-port": "192.0.2.1:4242",
+                "inbound-rules": '["port=any,proto=any,host=any"]',
+                "outbound-rules": '["port=any,proto=any,host=any"]',
+            }
+        if provider == "n2n":
+            return {"dev": dev, "community": "bench", "encryption-key": "bench", "supernodes": "192.0.2.1:7654"}
+        if provider == "weron":
+            return {"dev": dev, "community": "bench", "password": "bench", "key": "bench", "ips": "10.1.0.0/16"}
+        raise ValueError(f"Unknown provider: {provider}")
+
+
+class ServiceInstance:
+    """One plugin-service process, as NetworkManager spawns it for a connection activation."""
+
+    def __init__(self, workspace: Workspace, bus, provider: str, index: int) -> None:
+        self.workspace = workspace
+        self.bus = bus
+        self.provider = provider
+        self.index = index
+        self.uuid = f"00000000-0000-4000-8000-{index:012x}"
+        self.bus_name = f"org.freedesktop.NetworkManager.{provider}.Connection_{index}"
+        self.connection_name = f"bench-{provider}-{index}"
+        self.states: list[tuple[float, int]] = []
+        self.failures: list[int] = []
+        self.tundev: str = None
+        self.proc: subprocess.Popen = None
+        self.proxy = None
+        self.spawned_at: float = None
+        self.ready_at: float = None
+        self.connect_called_at: float = None
+        self.disconnect_called_at: float = None
+        self.exited_at: float = None
+        self._log = None
+
+    @property
+    def state(self):
+        return self.states[-1][1] if self.states else None
+
+    @property
+    def started_at(self):
+        return next((t for t, state in self.states if state == STATE_STARTED), None)
+
+    def spawn(self, timeout_sec=30) -> float:
+        """Starts the service and waits until its bus name is owned. Returns the elapsed time."""
+        self.start_process()
+        run_until(self.is_ready, timeout_sec)
+        return self.attach()
+
+    def start_process(self):
+        self.spawned_at = time.monotonic()
+        self._log = open(self.workspace.log_dir / f"{self.provider}-{self.index}.log", "ab")
+        self.proc = subprocess.Popen(
+            [
+                str(PROVIDER_EXEC),
+                "--provider",
+                self.provider,
+                "--bus-name",
+                self.bus_name,
+                "--state-home-dir",
+                str(self.workspace.state_dir),
+            ],
+            env=self.workspace.env,
+            stdout=self._log,
+            stderr=self._log,
+            start_new_session=True,
+        )
+
+    def is_ready(self):
+        """The process exited or owns its bus name."""
+        if self.ready_at is None and (self.proc.poll() is not None or self.bus.dbus.NameHasOwner(self.bus_name)):
+            self.ready_at = time.monotonic()
+        return self.ready_at is not None
+
+    def attach(self) -> float:
+        """Subscribes to the signals of a ready service. Returns the time it took to get ready."""
+        if self.proc.poll() is not None:
+            raise RuntimeError(f"{self.bus_name} exited with {self.proc.returncode}")
+        elapsed = (self.ready_at or time.monotonic()) - self.spawned_at
+        self.proxy = self.bus.get(self.bus_name, NM_VPN_OBJECT_PATH)
+        self.proxy.StateChanged.connect(lambda state: self.states.append((time.monotonic(), state)))
+        self.proxy.Failure.connect(lambda reason: self.failures.append(reason))
+        self.proxy.Config.connect(lambda config: setattr(self, "tundev", config.get("tundev")))
+        return elapsed
+
+    def connect(self, timeout_sec=60, explicit_dev=True) -> float:
+        """ConnectInteractive() until STARTED. Returns the elapsed time; raises on failure or timeout."""
+        self.call_connect(explicit_dev)
+        run_until(self.connect_finished, timeout_sec)
+        return self.connect_elapsed()
+
+    def call_connect(self, explicit_dev=True):
+        """ConnectInteractive() returns right away, the connect goes on in the service."""
+        from gi.repository import GLib
+
+        connection = {
+            "connection": {
+                "id": GLib.Variant("s", self.connection_name),
+                "uuid": GLib.Variant("s", self.uuid),
+                "type": GLib.Variant("s", "vpn"),
+            },
+            "vpn": {
+                "service-type": GLib.Variant("s", f"org.freedesktop.NetworkManager.{self.provider}"),
+                "data": GLib.Variant("a{ss}", self.workspace.vpn_data(self.provider, self.index, explicit_dev)),
+            },
+        }
+        self.connect_called_at = time.monotonic()
+        self.proxy.ConnectInteractive(connection, {})
+
+    def connect_finished(self):
+        return self.state in (STATE_STARTED, STATE_STOPPED) or bool(self.failures) or self.proc.poll() is not None
+
+    def connect_elapsed(self) -> float:
+        """Time from ConnectInteractive() to STARTED; raises if the connect failed."""
+        if self.started_at is None:
+            raise RuntimeError(f"{self.bus_name} did not start: state={self.state} failures={self.failures}")
+        return self.started_at - self.connect_called_at
+
+    @property
+    def stopped_at(self):
+        """Of the StateChanged(STOPPED) following Disconnect()."""
+        return next(
+            (t for t, state in self.states if state == STATE_STOPPED and t >= self.disconnect_called_at),
+            None,
+        )
+
+    def disconnect(self, timeout_sec=30) -> float:
+        """
+        Disconnect() until the process exited. Returns the time to StateChanged(STOPPED): the exit comes after the
+        service's teardown (and linger-timeout, if set).
+        """
+        self.call_disconnect()
+        run_until(lambda: self.stopped_at is not None or self.has_exited(), timeout_sec)
+        if self.stopped_at is None:
+            with contextlib.suppress(TimeoutError):  # the signal may still be queued
+                run_until(lambda: self.stopped_at is not None, 1)
+        run_until(self.has_exited, timeout_sec)
+        if self.stopped_at is None:
+            raise RuntimeError(f"{self.bus_name} exited without emitting STOPPED: states={self.states}")
+        return self.stopped_at - self.disconnect_called_at
+
+    def call_disconnect(self):
+        """Asynchronous Disconnect() call: the service stops its daemons before replying."""
+        from gi.repository import Gio
+
+        self.disconnect_called_at = time.monotonic()
+        self.bus.con.call(
+            self.bus_name,
+            NM_VPN_OBJECT_PATH,
+            NM_VPN_INTERFACE,
+            "Disconnect",
+            None,  # parameters
+            None,  # reply type
+            Gio.DBusCallFlags.NONE,
+            -1,  # timeout
+            None,  # cancellable
+            None,  # callback: the reply does not matter, the process exit does
+        )
+
+    def has_exited(self):
+        if self.exited_at is None and self.proc.poll() is not None:
+            self.exited_at = time.monotonic()
+        return self.exited_at is not None
+
+    def kill(self):
+        if self.proc and self.proc.poll() is None:
+            os.killpg(self.proc.pid, signal.SIGKILL)
+            self.proc.wait()
+        if self._log:
+            self._log.close()
+
+    def rss_kb(self) -> int:
+        """Resident memory of the service and its children (daemons), from /proc."""
+        return sum(_proc_status_kb(pid, "VmRSS") for pid in _process_tree(self.proc.pid))
+
+    def cpu_sec(self) -> float:
+        """CPU time of the service and its children, from /proc."""
+        return sum(_proc_cpu_sec(pid) for pid in _process_tree(self.proc.pid))
+
+
+def run_until(predicate, timeout_sec: float):
+    """Iterates the GLib main context (D-Bus signals) until `predicate()` holds."""
+    from gi.repository import GLib
+
+    context = GLib.MainContext.default()
+    deadline = time.monotonic() + timeout_sec
+    tick = GLib.timeout_add(10, lambda: True)
+    try:
+        while not predicate():
+            if time.monotonic() > deadline:
+                raise TimeoutError(f"Timed out after {timeout_sec}s")
+            context.iteration(True)
+    finally:
+        GLib.source_remove(tick)
+
+
+def _process_tree(pid: int) -> list[int]:
+    pids, i = [pid], 0
+    while i < len(pids):
+        # children are listed per thread which forked them
+        for children_file in Path(f"/proc/{pids[i]}/task").glob("*/children"):
+            try:
+                pids.extend(int(c) for c in children_file.read_text().split())
+            except OSError:
+                pass
+        i += 1
+    return pids
+
+
+def _proc_status_kb(pid: int, key: str) -> int:
+    try:
+        for line in Path(f"/proc/{pid}/status").read_text().splitlines():
+            if line.startswith(key + ":"):
+                return int(line.split()[1])
+    except OSError:
+        pass
+    return 0
+
+
+def _proc_cpu_sec(pid: int) -> float:
+    try:
+        fields = Path(f"/proc/{pid}/stat").read_text().rsplit(")", 1)[1].split()
+    except OSError:
+        return 0.0
+    return (int(fields[11]) + int(fields[12])) / os.sysconf("SC_CLK_TCK")  # utime + stime
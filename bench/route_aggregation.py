@@ -0,0 +1,76 @@
+"""
+Route aggregation benchmark.
+
+    python bench/route_aggregation.py [--routes 100000] [--max-routes 1000] [--seed 1]
+
+Generates clustered IPv4/IPv6 prefixes (as advertised by many mesh peers: lots of adjacent /24../32 and /48../64,
+some overlapping) and times plugin-service/routes.py on them.
+"""
+
+import argparse
+import importlib.util
+import ipaddress
+import random
+import time
+from pathlib import Path
+
+_spec = importlib.util.spec_from_file_location("routes", Path(__file__).parent.parent / "plugin-service" / "routes.py")
+routes = importlib.util.module_from_spec(_spec)
+_spec.loader.exec_module(routes)
+
+
+def generate(count: int, rng: random.Random):
+    result = []
+    v4_clusters = [rng.getrandbits(16) << 16 for _ in range(max(1, count // 2000))]
+    v6_clusters = [rng.getrandbits(40) << 88 for _ in range(max(1, count // 2000))]
+    for i in range(count):
+        if i % 4:
+            plen = rng.choice((24, 24, 26, 28, 30, 32, 32, 32))
+            addr = rng.choice(v4_clusters) | rng.getrandbits(16)
+            result.append(ipaddress.IPv4Network((addr >> (32 - plen) << (32 - plen), plen)))
+        else:
+            plen = rng.choice((48, 56, 64, 64, 64))
+            addr = rng.choice(v6_clusters) | rng.getrandbits(24) << 64
+            result.append(ipaddress.IPv6Network((addr >> (128 - plen) << (128 - plen), plen)))
+    return result
+
+
+def run(name, networks, **kwargs):
+    started_at = time.perf_counter()
+    aggregated = routes.aggregate_routes(networks, **kwargs)
+    elapsed_ms = (time.perf_counter() - started_at) * 1000
+    by_version = {v: sum(n.version == v for n in aggregated) for v in (4, 6)}
+    print(
+        f"{name:<24} in={len(networks):>7} out={len(aggregated):>7} (v4={by_version[4]} v6={by_version[6]}) {elapsed_ms:>8.1f}ms"
+    )
+    return aggregated
+
+
+def check(networks, aggregated):
+    """Exact aggregation must route the very same addresses."""
+    for version in (4, 6):
+        expected = list(ipaddress.collapse_addresses(n for n in networks if n.version == version))
+        actual = sorted(n for n in aggregated if n.version == version)
+        assert expected == actual, f"IPv{version} mismatch: {len(expected)} != {len(actual)}"
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--routes", type=int, default=100_000)
+    parser.add_argument("--max-routes", type=int, default=1000)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument(
+        "--check", action="store_true", help="Compare exact aggregation with ipaddress.collapse_addresses"
+    )
+    args = parser.parse_args()
+
+    networks = generate(args.routes, random.Random(args.seed))
+    aggregated = run("exact", networks)
+    run(f"max-routes={args.max_routes}", networks, max_routes=args.max_routes)
+    if args.check:
+        check(networks, aggregated)
+        print("check: ok")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,214 @@
+"""
+Concurrent multi-connection scale test of plugin-service, against stand-in provider daemons (see bench/harness.py).
+
+    python bench/scale.py --provider tailscale --connections 10,50,200 [--hold 30] [--churn 20] [--auto-ifname]
+
+For every N: a sequential single-connection baseline, then N services spawned and connected at once (like
+NetworkManager activating N connections of one provider), held for a while, churned (disconnect + new activation)
+and torn down in parallel. Reports per N:
+- connect latency p50/p99 and its degradation against the baseline;
+- resident memory per connection (service + daemon) and CPU per connection while idle;
+- failures, and interface name collisions (two connections reporting the same tundev), which happen with
+  --auto-ifname when connection names only differ after the 15th character (find_valid_if_name()).
+"""
+
+import argparse
+import collections
+import json
+import random
+import sys
+import time
+
+from harness import (
+    ServiceInstance,
+    Workspace,
+    enter_namespace,
+    format_ms,
+    percentile,
+    run_until,
+)
+
+
+class ScaleRun:
+    def __init__(self, workspace: Workspace, bus, provider: str, explicit_dev: bool, timeout_sec: float) -> None:
+        self.workspace = workspace
+        self.bus = bus
+        self.provider = provider
+        self.explicit_dev = explicit_dev
+        self.timeout_sec = timeout_sec
+        self.next_index = 0
+        self.running: list[ServiceInstance] = []
+        self.all: list[ServiceInstance] = []
+        self.failures: list[str] = []
+
+    def _new(self) -> ServiceInstance:
+        svc = ServiceInstance(self.workspace, self.bus, self.provider, self.next_index)
+        self.next_index += 1
+        self.all.append(svc)
+        return svc
+
+    def bring_up(self, count: int) -> list[float]:
+        """Spawns and connects `count` services at once. Returns the connect latencies of the started ones."""
+        batch = [self._new() for _ in range(count)]
+        for svc in batch:
+            svc.start_process()
+        self._wait(lambda: all(svc.is_ready() for svc in batch))
+        ready = []
+        for svc in batch:
+            try:
+                svc.attach()
+                svc.call_connect(self.explicit_dev)
+                ready.append(svc)
+            except Exception as e:
+                self._failed(svc, e)
+        self._wait(lambda: all(svc.connect_finished() for svc in ready))
+        latencies = []
+        for svc in ready:
+            try:
+                latencies.append(svc.connect_elapsed())
+                self.running.append(svc)
+            except Exception as e:
+                self._failed(svc, e)
+        return latencies
+
+    def tear_down(self, services: list[ServiceInstance]) -> list[float]:
+        """Disconnects `services` at once. Returns the time each took to exit."""
+        for svc in services:
+            svc.call_disconnect()
+        self._wait(lambda: all([svc.has_exited() for svc in services]))
+        latencies = []
+        for svc in services:
+            self.running.remove(svc)
+            if svc.has_exited():
+                latencies.append(svc.exited_at - svc.disconnect_called_at)
+            else:
+                self.failures.append(f"{svc.bus_name}: did not exit after Disconnect()")
+            svc.kill()
+        return latencies
+
+    def sample(self, hold_sec: float):
+        """Resident memory per connection, and CPU per connection over `hold_sec` of idling."""
+        cpu_before = {svc: svc.cpu_sec() for svc in self.running}
+        started_at = time.monotonic()
+        rss = {}
+        samples = 0
+        while True:
+            for svc in self.running:
+                rss[svc] = max(rss.get(svc, 0), svc.rss_kb())
+            samples += 1  # about once a second
+            if time.monotonic() - started_at >= hold_sec:
+                break
+            run_until(lambda: time.monotonic() - started_at >= min(hold_sec, samples), hold_sec + 1)
+        elapsed = time.monotonic() - started_at
+        cpu = [(svc.cpu_sec() - cpu_before[svc]) / elapsed for svc in self.running if svc in cpu_before]
+        return list(rss.values()), cpu
+
+    def collisions(self) -> dict[str, int]:
+        devs = collections.Counter(svc.tundev for svc in self.running if svc.tundev)
+        return {dev: n for dev, n in devs.items() if n > 1}
+
+    def kill_all(self):
+        for svc in self.all:
+            svc.kill()
+
+    def _wait(self, predicate):
+        try:
+            run_until(predicate, self.timeout_sec)
+        except TimeoutError as e:
+            self.failures.append(repr(e))
+
+    def _failed(self, svc: ServiceInstance, e: Exception):
+        self.failures.append(f"{svc.bus_name}: {e}")
+        svc.kill()
+
+
+def measure(workspace, bus, args, count: int, baseline_p50: float):
+    run = ScaleRun(workspace, bus, args.provider, not args.auto_ifname, args.timeout)
+    try:
+        connect = run.bring_up(count)
+        collisions = run.collisions()
+        rss_kb, cpu = run.sample(args.hold)
+
+        churn_connect, churn_disconnect = [], []
+        rng = random.Random(count)
+        batch = max(1, count // 10)
+        for _ in range(args.churn):
+            victims = rng.sample(run.running, min(batch, len(run.running)))
+            churn_disconnect.extend(run.tear_down(victims))
+            churn_connect.extend(run.bring_up(len(victims)))
+        teardown = run.tear_down(list(run.running))
+    finally:
+        run.kill_all()
+
+    p50 = percentile(connect, 50)
+    result = {
+        "connections": count,
+        "started": len(connect),
+        "connect_p50": p50,
+        "connect_p99": percentile(connect, 99),
+        "degradation": p50 / baseline_p50 if baseline_p50 else None,
+        "churn_connect_p50": percentile(churn_connect, 50),
+        "churn_disconnect_p50": percentile(churn_disconnect, 50),
+        "teardown_max": max(teardown, default=0.0),
+        "rss_kb_mean": sum(rss_kb) / len(rss_kb) if rss_kb else 0,
+        "rss_kb_max": max(rss_kb, default=0),
+        "cpu_percent_mean": 100 * sum(cpu) / len(cpu) if cpu else 0,
+        "collisions": collisions,
+        "failures": run.failures,
+    }
+    print(
+        f"N={count:<4} started={len(connect):<4} connect p50/p99={format_ms(p50)}/{format_ms(result['connect_p99'])}"
+        f" (x{result['degradation'] or 0:.1f} baseline) churn p50 up/down="
+        f"{format_ms(result['churn_connect_p50'])}/{format_ms(result['churn_disconnect_p50'])}"
+        f" teardown={format_ms(result['teardown_max'])} rss/conn mean/max="
+        f"{result['rss_kb_mean'] / 1024:.1f}/{result['rss_kb_max'] / 1024:.1f}MiB"
+        f" cpu/conn={result['cpu_percent_mean']:.2f}% collisions={len(collisions)} failures={len(run.failures)}"
+    )
+    for failure, n in collections.Counter(f.split(": ", 1)[-1] for f in run.failures).most_common(5):
+        print(f"    {n}x {failure}")
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--provider", default="tailscale")
+    parser.add_argument("--connections", default="10,50,200", help="Comma separated connection counts")
+    parser.add_argument("--hold", type=float, default=30, help="Seconds to hold the connections for sampling")
+    parser.add_argument("--churn", type=int, default=10, help="Churn rounds, each replacing 10%% of the connections")
+    parser.add_argument("--auto-ifname", action="store_true", help="Let the service derive interface names")
+    parser.add_argument("--baseline-cycles", type=int, default=3)
+    parser.add_argument("--timeout", type=float, default=300, help="Timeout of each bring-up/tear-down step")
+    parser.add_argument("--delay", action="append", default=[], help="Stand-in daemon delay: <step>=<seconds>")
+    parser.add_argument("--json", help="Write the results to this file")
+    parser.add_argument("--keep", action="store_true", help="Keep the workspace (logs) for inspection")
+    args = parser.parse_args()
+
+    enter_namespace()
+    from pydbus import SystemBus
+
+    delays = {k: float(v) for k, _, v in (d.partition("=") for d in args.delay)}
+    results = []
+    with Workspace(delays, keep=args.keep) as workspace:
+        bus = SystemBus()
+        baseline = []
+        for i in range(args.baseline_cycles):
+            svc = ServiceInstance(workspace, bus, args.provider, 100_000 + i)
+            try:
+                svc.spawn()
+                baseline.append(svc.connect(explicit_dev=not args.auto_ifname))
+                svc.disconnect()
+            except Exception as e:
+                print(f"baseline: {e!r}", file=sys.stderr)
+            finally:
+                svc.kill()
+        baseline_p50 = percentile(baseline, 50)
+        print(f"{args.provider}: single connection baseline p50={format_ms(baseline_p50)}")
+        for count in (int(n) for n in args.connections.split(",")):
+            results.append(measure(workspace, bus, args, count, baseline_p50))
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"provider": args.provider, "baseline": baseline, "results": results}, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
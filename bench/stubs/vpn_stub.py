@@ -0,0 +1,482 @@
+#!/usr/bin/env python3
+"""
+Stand-in for the provider binaries driven by plugin-service, for benchmarks (see bench/harness.py).
+Dispatches on the name it is invoked as (symlinks): tailscaled, tailscale, zerotier-one, tincd, tinc, nebula, edge, weron.
+
+It creates a real (persistent) tun device, configures an address and answers the CLI calls of plugin-service
+with realistic output. Delays are configured by $VPN_BUNDLE_STUB_DELAYS, a JSON object of "<step>": seconds, eg:
+{"tailscaled.start": 0.2, "tailscale.up": 1.5, "zerotier.join": 2}. $VPN_BUNDLE_STUB_NEEDS_LOGIN=1 makes
+`tailscale up` ask for interactive login first ("tailscale.login" delay). After `tailscale down`, tailscaled keeps its
+control session and the next `up` takes "tailscale.resume" instead of "tailscale.up".
+
+Needs CAP_NET_ADMIN, eg: `unshare -rn`.
+"""
+
+import http.client
+import http.server
+import ipaddress
+import json
+import os
+import signal
+import socket
+import socketserver
+import subprocess
+import sys
+import threading
+import time
+import zlib
+from pathlib import Path
+
+_DELAYS = json.loads(os.getenv("VPN_BUNDLE_STUB_DELAYS") or "{}")
+
+
+def delay(step: str):
+    if sec := float(_DELAYS.get(step, 0)):
+        time.sleep(sec)
+
+
+def log(msg, *args):
+    print(f"{Path(sys.argv[0]).name}[{os.getpid()}]: {msg % args}", file=sys.stderr, flush=True)
+
+
+def arg_value(argv: list[str], *names: str, default=None):
+    """Value of `-name value`, `--name value`, `--name=value` or `-Xvalue` style arguments."""
+    for i, a in enumerate(argv):
+        for n in names:
+            if a == n and i + 1 < len(argv):
+                return argv[i + 1]
+            if a.startswith(n + "="):
+                return a[len(n) + 1 :]
+            if len(n) == 2 and a.startswith(n) and len(a) > 2 and not a.startswith("--"):
+                return a[2:]
+    return default
+
+
+def stable_ipv4(dev: str, network="10.0.0.0/8") -> ipaddress.IPv4Interface:
+    """Per-device address, so that parallel connections do not collide."""
+    net = ipaddress.ip_network(network)
+    host = zlib.crc32(dev.encode()) % (net.num_addresses - 2) + 1
+    return ipaddress.ip_interface(f"{net.network_address + host}/{net.prefixlen}")
+
+
+def stable_ipv6(dev: str) -> ipaddress.IPv6Interface:
+    return ipaddress.ip_interface(f"fd7a:115c:a1e0::{zlib.crc32(dev.encode()) & 0xFFFF:x}/128")
+
+
+def ip(*args, check=True):
+    return subprocess.run(["ip", *args], check=check, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+
+
+def tun_up(dev: str, *addresses):
+    ip("tuntap", "add", "dev", dev, "mode", "tun")
+    for a in addresses:
+        ip("addr", "add", str(a), "dev", dev)
+    ip("link", "set", dev, "up")
+
+
+def tun_down(dev: str):
+    ip("link", "del", dev, check=False)
+
+
+def run_until_terminated(cleanup=None):
+    stopped = threading.Event()
+    for sig in (signal.SIGTERM, signal.SIGINT):
+        signal.signal(sig, lambda *_: stopped.set())
+    stopped.wait()
+    delay("stop")
+    if cleanup:
+        cleanup()
+
+
+def write_pidfile(path):
+    if path:
+        Path(path).write_text(f"{os.getpid()}\n")
+
+
+# ---- tailscale: tailscaled serves a LocalAPI-like HTTP API over its unix socket, the CLI talks to it.
+
+
+class _TailscaleState:
+    def __init__(self, dev: str) -> None:
+        self.dev = dev
+        self.backend_state = "NeedsLogin" if os.getenv("VPN_BUNDLE_STUB_NEEDS_LOGIN") == "1" else "Stopped"
+        self.has_netmap = False  # after the first `up`: control session is established, `down` keeps it
+        self.addresses = [stable_ipv4(dev, "100.64.0.0/10"), stable_ipv6(dev)]
+        self.lock = threading.Lock()
+
+    def status(self):
+        return {
+            "Version": "1.99.0-stub",
+            "BackendState": self.backend_state,
+            "TailscaleIPs": [str(a.ip) for a in self.addresses],
+            "Self": {"HostName": socket.gethostname(), "TailscaleIPs": [str(a.ip) for a in self.addresses]},
+            "Peer": {
+                f"nodekey:{i:064x}": {
+                    "HostName": f"peer{i}",
+                    "TailscaleIPs": [f"100.100.{i}.1"],
+                    "PrimaryRoutes": [f"10.{200 + i}.0.0/16"] if i % 2 else None,
+                }
+                for i in range(int(os.getenv("VPN_BUNDLE_STUB_PEERS", "4")))
+            },
+        }
+
+
+class _UnixHTTPServer(socketserver.ThreadingMixIn, socketserver.UnixStreamServer):
+    daemon_threads = True
+
+
+def _tailscaled(argv):
+    sock_path = arg_value(argv, "-socket", "--socket")
+    dev = arg_value(argv, "-tun", "--tun", default="tailscale0")
+    delay("tailscaled.start")
+    state = _TailscaleState(dev)
+    tun_up(dev, *state.addresses)
+
+    class Handler(http.server.BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"
+
+        def log_message(self, *args):
+            pass
+
+        def _reply(self, obj, code=200):
+            body = json.dumps(obj, indent=2).encode()
+            self.send_response(code)
+            self.send_header("Content-Type", "application/json")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+        def do_GET(self):
+            if self.path.startswith("/localapi/v0/status"):
+                delay("tailscale.status")
+                with state.lock:
+                    return self._reply(state.status())
+            self._reply({"error": "not found"}, 404)
+
+        def do_POST(self):
+            self.rfile.read(int(self.headers.get("Content-Length") or 0))
+            if self.path.startswith("/localapi/v0/login-interactive"):
+                delay("tailscale.login")
+                with state.lock:
+                    state.backend_state = "Running"
+                    state.has_netmap = True
+                return self._reply({})
+            if self.path.startswith("/localapi/v0/start"):
+                delay("tailscale.resume" if state.has_netmap else "tailscale.up")
+                with state.lock:
+                    if state.backend_state != "NeedsLogin":
+                        state.backend_state = "Running"
+                        state.has_netmap = True
+                    return self._reply({"BackendState": state.backend_state})
+            if self.path.startswith("/localapi/v0/down"):
+                with state.lock:
+                    state.backend_state = "Stopped"
+                return self._reply({})
+            self._reply({"error": "not found"}, 404)
+
+    with _UnixHTTPServer(sock_path, Handler) as server:
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+        log("listening on %s dev=%s", sock_path, dev)
+        try:
+            run_until_terminated()
+        finally:
+            server.shutdown()
+            os.unlink(sock_path)
+            tun_down(dev)
+
+
+class _UnixHTTPConnection(http.client.HTTPConnection):
+    def __init__(self, path):
+        super().__init__("local-tailscaled.sock")
+        self.path = path
+
+    def connect(self):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(self.path)
+
+
+def _localapi(sock_path, method, path):
+    conn = _UnixHTTPConnection(sock_path)
+    conn.request(method, path, body=b"" if method == "POST" else None)
+    resp = conn.getresponse()
+    return json.loads(resp.read())
+
+
+def _tailscale(argv):
+    sock_path = arg_value(argv, "--socket")
+    args = [a for a in argv if not a.startswith("--socket")]
+    cmd = args[0] if args else "status"
+    if cmd == "up":
+        # like the real CLI: indented JSON objects on stdout, one per state change
+        status = _localapi(sock_path, "POST", "/localapi/v0/start")
+        if status["BackendState"] == "NeedsLogin":
+            print(
+                json.dumps(
+                    {"AuthURL": "https://login.example.com/a/0123456789", "QR": "data:image/png;base64,"}, indent=2
+                ),
+                flush=True,
+            )
+            _localapi(sock_path, "POST", "/localapi/v0/login-interactive")
+            status = _localapi(sock_path, "GET", "/localapi/v0/status")
+        print(json.dumps({"BackendState": status["BackendState"]}, indent=2), flush=True)
+    elif cmd == "status":
+        print(json.dumps(_localapi(sock_path, "GET", "/localapi/v0/status"), indent=2))
+    elif cmd == "ip":
+        print("\n".join(_localapi(sock_path, "GET", "/localapi/v0/status")["TailscaleIPs"]))
+    elif cmd == "down":
+        _localapi(sock_path, "POST", "/localapi/v0/down")
+    else:
+        log("unsupported: %r", args)
+        return 2
+    return 0
+
+
+# ---- zerotier: `zerotier-one` serves the local JSON API on 127.0.0.1:<primary port>, `zerotier-one -q` (zerotier-cli)
+# talks to it like the real CLI does.
+
+
+class _ZeroTierState:
+    def __init__(self, work_dir: Path) -> None:
+        self.work_dir = work_dir
+        self.node_id = f"{zlib.crc32(str(work_dir).encode()):010x}"[:10]
+        self.networks: dict[str, dict] = {}
+        self.join_ready_sec = float(_DELAYS.get("zerotier.join", 0))
+        self.lock = threading.Lock()
+
+    def join(self, nwid):
+        dev = f"zt{zlib.crc32(f'{self.work_dir}/{nwid}'.encode()):08x}"
+        self.networks.setdefault(nwid, {"joined_at": time.time(), "portDeviceName": dev})
+        return self.network(nwid)
+
+    def leave(self, nwid):
+        if n := self.networks.pop(nwid, None):
+            if n.get("tun"):
+                tun_down(n["portDeviceName"])
+        return {"result": True}
+
+    def configure(self, nwid, settings: dict):
+        n = self.networks[nwid]
+        if "allowManaged" in settings and bool(settings["allowManaged"]) != n.get("allowManaged", True):
+            n["allowManaged"] = bool(settings["allowManaged"])
+            if n.get("tun"):
+                dev = n["portDeviceName"]
+                for a in (stable_ipv4(dev, "10.147.0.0/16"), stable_ipv6(dev)):
+                    ip("addr", "add" if n["allowManaged"] else "del", str(a), "dev", dev, check=False)
+        return self.network(nwid)
+
+    def network(self, nwid):
+        n = self.networks[nwid]
+        ready = time.time() - n["joined_at"] >= self.join_ready_sec
+        managed = n.get("allowManaged", True)
+        dev = n["portDeviceName"]
+        v4, v6 = stable_ipv4(dev, "10.147.0.0/16"), stable_ipv6(dev)
+        if ready and not n.get("tun"):
+            tun_up(dev, v4, v6)
+            n["tun"] = True
+        return {
+            "allowDNS": False,
+            "allowDefault": False,
+            "allowGlobal": False,
+            "allowManaged": managed,
+            "assignedAddresses": [str(v4), str(v6)] if ready and managed else [],
+            "dns": {"domain": "", "servers": []},
+            "id": nwid,
+            "mtu": 2800,
+            "name": "stub",
+            "nwid": nwid,
+            "portDeviceName": dev,
+            "routes": [{"flags": 0, "metric": 0, "target": "10.147.0.0/16", "via": None}] if ready and managed else [],
+            "status": "OK" if ready else "REQUESTING_CONFIGURATION",
+            "type": "PRIVATE",
+        }
+
+    def status(self):
+        return {"address": self.node_id, "online": True, "version": "1.99.0-stub"}
+
+
+def _zerotier_service(work_dir: Path, port: int):
+    state = _ZeroTierState(work_dir)
+    auth_token = f"{zlib.crc32(os.urandom(8)):08x}"
+    token_file = work_dir / "authtoken.secret"
+    token_file.write_text(auth_token)
+    token_file.chmod(0o600)
+
+    class Handler(http.server.BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"
+        disable_nagle_algorithm = True  # headers and body are written separately
+
+        def log_message(self, *args):
+            pass
+
+        def _reply(self, obj, code=200):
+            body = json.dumps(obj).encode()
+            self.send_response(code)
+            self.send_header("Content-Type", "application/json")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+        def _handle(self, method):
+            body = json.loads(self.rfile.read(int(self.headers.get("Content-Length") or 0)) or b"{}")
+            if self.headers.get("X-ZT1-Auth") != auth_token:
+                return self._reply({}, 401)
+            delay("zerotier.api")
+            parts = self.path.strip("/").split("/")
+            with state.lock:
+                if parts == ["status"] and method == "GET":
+                    return self._reply(state.status())
+                if parts == ["network"] and method == "GET":
+                    return self._reply([state.network(nwid) for nwid in state.networks])
+                if len(parts) == 2 and parts[0] == "network":
+                    nwid = parts[1]
+                    if method == "POST" and nwid not in state.networks:
+                        return self._reply(state.join(nwid))
+                    if method == "POST":
+                        return self._reply(state.configure(nwid, body))
+                    if nwid not in state.networks:
+                        return self._reply({}, 404)
+                    if method == "DELETE":
+                        return self._reply(state.leave(nwid))
+                    return self._reply(state.network(nwid))
+            self._reply({}, 404)
+
+        def do_GET(self):
+            self._handle("GET")
+
+        def do_POST(self):
+            self._handle("POST")
+
+        def do_DELETE(self):
+            self._handle("DELETE")
+
+    with http.server.ThreadingHTTPServer(("127.0.0.1", port), Handler) as server:
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+        log("listening on 127.0.0.1:%d work_dir=%s", port, work_dir)
+        try:
+            run_until_terminated()
+        finally:
+            server.shutdown()
+            with state.lock:
+                for nwid in list(state.networks):
+                    state.leave(nwid)
+
+
+def _zerotier(argv):
+    if "-v" in argv:
+        print("1.99.0-stub")
+        return 0
+    args = [a for a in argv if not a.startswith("-")]
+    port = int(arg_value(argv, "-p", default="9993"))
+    if "-q" not in argv:
+        work_dir = Path(args[0] if args else arg_value(argv, "-D", default="/var/lib/zerotier-one"))
+        work_dir.mkdir(parents=True, exist_ok=True)
+        _zerotier_service(work_dir, port)
+        return 0
+
+    work_dir = Path(arg_value(argv, "-D", default="/var/lib/zerotier-one"))
+    conn = http.client.HTTPConnection("127.0.0.1", port, timeout=10)
+    headers = {"X-ZT1-Auth": (work_dir / "authtoken.secret").read_text().strip()}
+
+    def api(method, path, data=None):
+        conn.request(method, path, body=json.dumps(data or {}) if method == "POST" else None, headers=headers)
+        resp = conn.getresponse()
+        body = json.loads(resp.read())
+        if resp.status != 200:
+            raise RuntimeError(f"{method} {path}: HTTP {resp.status}")
+        return body
+
+    delay("zerotier.cli")
+    try:
+        if args[:1] == ["info"]:
+            out = api("GET", "/status")
+        elif args[:1] == ["join"]:
+            out = api("POST", f"/network/{args[1]}")
+        elif args[:1] == ["leave"]:
+            out = api("DELETE", f"/network/{args[1]}")
+        elif args[:1] == ["listnetworks"]:
+            out = api("GET", "/network")
+        elif args[:1] == ["set"]:
+            settings = dict(a.split("=", 1) for a in args[2:])
+            out = api("POST", f"/network/{args[1]}", {k: v in ("1", "true") for k, v in settings.items()})
+        else:
+            log("unsupported: %r", args)
+            return 2
+    except OSError as e:
+        print(f"Error connecting to the ZeroTier service: {e}", file=sys.stderr)
+        return 1
+    print(json.dumps(out, indent=2))
+    return 0
+
+
+# ---- daemons which only bring up a tun device
+
+
+def _tincd(argv):
+    config_dir = Path(arg_value(argv, "--config", "-c"))
+    conf = dict(
+        (k.strip(), v.strip())
+        for k, _, v in (line.partition("=") for line in (config_dir / "tinc.conf").read_text().splitlines())
+        if v
+    )
+    dev = conf.get("Interface", "tinc0")
+    delay("tincd.start")
+    tun_up(dev)
+    subprocess.run(
+        [str(config_dir / "tinc-up")],
+        env=dict(os.environ, INTERFACE=dev, NETNAME="", NAME=conf.get("Name", "")),
+        check=False,
+    )
+    write_pidfile(arg_value(argv, "--pidfile"))
+    run_until_terminated(lambda: tun_down(dev))
+
+
+def _tinc(argv):
+    config_dir = Path(arg_value(argv, "--config", "-c"))
+    args = [a for i, a in enumerate(argv) if not a.startswith("-") and not argv[i - 1].startswith("-")]
+    if args[:2] != ["dump", "subnets"]:
+        log("unsupported: %r", args)
+        return 2
+    for host_file in sorted((config_dir / "hosts").iterdir()):
+        for line in host_file.read_text().splitlines():
+            k, _, v = line.partition("=")
+            if k.strip() == "Subnet":
+                print(f"{v.strip()} owner {host_file.name}")
+    return 0
+
+
+def _nebula(argv):
+    config = json.loads(Path(arg_value(argv, "-config")).read_text())
+    dev = config["tun"]["dev"]
+    delay("nebula.start")
+    tun_up(dev, stable_ipv4(dev, "192.168.100.0/24"))
+    run_until_terminated(lambda: tun_down(dev))
+
+
+def _edge(argv):
+    dev = arg_value(argv, "-d", default="edge0")
+    delay("edge.start")
+    tun_up(dev, arg_value(argv, "-a") or stable_ipv4(dev, "10.64.0.0/16"))
+    run_until_terminated(lambda: tun_down(dev))
+
+
+def _weron(argv):
+    dev = arg_value(argv, "--dev", default="weron0")
+    ips = [ipaddress.ip_network(n, strict=False) for n in (arg_value(argv, "--ips") or "10.1.0.0/16").split(",")]
+    delay("weron.start")
+    tun_up(dev, *(stable_ipv4(dev, str(n)) if n.version == 4 else f"{n[1]}/{n.prefixlen}" for n in ips))
+    run_until_terminated(lambda: tun_down(dev))
+
+
+_COMMANDS = {
+    "tailscaled": _tailscaled,
+    "tailscale": _tailscale,
+    "zerotier-one": _zerotier,
+    "tincd": _tincd,
+    "tinc": _tinc,
+    "nebula": _nebula,
+    "edge": _edge,
+    "weron": _weron,
+}
+
+if __name__ == "__main__":
+    sys.exit(_COMMANDS[Path(sys.argv[0]).name](sys.argv[1:]) or 0)
@@ -0,0 +1,224 @@
+#pragma once
+
+// Dependencies between the inputs of a provider's editor schema (providers/*.json), shared by the GTK and Plasma editors.
+// An input can declare conditions on the values of other inputs:
+//
+//   "visible_if":  {"mode": "IP (Layer 3 / TUN)"}      shown (and its widget created) only while they hold
+//   "enabled_if":  {"exit-node": {"not": ""}}           editable only while they hold
+//   "required_if": {"mode": ["a", "b"]}                 required only while they hold, instead of "required"
+//
+// All the inputs of a condition must match one of the listed values (or none of them with "not"). Values compare as
+// they are saved in vpn.data: "true"/"false" for booleans, decimal integers.
+// A hidden or disabled input is inactive: it is not validated or saved, and it compares as unset ("") in the conditions
+// of others. set_value() re-evaluates only the inputs whose conditions refer to the changed one, and transitively the
+// dependents of the ones whose active state changed.
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+class FieldGraph
+{
+public:
+    enum Condition { VisibleIf, EnabledIf, RequiredIf, ConditionCount };
+
+    struct Clause {
+        int source;
+        std::vector<std::string> values;
+        bool negate;
+    };
+
+    struct Field {
+        std::string id;
+        std::string value;
+        bool required; // "required" of the schema
+        bool visible = true;
+        bool enabled = true;
+        bool required_now = false;
+        bool valid = true; // as last set_valid()
+        std::string error;
+        std::vector<Clause> conditions[ConditionCount];
+        std::vector<int> dependents;
+        int rank = 0; // topological order
+
+        bool active() const
+        {
+            return visible && enabled;
+        }
+    };
+
+    static const char *condition_name(Condition c)
+    {
+        static const char *names[] = {"visible_if", "enabled_if", "required_if"};
+        return names[c];
+    }
+
+    int add(const std::string &id, const std::string &value, bool required)
+    {
+        Field field;
+        field.id = id;
+        field.value = value;
+        field.required = field.required_now = required;
+        fields.push_back(std::move(field));
+        by_id[id] = fields.size() - 1;
+        return fields.size() - 1;
+    }
+
+    int index(const std::string &id) const
+    {
+        auto it = by_id.find(id);
+        return it == by_id.end() ? -1 : it->second;
+    }
+
+    bool add_clause(int field, Condition c, const std::string &source_id, const std::vector<std::string> &values, bool negate, std::string *error)
+    {
+        int source = index(source_id);
+        if (source < 0 || source == field) {
+            *error = fields[field].id + ": " + condition_name(c) + " refers to unknown input " + source_id;
+            return false;
+        }
+        fields[field].conditions[c].push_back(Clause{source, values, negate});
+        return true;
+    }
+
+    // Orders the inputs by their dependencies and evaluates all of them. The conditions of the inputs on a dependency
+    // cycle are dropped (false, `error` names them).
+    bool compile(std::string *error)
+    {
+        std::vector<int> pending(fields.size(), 0);
+        for (size_t i = 0; i < fields.size(); i++) {
+            std::set<int> sources;
+            for (const auto &clauses : fields[i].conditions)
+                for (const Clause &clause : clauses)
+                    sources.insert(clause.source);
+            for (int source : sources)
+                fields[source].dependents.push_back(i);
+            pending[i] = sources.size();
+        }
+        std::vector<int> order;
+        for (size_t i = 0; i < fields.size(); i++)
+            if (!pending[i])
+                order.push_back(i);
+        for (size_t k = 0; k < order.size(); k++)
+            for (int dependent : fields[order[k]].dependents)
+                if (--pending[dependent] == 0)
+                    order.push_back(dependent);
+        bool ok = order.size() == fields.size();
+        if (!ok) {
+            *error = "dependency cycle between inputs:";
+            for (size_t i = 0; i < fields.size(); i++) {
+                if (!pending[i])
+                    continue;
+                *error += " " + fields[i].id;
+                for (auto &clauses : fields[i].conditions)
+                    clauses.clear();
+                order.push_back(i);
+            }
+            for (Field &field : fields) {
+                std::vector<int> dependents;
+                for (int dependent : field.dependents)
+                    if (!pending[dependent])
+                        dependents.push_back(dependent);
+                field.dependents.swap(dependents);
+            }
+        }
+        for (size_t k = 0; k < order.size(); k++) {
+            fields[order[k]].rank = k;
+            evaluate(order[k]);
+        }
+        return ok;
+    }
+
+    // Sets the value of input `field`. Returns the inputs whose visible, enabled or required state changed, in
+    // dependency order.
+    std::vector<int> set_value(int field, const std::string &value)
+    {
+        std::vector<int> changed;
+        if (fields[field].value == value)
+            return changed;
+        fields[field].value = value;
+        if (!fields[field].active())
+            return changed; // compares as unset either way
+        std::set<std::pair<int, int>> queue; // (rank, input)
+        for (int dependent : fields[field].dependents)
+            queue.insert(std::make_pair(fields[dependent].rank, dependent));
+        while (!queue.empty()) {
+            int i = queue.begin()->second;
+            queue.erase(queue.begin());
+            Field &f = fields[i];
+            bool was_active = f.active(), was_required = f.required_now, was_visible = f.visible;
+            evaluate(i);
+            if (f.active() != was_active || f.required_now != was_required || f.visible != was_visible)
+                changed.push_back(i);
+            if (f.active() != was_active && !f.value.empty())
+                for (int dependent : f.dependents)
+                    queue.insert(std::make_pair(fields[dependent].rank, dependent));
+        }
+        return changed;
+    }
+
+    void set_valid(int field, bool valid, const std::string &error = std::string())
+    {
+        fields[field].valid = valid;
+        fields[field].error = valid ? std::string() : error;
+        update_invalid(field);
+    }
+
+    // The first active input failing its validation, -1 if the form is valid
+    int first_invalid() const
+    {
+        return invalid.empty() ? -1 : *invalid.begin();
+    }
+
+    const Field &operator[](int i) const
+    {
+        return fields[i];
+    }
+
+    int size() const
+    {
+        return fields.size();
+    }
+
+private:
+    std::vector<Field> fields;
+    std::map<std::string, int> by_id;
+    std::set<int> invalid; // active and not valid, by schema order
+
+    std::string effective_value(int i) const
+    {
+        return fields[i].active() ? fields[i].value : std::string();
+    }
+
+    bool matches(const std::vector<Clause> &clauses) const
+    {
+        for (const Clause &clause : clauses) {
+            std::string value = effective_value(clause.source);
+            bool found = false;
+            for (const std::string &v : clause.values)
+                found = found || v == value;
+            if (found == clause.negate)
+                return false;
+        }
+        return true;
+    }
+
+    void evaluate(int i)
+    {
+        Field &f = fields[i];
+        f.visible = matches(f.conditions[VisibleIf]);
+        f.enabled = matches(f.conditions[EnabledIf]);
+        f.required_now = f.conditions[RequiredIf].empty() ? f.required : matches(f.conditions[RequiredIf]);
+        update_invalid(i);
+    }
+
+    void update_invalid(int i)
+    {
+        if (fields[i].active() && !fields[i].valid)
+            invalid.insert(i);
+        else
+            invalid.erase(i);
+    }
+};
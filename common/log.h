@@ -0,0 +1,237 @@
+#pragma once
+
+// Logging of the GTK editor, the auth dialog and the Plasma applet UI, with structured key/value fields:
+//
+//   VPN_LOG_DEBUG("Set input value", "key", key, "value", value);
+//
+// The arguments are only evaluated (and strings built) if the level is enabled:
+// - GLib: info and debug with G_MESSAGES_DEBUG=all or the log domain (read once). Written with g_log_structured_array(),
+//   the fields become journal fields (KEY=value) and are appended to the message for the stderr writer.
+// - Qt (VPN_BUNDLE_LOG_QT_CATEGORY defined): the levels of that logging category, eg: QT_LOGGING_RULES="vpnBundle.debug=true".
+// VPN_LOG_TRACE is for per-keystroke/per-signal paths. It is compiled out unless VPN_BUNDLE_LOG_TRACE is 1 (default:
+// builds without NDEBUG), and is enabled with debug otherwise.
+
+#include <cstdio>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef VPN_BUNDLE_LOG_QT_CATEGORY
+#include <QtCore/QLoggingCategory>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#else
+#include <glib.h>
+#endif
+
+#ifndef VPN_BUNDLE_LOG_TRACE
+#ifdef NDEBUG
+#define VPN_BUNDLE_LOG_TRACE 0
+#else
+#define VPN_BUNDLE_LOG_TRACE 1
+#endif
+#endif
+
+enum class LogLevel { Critical, Warning, Message, Info, Debug, Trace };
+
+struct LogRecord {
+    std::string text; // message followed by the fields, logfmt style
+    std::vector<std::pair<const char *, std::string>> fields;
+};
+
+inline std::string log_value(const char *v)
+{
+    return v ? v : "(null)";
+}
+
+inline std::string log_value(const std::string &v)
+{
+    return v;
+}
+
+inline std::string log_value(bool v)
+{
+    return v ? "true" : "false";
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_arithmetic<T>::value, std::string>::type log_value(T v)
+{
+    return std::to_string(v);
+}
+
+inline std::string log_value(char **v) // NULL terminated, eg: argv
+{
+    std::string joined;
+    for (char **iter = v; iter && *iter; iter++) {
+        if (iter != v)
+            joined += ' ';
+        joined += *iter;
+    }
+    return joined;
+}
+
+inline std::string log_value(const void *v)
+{
+    char buf[2 + sizeof(void *) * 2 + 1];
+    snprintf(buf, sizeof(buf), "%p", v);
+    return buf;
+}
+
+#ifdef VPN_BUNDLE_LOG_QT_CATEGORY
+inline std::string log_value(const QString &v)
+{
+    return v.toStdString();
+}
+
+inline std::string log_value(const QStringList &v)
+{
+    return v.join(',').toStdString();
+}
+#endif
+
+inline void log_append_fields(LogRecord &)
+{
+}
+
+template <typename V, typename... Rest>
+inline void log_append_fields(LogRecord &record, const char *key, const V &value, const Rest &...rest)
+{
+    std::string v = log_value(value);
+    record.text += ' ';
+    record.text += key;
+    record.text += '=';
+    if (v.empty() || v.find_first_of(" \t\n\"") != std::string::npos) {
+        record.text += '"';
+        for (char c : v) {
+            if (c == '"' || c == '\\')
+                record.text += '\\';
+            record.text += c == '\n' ? ' ' : c;
+        }
+        record.text += '"';
+    } else {
+        record.text += v;
+    }
+    record.fields.emplace_back(key, std::move(v));
+    log_append_fields(record, rest...);
+}
+
+#ifdef VPN_BUNDLE_LOG_QT_CATEGORY
+
+#define VPN_LOG_DOMAIN_ nullptr
+
+inline bool log_enabled(LogLevel level, const char *)
+{
+    const QLoggingCategory &category = VPN_BUNDLE_LOG_QT_CATEGORY();
+    switch (level) {
+    case LogLevel::Critical:
+        return category.isCriticalEnabled();
+    case LogLevel::Warning:
+        return category.isWarningEnabled();
+    case LogLevel::Message:
+    case LogLevel::Info:
+        return category.isInfoEnabled();
+    default:
+        return category.isDebugEnabled();
+    }
+}
+
+inline void log_write(LogLevel level, const char *, const char *file, int line, const char *func, const LogRecord &record)
+{
+    QMessageLogger logger(file, line, func, VPN_BUNDLE_LOG_QT_CATEGORY().categoryName());
+    switch (level) {
+    case LogLevel::Critical:
+        logger.critical("%s", record.text.c_str());
+        break;
+    case LogLevel::Warning:
+        logger.warning("%s", record.text.c_str());
+        break;
+    case LogLevel::Message:
+    case LogLevel::Info:
+        logger.info("%s", record.text.c_str());
+        break;
+    default:
+        logger.debug("%s", record.text.c_str());
+    }
+}
+
+#else
+
+#define VPN_LOG_DOMAIN_ G_LOG_DOMAIN
+
+inline bool log_enabled(LogLevel level, const char *domain)
+{
+    if (level <= LogLevel::Message)
+        return true;
+    // like g_log_writer_default_would_drop()
+    static const std::string debug_domains = []() -> std::string {
+        const char *env = g_getenv("G_MESSAGES_DEBUG");
+        return env ? std::string(" ") + env + " " : "";
+    }();
+    if (debug_domains.empty())
+        return false;
+    if (debug_domains.find(" all ") != std::string::npos)
+        return true;
+    return domain && debug_domains.find(std::string(" ") + domain + " ") != std::string::npos;
+}
+
+inline void log_write(LogLevel level, const char *domain, const char *file, int line, const char *func, const LogRecord &record)
+{
+    static const GLogLevelFlags g_levels[] =
+        {G_LOG_LEVEL_CRITICAL, G_LOG_LEVEL_WARNING, G_LOG_LEVEL_MESSAGE, G_LOG_LEVEL_INFO, G_LOG_LEVEL_DEBUG, G_LOG_LEVEL_DEBUG};
+    static const char *priorities[] = {"4", "4", "5", "6", "7", "7"}; // syslog, as g_log_structured() sets them
+    std::string line_str = std::to_string(line);
+    std::vector<std::string> names;
+    names.reserve(record.fields.size());
+    std::vector<GLogField> fields = {
+        {"MESSAGE", record.text.c_str(), -1},
+        {"PRIORITY", priorities[(int)level], -1},
+        {"CODE_FILE", file, -1},
+        {"CODE_LINE", line_str.c_str(), -1},
+        {"CODE_FUNC", func, -1},
+    };
+    if (domain)
+        fields.push_back({"GLIB_DOMAIN", domain, -1});
+    for (const auto &field : record.fields) {
+        // journal field names: upper case letters, digits and '_'
+        std::string name = field.first;
+        for (char &c : name)
+            c = g_ascii_isalnum(c) ? g_ascii_toupper(c) : '_';
+        names.push_back(std::move(name));
+        fields.push_back({names.back().c_str(), field.second.c_str(), -1});
+    }
+    g_log_structured_array(g_levels[(int)level], fields.data(), fields.size());
+}
+
+#endif
+
+template <typename... Fields>
+inline void log_emit(LogLevel level, const char *domain, const char *file, int line, const char *func, const char *message, const Fields &...fields)
+{
+    LogRecord record;
+    record.text = message;
+    log_append_fields(record, fields...);
+    log_write(level, domain, file, line, func, record);
+}
+
+#define VPN_LOG_IS_ENABLED(level) log_enabled(LogLevel::level, VPN_LOG_DOMAIN_)
+
+#define VPN_LOG_AT_(level, ...)                                                                                                                                \
+    do {                                                                                                                                                       \
+        if (log_enabled(level, VPN_LOG_DOMAIN_))                                                                                                               \
+            log_emit(level, VPN_LOG_DOMAIN_, __FILE__, __LINE__, __func__, __VA_ARGS__);                                                                       \
+    } while (0)
+
+#define VPN_LOG_CRITICAL(...) VPN_LOG_AT_(LogLevel::Critical, __VA_ARGS__)
+#define VPN_LOG_WARNING(...) VPN_LOG_AT_(LogLevel::Warning, __VA_ARGS__)
+#define VPN_LOG_MESSAGE(...) VPN_LOG_AT_(LogLevel::Message, __VA_ARGS__)
+#define VPN_LOG_INFO(...) VPN_LOG_AT_(LogLevel::Info, __VA_ARGS__)
+#define VPN_LOG_DEBUG(...) VPN_LOG_AT_(LogLevel::Debug, __VA_ARGS__)
+#if VPN_BUNDLE_LOG_TRACE
+#define VPN_LOG_TRACE(...) VPN_LOG_AT_(LogLevel::Trace, __VA_ARGS__)
+#else
+#define VPN_LOG_TRACE(...)                                                                                                                                     \
+    do {                                                                                                                                                       \
+    } while (0)
+#endif
@@ -0,0 +1,94 @@
+#pragma once
+
+// Connect-phase trace spans, appended as Chrome trace events to <connection uuid>.auth-dialog.json, next to the trace
+// file of plugin-service (see plugin-service/tracing.py). The connection uuid is the correlation id. The trace
+// directory may be world-writable: only a regular file (not a symlink) owned by this user is written.
+// Enabled when $VPN_BUNDLE_TRACE_DIR is set or <runtime dir>/vpn-bundle-trace/ exists.
+
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+inline std::string &trace_connection_uuid()
+{
+    static std::string uuid;
+    return uuid;
+}
+
+inline std::string trace_dir()
+{
+    static std::string dir = []() -> std::string {
+        const char *env_dir = g_getenv("VPN_BUNDLE_TRACE_DIR");
+        if (env_dir && *env_dir)
+            return env_dir;
+        // plugin-service runs as root without XDG_RUNTIME_DIR, while the auth dialog runs in the user session
+        const char *candidates[] = {g_getenv("XDG_RUNTIME_DIR"), "/var/run"};
+        for (const char *runtime_dir : candidates) {
+            if (!runtime_dir)
+                continue;
+            std::string path = std::string(runtime_dir) + "/vpn-bundle-trace";
+            if (g_file_test(path.c_str(), G_FILE_TEST_IS_DIR))
+                return path;
+        }
+        return "";
+    }();
+    return dir;
+}
+
+inline void trace_record(const char *name, gint64 start_us, gint64 end_us)
+{
+    const std::string &uuid = trace_connection_uuid();
+    if (uuid.empty() || trace_dir().empty())
+        return;
+    char *escaped_uuid = g_strescape(uuid.c_str(), nullptr);
+    char *event = g_strdup_printf("{\"name\":\"%s\",\"cat\":\"auth-dialog\",\"ph\":\"X\",\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT
+                                  ",\"pid\":%d,\"tid\":%ld,\"args\":{\"uuid\":\"%s\"}},\n",
+                                  name,
+                                  start_us,
+                                  end_us - start_us,
+                                  getpid(),
+                                  (long)syscall(SYS_gettid),
+                                  escaped_uuid);
+    std::string path = trace_dir() + "/" + uuid + ".auth-dialog.json";
+    // O_NONBLOCK: a FIFO planted in its place fails with ENXIO instead of blocking
+    int fd = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid()) {
+            g_debug("Not writing trace file %s: not a regular file of ours", path.c_str());
+        } else {
+            flock(fd, LOCK_EX); // shared with the other auth dialogs of the connection
+            if (fstat(fd, &st) == 0 && st.st_size == 0 && write(fd, "[\n", 2) < 0)
+                g_debug("Could not write trace file: %s", path.c_str());
+            if (write(fd, event, strlen(event)) < 0)
+                g_debug("Could not write trace file: %s", path.c_str());
+        }
+        close(fd);
+    }
+    g_free(event);
+    g_free(escaped_uuid);
+}
+
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name)
+        : name(name)
+        , start_us(g_get_real_time())
+    {
+    }
+    ~TraceSpan()
+    {
+        trace_record(name, start_us, g_get_real_time());
+    }
+
+private:
+    const char *name;
+    gint64 start_us;
+};
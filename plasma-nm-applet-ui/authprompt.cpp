@@ -47,10 +47,7 @@ QDialog *AuthPromptDialog::_getCurrentDialogWidget()
     // Find top-level widget as this should be the QDialog itself
     QWidget *widget = parentWidget();
     while (widget->parentWidget() != nullptr) {
-        qCDebug(vpnBundle,
-                "widget->parentWidget: %s -> %s",
-                widget->objectName().toStdString().c_str(),
-                widget->parentWidget()->objectName().toStdString().c_str());
+        VPN_LOG_TRACE("_getCurrentDialogWidget()", "widget", widget->objectName(), "parent", widget->parentWidget()->objectName());
         widget = widget->parentWidget();
     }
     return qobject_cast<QDialog *>(widget);
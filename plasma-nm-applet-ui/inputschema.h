@@ -0,0 +1,90 @@
+#pragma once
+
+// Provider schema (THIS_VPN_PROVIDER_INPUT_FORM_JSON) helpers shared by the Plasma settings forms
+
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QString>
+
+#include <string>
+#include <vector>
+
+#include "common/field-graph.h"
+#include "common/nm-service-defines.h"
+
+inline QJsonArray inputFormSections()
+{
+    return QJsonDocument::fromJson(QString(THIS_VPN_PROVIDER_INPUT_FORM_JSON).toUtf8()).array();
+}
+
+inline int inputFormInputCount(const QJsonArray &sections)
+{
+    int count = 0;
+    for (const QJsonValue &section : sections)
+        count += section.toObject()["inputs"].toArray().size();
+    return count;
+}
+
+inline bool isKnownInputType(const QString &type)
+{
+    return type == "integer" || type == "string" || type == "array" || type == "boolean" || type == "enum";
+}
+
+// The value of an input without connection data, as the editors save it
+inline QString inputDefaultValue(const QJsonObject &defObj, const QString &type)
+{
+    if (type == "integer")
+        return QString::number(defObj["default"].isDouble() ? defObj["default"].toInt() : defObj["min_value"].toInt());
+    if (type == "boolean")
+        return defObj["default"].toBool(false) ? "true" : "false";
+    if (type == "array")
+        return QString::fromUtf8(QJsonDocument(defObj["default"].toArray()).toJson(QJsonDocument::Compact));
+    if (type == "enum" && !defObj["default"].isString()) {
+        QJsonArray values = defObj["values"].toArray();
+        return values.isEmpty() ? QString() : values.first().toString();
+    }
+    return defObj["default"].toString();
+}
+
+// A value of a condition, as the values of vpn.data compare with it
+inline std::string conditionValue(const QJsonValue &value)
+{
+    if (value.isBool())
+        return value.toBool() ? "true" : "false";
+    if (value.isDouble())
+        return std::to_string(value.toInt());
+    return value.toString().toStdString();
+}
+
+// Adds "visible_if", "enabled_if" and "required_if" of an input def to the graph, see common/field-graph.h
+inline bool addInputConditions(FieldGraph &graph, int node, const QJsonObject &defObj, std::string *error)
+{
+    for (int c = 0; c < FieldGraph::ConditionCount; c++) {
+        FieldGraph::Condition condition = (FieldGraph::Condition)c;
+        QJsonValue conditionValueJson = defObj[FieldGraph::condition_name(condition)];
+        if (conditionValueJson.isUndefined())
+            continue;
+        if (!conditionValueJson.isObject()) {
+            *error = graph[node].id + ": " + FieldGraph::condition_name(condition) + " must be an object";
+            return false;
+        }
+        QJsonObject conditionObj = conditionValueJson.toObject();
+        for (auto it = conditionObj.constBegin(); it != conditionObj.constEnd(); ++it) {
+            QJsonValue valuesJson = it.value();
+            bool negate = valuesJson.isObject() && valuesJson.toObject().contains("not");
+            if (negate)
+                valuesJson = valuesJson.toObject()["not"];
+            std::vector<std::string> values;
+            if (valuesJson.isArray()) {
+                for (const QJsonValue &value : valuesJson.toArray())
+                    values.push_back(conditionValue(value));
+            } else {
+                values.push_back(conditionValue(valuesJson));
+            }
+            if (!graph.add_clause(node, condition, it.key().toStdString(), values, negate, error))
+                return false;
+        }
+    }
+    return true;
+}
@@ -3,6 +3,8 @@
 #include <KPluginFactory>
 
 #include "authprompt.h"
+#include "inputschema.h"
+#include "settingtreeview.h"
 #include "settingview.h"
 
 Q_LOGGING_CATEGORY(vpnBundle, "vpnBundle")
@@ -16,14 +18,24 @@ VPNProviderUiPlugin::VPNProviderUiPlugin(QObject *parent, const QVariantList &)
 
 VPNProviderUiPlugin::~VPNProviderUiPlugin() = default;
 
+// Above this, the settings form is a single item view instead of a widget per input.
+// VPN_BUNDLE_PLASMA_FORM=tree or =widgets overrides it.
+static const int LargeSchemaInputCount = 48;
+
 SettingWidget *VPNProviderUiPlugin::widget(const NetworkManager::VpnSetting::Ptr &setting, QWidget *parent)
 {
+    static const int inputCount = inputFormInputCount(inputFormSections());
+    const QByteArray form = qgetenv("VPN_BUNDLE_PLASMA_FORM");
+    if (form == "tree" || (form != "widgets" && inputCount > LargeSchemaInputCount)) {
+        VPN_LOG_DEBUG("VPNProviderUiPlugin::widget() new VPNProviderSettingTreeView", "inputs", inputCount);
+        return new VPNProviderSettingTreeView(setting, parent);
+    }
     return new VPNProviderSettingView(setting, parent);
 }
 
 SettingWidget *VPNProviderUiPlugin::askUser(const NetworkManager::VpnSetting::Ptr &setting, const QStringList &hints, QWidget *parent)
 {
-    qCInfo(vpnBundle, ">>> VPNProviderUiPlugin::askUser() : new AuthPromptDialog()");
+    VPN_LOG_INFO("VPNProviderUiPlugin::askUser() new AuthPromptDialog", "hints", hints);
     return new AuthPromptDialog(setting, hints, parent);
 }
 
@@ -0,0 +1,365 @@
+#include "settingmodel.h"
+
+#include <QtWidgets/QComboBox>
+#include <QtWidgets/QLineEdit>
+#include <QtWidgets/QPlainTextEdit>
+#include <QtWidgets/QSpinBox>
+
+#include <QtCore/QJsonDocument>
+#include <QtGui/QBrush>
+#include <QtGui/QFont>
+
+#include <klocalizedstring.h>
+
+#include "inputschema.h"
+
+VPNProviderSettingModel::VPNProviderSettingModel(const NMStringMap &data, QObject *parent)
+    : QAbstractItemModel(parent)
+    , m_data(data)
+{
+    const QJsonArray sections = inputFormSections();
+    m_inputs.reserve(inputFormInputCount(sections));
+    for (const QJsonValue &sectionValue : sections) {
+        QJsonObject sectionObj = sectionValue.toObject();
+        Section section{sectionObj["section"].toString(), sectionObj["description"].toString(), m_graph.size(), 0};
+        for (const QJsonValue &inputValue : sectionObj["inputs"].toArray()) {
+            QJsonObject defObj = inputValue.toObject();
+            QString id = defObj["id"].toString();
+            QString type = defObj["type"].toString("string");
+            if (id.isEmpty() || !isKnownInputType(type)) {
+                VPN_LOG_CRITICAL("Invalid input", "type", type, "id", id);
+                continue;
+            }
+            m_graph.add(id.toStdString(),
+                        (data.contains(id) ? data.value(id) : inputDefaultValue(defObj, type)).toStdString(),
+                        defObj.value("required").toBool(false));
+            m_inputs.append(Input{defObj, type, (int)m_sections.size()});
+            section.count++;
+        }
+        m_sections.append(section);
+    }
+    std::string graphError;
+    for (int node = 0; node < m_graph.size(); node++) {
+        if (!addInputConditions(m_graph, node, m_inputs[node].def, &graphError)) {
+            VPN_LOG_CRITICAL("Invalid input condition", "error", graphError);
+            m_schemaError = QString::fromStdString(graphError);
+            break;
+        }
+    }
+    if (!m_graph.compile(&graphError)) {
+        VPN_LOG_WARNING("Ignoring input conditions", "error", graphError);
+    }
+    for (int node = 0; node < m_graph.size(); node++) {
+        validate(node);
+    }
+    VPN_LOG_DEBUG("VPNProviderSettingModel()", "sections", m_sections.size(), "inputs", m_graph.size());
+}
+
+// Section rows have the internal id 0, input rows the row of their section + 1
+QModelIndex VPNProviderSettingModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (!hasIndex(row, column, parent))
+        return QModelIndex();
+    return createIndex(row, column, quintptr(parent.isValid() ? parent.row() + 1 : 0));
+}
+
+QModelIndex VPNProviderSettingModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid() || child.internalId() == 0)
+        return QModelIndex();
+    return createIndex(child.internalId() - 1, 0, quintptr(0));
+}
+
+int VPNProviderSettingModel::rowCount(const QModelIndex &parent) const
+{
+    if (!parent.isValid())
+        return m_sections.size();
+    if (parent.internalId() == 0 && parent.column() == 0)
+        return m_sections[parent.row()].count;
+    return 0;
+}
+
+int VPNProviderSettingModel::columnCount(const QModelIndex &) const
+{
+    return ColumnCount;
+}
+
+int VPNProviderSettingModel::nodeOf(const QModelIndex &index) const
+{
+    return m_sections[index.internalId() - 1].first + index.row();
+}
+
+QModelIndex VPNProviderSettingModel::indexOf(int node, int column) const
+{
+    int section = m_inputs[node].section;
+    return createIndex(node - m_sections[section].first, column, quintptr(section + 1));
+}
+
+QVariant VPNProviderSettingModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+    if (index.internalId() == 0) {
+        const Section &section = m_sections[index.row()];
+        switch (role) {
+        case Qt::DisplayRole:
+            return tr2i18n(section.title.toUtf8(), nullptr);
+        case Qt::ToolTipRole:
+            return section.description.isEmpty() ? QVariant() : tr2i18n(section.description.toUtf8(), nullptr);
+        case Qt::FontRole: {
+            QFont font;
+            font.setBold(true);
+            return font;
+        }
+        }
+        return QVariant();
+    }
+    int node = nodeOf(index);
+    const FieldGraph::Field &field = m_graph[node];
+    const Input &input = m_inputs[node];
+    switch (role) {
+    case InputTypeRole:
+        return input.type;
+    case InputDefRole:
+        return input.def;
+    case Qt::ToolTipRole:
+        if (!field.valid)
+            return QString::fromStdString(field.error);
+        return tr2i18n(input.def["description"].toString().toUtf8(), nullptr);
+    case Qt::ForegroundRole:
+        return field.valid || !field.active() ? QVariant() : QBrush(Qt::red);
+    }
+    if (index.column() == LabelColumn) {
+        if (role != Qt::DisplayRole)
+            return QVariant();
+        QString label = input.def["label"].toString();
+        return label.isEmpty() ? QString::fromStdString(field.id) : tr2i18n(label.toUtf8(), nullptr);
+    }
+    QString value = QString::fromStdString(field.value);
+    if (input.type == "boolean") {
+        return role == Qt::CheckStateRole ? QVariant(value == "true" ? Qt::Checked : Qt::Unchecked) : QVariant();
+    }
+    if (role == Qt::EditRole)
+        return value;
+    if (role != Qt::DisplayRole)
+        return QVariant();
+    if (input.def["is_secret"].toBool(false))
+        return QString(value.size(), QChar(0x2022));
+    if (input.type == "array") {
+        QStringList entries;
+        for (const QJsonValue &entry : QJsonDocument::fromJson(value.toUtf8()).array())
+            entries << entry.toString();
+        return entries.join(", ");
+    }
+    return value;
+}
+
+bool VPNProviderSettingModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if (!index.isValid() || index.internalId() == 0 || index.column() != ValueColumn)
+        return false;
+    int node = nodeOf(index);
+    if (role == Qt::CheckStateRole && m_inputs[node].type == "boolean") {
+        setValue(node, value.toInt() == Qt::Checked ? "true" : "false");
+        return true;
+    }
+    if (role != Qt::EditRole)
+        return false;
+    setValue(node, value.toString());
+    return true;
+}
+
+Qt::ItemFlags VPNProviderSettingModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return Qt::NoItemFlags;
+    if (index.internalId() == 0)
+        return Qt::ItemIsEnabled;
+    int node = nodeOf(index);
+    if (!m_graph[node].enabled)
+        return Qt::NoItemFlags;
+    Qt::ItemFlags itemFlags = Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+    if (index.column() == ValueColumn)
+        itemFlags |= m_inputs[node].type == "boolean" ? Qt::ItemIsUserCheckable : Qt::ItemIsEditable;
+    return itemFlags;
+}
+
+void VPNProviderSettingModel::load(const NMStringMap &data)
+{
+    m_data = data;
+    for (auto it = data.constBegin(); it != data.constEnd(); ++it) {
+        VPN_LOG_TRACE("load() Found VpnSettings.data", "key", it.key(), "value", it.value());
+        if (it.value().isEmpty()) {
+            continue;
+        }
+        int node = m_graph.index(it.key().toStdString());
+        if (node < 0) {
+            VPN_LOG_WARNING("load() No input", "key", it.key());
+            continue;
+        }
+        setValue(node, it.value());
+    }
+}
+
+NMStringMap VPNProviderSettingModel::vpnData() const
+{
+    NMStringMap data;
+    for (int node = 0; node < m_graph.size(); node++) {
+        const FieldGraph::Field &field = m_graph[node];
+        QString id = QString::fromStdString(field.id);
+        if (!field.visible) {
+            continue; // hidden by its conditions
+        }
+        if (!field.enabled) {
+            // disabled by its conditions: keeps the value the connection has, if any
+            if (!m_data.value(id).isEmpty()) {
+                data.insert(id, m_data.value(id));
+            }
+            continue;
+        }
+        data.insert(id, QString::fromStdString(field.value));
+    }
+    return data;
+}
+
+bool VPNProviderSettingModel::isValid() const
+{
+    return m_schemaError.isEmpty() && m_graph.first_invalid() < 0;
+}
+
+QString VPNProviderSettingModel::schemaError() const
+{
+    return m_schemaError;
+}
+
+bool VPNProviderSettingModel::isVisible(const QModelIndex &index) const
+{
+    return index.internalId() == 0 || m_graph[nodeOf(index)].visible;
+}
+
+// Only the changed input and the ones whose conditions depend on it are re-evaluated
+void VPNProviderSettingModel::setValue(int node, const QString &value)
+{
+    std::vector<int> changed = m_graph.set_value(node, value.toStdString());
+    validate(node);
+    Q_EMIT dataChanged(indexOf(node, LabelColumn), indexOf(node, ValueColumn));
+    for (int dependent : changed) {
+        validate(dependent);
+        Q_EMIT dataChanged(indexOf(dependent, LabelColumn), indexOf(dependent, ValueColumn));
+        Q_EMIT inputStateChanged(indexOf(dependent));
+    }
+}
+
+void VPNProviderSettingModel::validate(int node)
+{
+    const FieldGraph::Field &field = m_graph[node];
+    const QJsonObject &defObj = m_inputs[node].def;
+    QString value = QString::fromStdString(field.value);
+    QString id = QString::fromStdString(field.id);
+    QString error;
+    if (field.required_now && value.isEmpty()) {
+        error = QStringLiteral("Property %1 is required").arg(id);
+    } else if (m_inputs[node].type == "string" && !value.isEmpty()) {
+        int minLength = defObj["min_length"].toInt(0);
+        int maxLength = defObj["max_length"].toInt(0);
+        QString pattern = defObj["regex"].toString();
+        if (minLength && value.length() < minLength) {
+            error = QStringLiteral("Property %1 must be at least %2 characters long").arg(id).arg(minLength);
+        } else if (maxLength && value.length() > maxLength) {
+            error = QStringLiteral("Property %1 must be at most %2 characters long").arg(id).arg(maxLength);
+        } else if (!pattern.isEmpty()) {
+            auto regex = m_regexes.find(node);
+            if (regex == m_regexes.end())
+                regex = m_regexes.insert(node, QRegularExpression(QRegularExpression::anchoredPattern(pattern)));
+            if (regex->isValid() && !regex->match(value).hasMatch())
+                error = QStringLiteral("Property %1 must match regex %2").arg(id, pattern);
+        }
+    }
+    m_graph.set_valid(node, error.isEmpty(), error.toStdString());
+}
+
+QWidget *VPNProviderSettingDelegate::createEditor(QWidget *parent, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    QString type = index.data(VPNProviderSettingModel::InputTypeRole).toString();
+    QJsonObject defObj = index.data(VPNProviderSettingModel::InputDefRole).toJsonObject();
+    if (type == "integer") {
+        QSpinBox *sb = new QSpinBox(parent);
+        sb->setRange(defObj["min_value"].toInt(0), defObj["max_value"].toInt(999999));
+        return sb;
+    } else if (type == "string") {
+        QLineEdit *le = new QLineEdit(parent);
+        if (defObj["is_secret"].toBool(false))
+            le->setEchoMode(QLineEdit::PasswordEchoOnEdit);
+        if (defObj["max_length"].isDouble())
+            le->setMaxLength(defObj["max_length"].toInt());
+        if (defObj["placeholder"].isString())
+            le->setPlaceholderText(defObj["placeholder"].toString());
+        return le;
+    } else if (type == "enum") {
+        QComboBox *cmb = new QComboBox(parent);
+        for (const QJsonValue &value : defObj["values"].toArray()) {
+            cmb->addItem(value.toString());
+        }
+        return cmb;
+    } else if (type == "array") {
+        QPlainTextEdit *te = new QPlainTextEdit(parent);
+        te->setPlaceholderText(i18n("One entry per line"));
+        return te;
+    }
+    // booleans are check boxes of the view
+    return QStyledItemDelegate::createEditor(parent, option, index);
+}
+
+void VPNProviderSettingDelegate::setEditorData(QWidget *editor, const QModelIndex &index) const
+{
+    QString value = index.data(Qt::EditRole).toString();
+    if (QSpinBox *sb = qobject_cast<QSpinBox *>(editor)) {
+        sb->setValue(value.toInt());
+    } else if (QLineEdit *le = qobject_cast<QLineEdit *>(editor)) {
+        le->setText(value);
+    } else if (QComboBox *cmb = qobject_cast<QComboBox *>(editor)) {
+        cmb->setCurrentText(value);
+    } else if (QPlainTextEdit *te = qobject_cast<QPlainTextEdit *>(editor)) {
+        QStringList entries;
+        for (const QJsonValue &entry : QJsonDocument::fromJson(value.toUtf8()).array())
+            entries << entry.toString();
+        te->setPlainText(entries.join('\n'));
+    } else {
+        QStyledItemDelegate::setEditorData(editor, index);
+    }
+}
+
+void VPNProviderSettingDelegate::setModelData(QWidget *editor, QAbstractItemModel *model, const QModelIndex &index) const
+{
+    QString value;
+    if (QSpinBox *sb = qobject_cast<QSpinBox *>(editor)) {
+        sb->interpretText();
+        value = QString::number(sb->value());
+    } else if (QLineEdit *le = qobject_cast<QLineEdit *>(editor)) {
+        value = le->text();
+    } else if (QComboBox *cmb = qobject_cast<QComboBox *>(editor)) {
+        value = cmb->currentText();
+    } else if (QPlainTextEdit *te = qobject_cast<QPlainTextEdit *>(editor)) {
+        QJsonArray jsonArray;
+        for (const QString &entry : te->toPlainText().split('\n', Qt::SkipEmptyParts)) {
+            jsonArray.append(entry);
+        }
+        value = QString::fromUtf8(QJsonDocument(jsonArray).toJson(QJsonDocument::Compact));
+    } else {
+        QStyledItemDelegate::setModelData(editor, model, index);
+        return;
+    }
+    model->setData(index, value, Qt::EditRole);
+}
+
+void VPNProviderSettingDelegate::updateEditorGeometry(QWidget *editor, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    if (qobject_cast<QPlainTextEdit *>(editor)) {
+        // drawn over the next rows while editing, the rows keep their uniform height
+        QRect rect = option.rect;
+        rect.setHeight(qMax(rect.height(), editor->fontMetrics().lineSpacing() * 6));
+        editor->setGeometry(rect);
+        return;
+    }
+    QStyledItemDelegate::updateEditorGeometry(editor, option, index);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <NetworkManagerQt/VpnSetting>
+
+#include <QtCore/QAbstractItemModel>
+#include <QtCore/QHash>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonObject>
+#include <QtCore/QRegularExpression>
+#include <QtCore/QVector>
+#include <QtWidgets/QStyledItemDelegate>
+
+#include "common/field-graph.h"
+#include "shared.h"
+
+// The inputs of the provider schema as a two level tree: sections, and their inputs with the columns label and value.
+// Values are kept as they are saved in vpn.data (Qt::EditRole), in the FieldGraph that also evaluates the conditions
+// of the inputs. No widget is created per input: VPNProviderSettingDelegate creates the editor of the edited row only.
+class VPNProviderSettingModel : public QAbstractItemModel
+{
+    Q_OBJECT
+public:
+    enum Column { LabelColumn, ValueColumn, ColumnCount };
+    enum Role { InputTypeRole = Qt::UserRole + 1, InputDefRole };
+
+    explicit VPNProviderSettingModel(const NMStringMap &data, QObject *parent = nullptr);
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+
+    void load(const NMStringMap &data);
+    // The values of the active inputs, and the loaded ones of the visible but disabled inputs
+    NMStringMap vpnData() const;
+    bool isValid() const;
+    bool isVisible(const QModelIndex &index) const;
+    // Invalid input conditions of the schema, rejected like the GTK editor does: the form cannot be saved
+    QString schemaError() const;
+
+Q_SIGNALS:
+    // The visible, enabled or required state of the input at `index` changed
+    void inputStateChanged(const QModelIndex &index);
+
+private:
+    struct Section {
+        QString title;
+        QString description;
+        int first; // graph index of its first input
+        int count;
+    };
+    struct Input {
+        QJsonObject def; // shared with the parsed schema
+        QString type;
+        int section;
+    };
+
+    int nodeOf(const QModelIndex &index) const;
+    QModelIndex indexOf(int node, int column = LabelColumn) const;
+    void setValue(int node, const QString &value);
+    void validate(int node);
+
+    QVector<Section> m_sections;
+    QVector<Input> m_inputs; // by graph index
+    QHash<int, QRegularExpression> m_regexes; // compiled on the first validation of a non-empty value
+    FieldGraph m_graph;
+    NMStringMap m_data; // of the connection, saved as is for the disabled inputs
+    QString m_schemaError;
+};
+
+class VPNProviderSettingDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+public:
+    using QStyledItemDelegate::QStyledItemDelegate;
+
+    QWidget *createEditor(QWidget *parent, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+    void setEditorData(QWidget *editor, const QModelIndex &index) const override;
+    void setModelData(QWidget *editor, QAbstractItemModel *model, const QModelIndex &index) const override;
+    void updateEditorGeometry(QWidget *editor, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+};
@@ -0,0 +1,99 @@
+#include "settingtreeview.h"
+
+#include <QtWidgets/QHeaderView>
+#include <QtWidgets/QLabel>
+#include <QtWidgets/QTreeView>
+#include <QtWidgets/QVBoxLayout>
+
+#include <QtDBus/QDBusMetaType>
+
+#include <klocalizedstring.h>
+
+#include "common/nm-service-defines.h"
+#include "settingmodel.h"
+
+VPNProviderSettingTreeView::VPNProviderSettingTreeView(const NetworkManager::VpnSetting::Ptr &setting, QWidget *parent, Qt::WindowFlags f)
+    : SettingWidget(setting, parent, f)
+    , m_setting(setting)
+{
+    VPN_LOG_DEBUG("SettingTreeView::SettingTreeView()");
+
+    qDBusRegisterMetaType<NMStringMap>();
+
+    // the conditions of the inputs are evaluated on the values of the connection
+    m_model = new VPNProviderSettingModel(setting && !setting->isNull() ? setting->data() : NMStringMap(), this);
+    m_valid = m_model->isValid();
+
+    m_view = new QTreeView(this);
+    m_view->setModel(m_model);
+    m_view->setItemDelegateForColumn(VPNProviderSettingModel::ValueColumn, new VPNProviderSettingDelegate(m_view));
+    m_view->setHeaderHidden(true);
+    m_view->setUniformRowHeights(true);
+    m_view->setAlternatingRowColors(true);
+    m_view->setEditTriggers(QAbstractItemView::CurrentChanged | QAbstractItemView::SelectedClicked | QAbstractItemView::EditKeyPressed);
+    m_view->header()->setSectionResizeMode(VPNProviderSettingModel::LabelColumn, QHeaderView::ResizeToContents);
+    for (int section = 0; section < m_model->rowCount(); section++) {
+        QModelIndex sectionIndex = m_model->index(section, 0);
+        m_view->setFirstColumnSpanned(section, QModelIndex(), true);
+        for (int row = 0; row < m_model->rowCount(sectionIndex); row++) {
+            m_view->setRowHidden(row, sectionIndex, !m_model->isVisible(m_model->index(row, 0, sectionIndex)));
+        }
+    }
+    m_view->expandAll();
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    if (!m_model->schemaError().isEmpty()) {
+        QLabel *lbl = new QLabel(i18n("Invalid provider schema: %1", m_model->schemaError()), this);
+        lbl->setWordWrap(true);
+        layout->addWidget(lbl);
+        m_view->setEnabled(false);
+    }
+    layout->addWidget(m_view);
+
+    connect(m_model, &VPNProviderSettingModel::inputStateChanged, this, [this](const QModelIndex &index) {
+        m_view->setRowHidden(index.row(), index.parent(), !m_model->isVisible(index));
+    });
+    connect(m_model, &QAbstractItemModel::dataChanged, this, [this]() {
+        Q_EMIT settingChanged();
+        if (m_model->isValid() != m_valid) {
+            m_valid = !m_valid;
+            Q_EMIT validChanged(m_valid);
+        }
+    });
+
+    // Connect for setting check
+    watchChangedSetting();
+
+    KAcceleratorManager::manage(this);
+
+    if (setting && !setting->isNull()) {
+        // NOLINTNEXTLINE    // Or we gets "clang-analyzer-cplusplus.VirtualCall")
+        loadConfig(setting);
+    }
+}
+
+VPNProviderSettingTreeView::~VPNProviderSettingTreeView()
+{
+}
+
+void VPNProviderSettingTreeView::loadConfig(const NetworkManager::Setting::Ptr &setting)
+{
+    m_model->load(m_setting->data());
+    // NOLINTNEXTLINE    // Or we gets "clang-analyzer-cplusplus.VirtualCall")
+    loadSecrets(setting);
+}
+
+QVariantMap VPNProviderSettingTreeView::setting() const
+{
+    NetworkManager::VpnSetting setting;
+    setting.setServiceType(QLatin1String(THIS_VPN_PROVIDER_DBUS_SERVICE));
+    setting.setData(m_model->vpnData());
+    setting.setSecrets(NMStringMap());
+    return setting.toMap();
+}
+
+bool VPNProviderSettingTreeView::isValid() const
+{
+    return m_model->isValid();
+}
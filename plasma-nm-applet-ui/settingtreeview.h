@@ -0,0 +1,28 @@
+#pragma once
+
+#include <NetworkManagerQt/VpnSetting>
+
+#include "common/plasma/settingwidget.h"
+#include "shared.h"
+
+class QTreeView;
+class VPNProviderSettingModel;
+
+// Settings form over VPNProviderSettingModel: a single view instead of a widget per input, for large schemas
+class VPNProviderSettingTreeView : public SettingWidget
+{
+    Q_OBJECT
+public:
+    explicit VPNProviderSettingTreeView(const NetworkManager::VpnSetting::Ptr &setting, QWidget *parent = nullptr, Qt::WindowFlags f = {});
+    ~VPNProviderSettingTreeView() override;
+
+    void loadConfig(const NetworkManager::Setting::Ptr &setting) override;
+    QVariantMap setting() const override;
+    bool isValid() const override;
+
+private:
+    NetworkManager::VpnSetting::Ptr m_setting;
+    VPNProviderSettingModel *m_model;
+    QTreeView *m_view;
+    bool m_valid;
+};
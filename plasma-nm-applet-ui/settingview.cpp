@@ -14,7 +14,6 @@
 #include <QtWidgets/QTableView>
 #include <QtWidgets/QWidget>
 
-#include <QtCore/QPair>
 #include <QtDBus/QDBusMetaType>
 #include <QtGui/QValidator>
 
@@ -28,6 +27,7 @@
 
 #include "common/nm-service-defines.h"
 #include "common/plasma/passwordfield.h"
+#include "inputschema.h"
 
 class StringInputValidator : public QValidator
 {
@@ -61,21 +61,76 @@ private:
     QRegularExpression m_regex;
 };
 
+// The value of an input widget, as it is saved in vpn.data
+static QString inputWidgetValue(QWidget *widget)
+{
+    if (QSpinBox *sb = qobject_cast<QSpinBox *>(widget)) {
+        return QString::number(sb->value());
+    } else if (QLineEdit *le = qobject_cast<QLineEdit *>(widget)) {
+        return le->text();
+    } else if (PasswordField *pf = qobject_cast<PasswordField *>(widget)) {
+        return pf->text();
+    } else if (QCheckBox *cb = qobject_cast<QCheckBox *>(widget)) {
+        return cb->isChecked() ? "true" : "false";
+    } else if (QComboBox *cmb = qobject_cast<QComboBox *>(widget)) {
+        return cmb->currentText();
+    } else if (QListView *lv = qobject_cast<QListView *>(widget)) {
+        QJsonArray jsonArray;
+        QStringListModel *model = qobject_cast<QStringListModel *>(lv->model());
+        for (const QString &value : model->stringList()) {
+            jsonArray.append(value);
+        }
+        return QString::fromUtf8(QJsonDocument(jsonArray).toJson(QJsonDocument::Compact));
+    }
+    VPN_LOG_WARNING("inputWidgetValue() Unknown input widget", "widget", widget->objectName());
+    return QString();
+}
+
+static void setInputWidgetValue(QWidget *widget, const QString &value)
+{
+    if (QSpinBox *sb = qobject_cast<QSpinBox *>(widget)) {
+        sb->setValue(value.toInt());
+    } else if (QLineEdit *le = qobject_cast<QLineEdit *>(widget)) {
+        le->setText(value);
+    } else if (PasswordField *pf = qobject_cast<PasswordField *>(widget)) {
+        pf->setText(value);
+    } else if (QCheckBox *cb = qobject_cast<QCheckBox *>(widget)) {
+        cb->setChecked(value == "true");
+    } else if (QListView *lv = qobject_cast<QListView *>(widget)) {
+        QJsonDocument valueJson = QJsonDocument::fromJson(value.toUtf8());
+        if (!valueJson.isArray()) {
+            return;
+        }
+        QStringListModel *model = qobject_cast<QStringListModel *>(lv->model());
+        model->removeRows(0, model->rowCount());
+        for (const QJsonValue &value : valueJson.array()) {
+            model->insertRow(model->rowCount());
+            model->setData(model->index(model->rowCount() - 1), value.toString());
+        }
+    } else if (QComboBox *cmb = qobject_cast<QComboBox *>(widget)) {
+        cmb->setCurrentText(value);
+    } else {
+        VPN_LOG_WARNING("setInputWidgetValue() Unknown input widget", "widget", widget->objectName());
+    }
+}
+
 VPNProviderSettingView::VPNProviderSettingView(const NetworkManager::VpnSetting::Ptr &setting, QWidget *parent, Qt::WindowFlags f)
     : SettingWidget(setting, parent, f)
     , m_setting(setting)
     , m_inputs()
 {
-    qCDebug(vpnBundle, "SettingView::SettingView()");
+    VPN_LOG_DEBUG("SettingView::SettingView()");
 
     qDBusRegisterMetaType<NMStringMap>();
 
+    // the conditions of the inputs are evaluated on the values of the connection
+    const NMStringMap data = setting && !setting->isNull() ? setting->data() : NMStringMap();
+
     QWidget *mainView = this;
     mainView->setLayout(new QVBoxLayout(mainView));
 
-    QJsonDocument inputFormJson = QJsonDocument::fromJson(QString(THIS_VPN_PROVIDER_INPUT_FORM_JSON).toUtf8());
     // this->setStyleSheet("* { border: 1px dashed red; }");
-    for (const QJsonValue sectionValue : inputFormJson.array()) {
+    for (const QJsonValue sectionValue : inputFormSections()) {
         QString sectionTitle = sectionValue.toObject()["section"].toString();
         QString sectionDescription = sectionValue.toObject()["description"].toString();
         QGroupBox *gb = new QGroupBox(this);
@@ -105,147 +160,44 @@ VPNProviderSettingView::VPNProviderSettingView(const NetworkManager::VpnSetting:
             QJsonObject defObj = inputDefJsonArray[i].toObject();
             QString id = defObj["id"].toString();
             QString type = defObj["type"].toString("string");
-            QString label = defObj["label"].toString("");
-            QString description = defObj["description"].toString();
-            bool isRequired = defObj.value("required").toBool(false);
-            QWidget *inputWidget = nullptr;
-            QWidget *fieldWidget = nullptr;
-            if (type == "integer") {
-                QSpinBox *sb = new QSpinBox(this);
-                sb->setObjectName("sb_" + id);
-                if (defObj["min_value"].isDouble())
-                    sb->setMinimum(defObj["min_value"].toInt());
-                if (defObj["max_value"].isDouble())
-                    sb->setMaximum(defObj["max_value"].toInt());
-                if (defObj["default"].isDouble())
-                    sb->setValue(defObj["default"].toInt());
-                connect(sb, QOverload<int>::of(&QSpinBox::valueChanged), this, &SettingWidget::settingChanged);
-                inputWidget = sb;
-            } else if (type == "string") {
-                bool isSecret = defObj.value("is_secret").toBool(false);
-                int maxLength = -1;
-                if (defObj["max_length"].isDouble())
-                    maxLength = defObj["max_length"].toInt();
-                int minLength = -1;
-                if (defObj["min_length"].isDouble())
-                    minLength = defObj["min_length"].toInt();
-                if (isSecret) {
-                    PasswordField *pf = new PasswordField(this);
-                    pf->setObjectName("pf_" + id);
-                    pf->setPasswordModeEnabled(true);
-                    pf->setMaxLength(defObj["max_length"].toInt());
-                    if (maxLength > 0)
-                        pf->setMaxLength(maxLength);
-                    inputWidget = pf;
-                } else {
-                    QLineEdit *le = new QLineEdit(this);
-                    le->setObjectName("le_" + id);
-                    if (defObj["default"].isString())
-                        le->setText(defObj["default"].toString());
-                    if (maxLength > 0)
-                        le->setMaxLength(maxLength);
-                    QString regex;
-                    if (defObj["regex"].isString())
-                        regex = defObj["regex"].toString();
-                    le->setValidator(new StringInputValidator(isRequired, minLength, regex, this));
-                    if (defObj["placeholder"].isString())
-                        le->setPlaceholderText(defObj["placeholder"].toString());
-                    // if (defObj["multiline"].isBool())
-                    connect(le, &QLineEdit::textChanged, this, &SettingWidget::settingChanged);
-                    inputWidget = le;
-                }
-            } else if (type == "array") {
-                QListView *lv = new QListView(this);
-                QStringListModel *model = new QStringListModel(lv);
-                lv->setObjectName("lv_" + id);
-                QString defaultAddValue = "<edit>";
-                if (defObj["default"].isArray()) {
-                    for (const QJsonValue &value : defObj["default"].toArray()) {
-                        defaultAddValue = value.toString();
-                        model->insertRow(model->rowCount());
-                        model->setData(model->index(model->rowCount() - 1), value.toString());
-                    }
-                }
-                lv->setModel(model);
-                QFrame *parentFrame = new QFrame(this);
-                parentFrame->setContentsMargins(0, 0, 0, 0);
-                parentFrame->setLayout(new QHBoxLayout(parentFrame));
-                parentFrame->setObjectName("frm" + id);
-                parentFrame->layout()->addWidget(lv);
-
-                QFrame *btnFrame = new QFrame(this);
-                btnFrame->setLayout(new QVBoxLayout(btnFrame));
-                QPushButton *btnAdd = new QPushButton("Add", btnFrame);
-                btnAdd->setIcon(QIcon::fromTheme("list-add"));
-                connect(btnAdd, &QPushButton::clicked, [model, defaultAddValue]() {
-                    model->insertRow(model->rowCount());
-                    model->setData(model->index(model->rowCount() - 1), defaultAddValue);
-                });
-                btnFrame->layout()->addWidget(btnAdd);
-                QPushButton *btnRemove = new QPushButton("Remove", btnFrame);
-                btnRemove->setIcon(QIcon::fromTheme("list-remove"));
-                btnRemove->setEnabled(model->rowCount() > 0);
-                connect(btnRemove, &QPushButton::clicked, [lv, model]() {
-                    model->removeRow(lv->currentIndex().row());
-                });
-                connect(model, &QStringListModel::rowsRemoved, [btnRemove, model](const QModelIndex &, int, int) {
-                    btnRemove->setEnabled(model->rowCount() > 0);
-                });
-                connect(model, &QStringListModel::rowsInserted, [btnRemove, model](const QModelIndex &, int, int) {
-                    btnRemove->setEnabled(model->rowCount() > 0);
-                });
-                btnFrame->layout()->addWidget(btnRemove);
-                parentFrame->layout()->addWidget(btnFrame);
-
-                inputWidget = lv;
-                fieldWidget = parentFrame;
-
-            } else if (type == "boolean") {
-                QCheckBox *cb = new QCheckBox(this);
-                cb->setObjectName("cb_" + id);
-                if (defObj["default"].isBool())
-                    cb->setChecked(defObj["default"].toBool());
-                connect(cb, &QCheckBox::stateChanged, this, &SettingWidget::settingChanged);
-                inputWidget = cb;
-            } else if (type == "enum") {
-                QComboBox *cmb = new QComboBox(this);
-                cmb->setObjectName("cmb_" + id);
-                if (defObj["default"].isString())
-                    cmb->setCurrentText(defObj["default"].toString());
-                if (defObj["default"].isArray()) {
-                    for (const QJsonValue &value : defObj["default"].toArray()) {
-                        cmb->addItem(value.toString());
-                    }
-                }
-                connect(cmb, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &SettingWidget::settingChanged);
-                connect(cmb, &QComboBox::currentTextChanged, this, &SettingWidget::settingChanged);
-                inputWidget = cmb;
-            } else {
-                // TODO: KUrlRequester, PasswordField, etc.
-                qCCritical(vpnBundle, "Unknown type: %s", type.toStdString().c_str());
+            if (!isKnownInputType(type)) {
+                // TODO: KUrlRequester, etc.
+                VPN_LOG_CRITICAL("Unknown input type", "type", type, "id", id);
                 continue;
             }
-            inputWidget->setToolTip(tr2i18n(description.toUtf8(), nullptr));
-            m_inputs.insert(id, QPair<QJsonObject, QWidget *>(defObj, inputWidget));
-            inputWidget->setProperty("InputId", id);
-            inputWidget->setProperty("InputType", type);
-            inputWidget->setProperty("InputDef", defObj);
-
-            if (fieldWidget == nullptr) {
-                fieldWidget = inputWidget;
-            }
-            if (!label.isEmpty()) {
-                QLabel *lbl = new QLabel(this);
-                lbl->setObjectName("lbl_" + id);
-                lbl->setText(tr2i18n(label.toUtf8(), nullptr));
-                lbl->setToolTip(tr2i18n(description.toUtf8(), nullptr));
-                sectionFormLayout->setWidget(i, QFormLayout::LabelRole, lbl);
-                sectionFormLayout->setWidget(i, QFormLayout::FieldRole, fieldWidget);
-            } else {
-                sectionFormLayout->setWidget(i, QFormLayout::SpanningRole, fieldWidget);
-            }
+            // the widgets are created by applyInputState() once the input is visible
+            Input input;
+            input.def = defObj;
+            input.layout = sectionFormLayout;
+            input.row = i;
+            m_graph.add(id.toStdString(),
+                        (data.contains(id) ? data.value(id) : inputDefaultValue(defObj, type)).toStdString(),
+                        defObj.value("required").toBool(false));
+            m_inputs.append(input);
+        }
+    }
+    std::string graphError;
+    for (int node = 0; node < m_graph.size(); node++) {
+        if (!addInputConditions(m_graph, node, m_inputs[node].def, &graphError)) {
+            VPN_LOG_CRITICAL("Invalid input condition", "error", graphError);
+            m_schemaError = QString::fromStdString(graphError);
+            break;
         }
     }
+    if (!m_graph.compile(&graphError)) {
+        VPN_LOG_WARNING("Ignoring input conditions", "error", graphError);
+    }
+    for (int node = 0; node < m_graph.size(); node++) {
+        applyInputState(node);
+    }
+    if (!m_schemaError.isEmpty()) {
+        for (QGroupBox *gb : findChildren<QGroupBox *>(QString(), Qt::FindDirectChildrenOnly)) {
+            gb->setEnabled(false);
+        }
+        QLabel *lbl = new QLabel(i18n("Invalid provider schema: %1", m_schemaError), this);
+        lbl->setWordWrap(true);
+        static_cast<QVBoxLayout *>(mainView->layout())->insertWidget(0, lbl);
+    }
     //////////////////////
 
     // Connect for setting check
@@ -266,42 +218,226 @@ VPNProviderSettingView::~VPNProviderSettingView()
 {
 }
 
+// Creates the widgets of an input, on its first time visible
+void VPNProviderSettingView::materializeInput(int node)
+{
+    Input &input = m_inputs[node];
+    const QJsonObject &defObj = input.def;
+    QString id = defObj["id"].toString();
+    QString type = defObj["type"].toString("string");
+    QString label = defObj["label"].toString("");
+    QString description = defObj["description"].toString();
+    bool isRequired = defObj.value("required").toBool(false);
+    auto changed = [this, node]() {
+        inputChanged(node);
+    };
+    QWidget *inputWidget = nullptr;
+    QWidget *fieldWidget = nullptr;
+    if (type == "integer") {
+        QSpinBox *sb = new QSpinBox(this);
+        sb->setObjectName("sb_" + id);
+        if (defObj["min_value"].isDouble())
+            sb->setMinimum(defObj["min_value"].toInt());
+        if (defObj["max_value"].isDouble())
+            sb->setMaximum(defObj["max_value"].toInt());
+        if (defObj["default"].isDouble())
+            sb->setValue(defObj["default"].toInt());
+        connect(sb, QOverload<int>::of(&QSpinBox::valueChanged), this, changed);
+        inputWidget = sb;
+    } else if (type == "string") {
+        bool isSecret = defObj.value("is_secret").toBool(false);
+        int maxLength = -1;
+        if (defObj["max_length"].isDouble())
+            maxLength = defObj["max_length"].toInt();
+        int minLength = -1;
+        if (defObj["min_length"].isDouble())
+            minLength = defObj["min_length"].toInt();
+        if (isSecret) {
+            PasswordField *pf = new PasswordField(this);
+            pf->setObjectName("pf_" + id);
+            pf->setPasswordModeEnabled(true);
+            pf->setMaxLength(defObj["max_length"].toInt());
+            if (maxLength > 0)
+                pf->setMaxLength(maxLength);
+            connect(pf, &PasswordField::textChanged, this, changed);
+            inputWidget = pf;
+        } else {
+            QLineEdit *le = new QLineEdit(this);
+            le->setObjectName("le_" + id);
+            if (defObj["default"].isString())
+                le->setText(defObj["default"].toString());
+            if (maxLength > 0)
+                le->setMaxLength(maxLength);
+            QString regex;
+            if (defObj["regex"].isString())
+                regex = defObj["regex"].toString();
+            le->setValidator(new StringInputValidator(isRequired, minLength, regex, this));
+            if (defObj["placeholder"].isString())
+                le->setPlaceholderText(defObj["placeholder"].toString());
+            // if (defObj["multiline"].isBool())
+            connect(le, &QLineEdit::textChanged, this, changed);
+            inputWidget = le;
+        }
+    } else if (type == "array") {
+        QListView *lv = new QListView(this);
+        QStringListModel *model = new QStringListModel(lv);
+        lv->setObjectName("lv_" + id);
+        QString defaultAddValue = "<edit>";
+        if (defObj["default"].isArray()) {
+            for (const QJsonValue &value : defObj["default"].toArray()) {
+                defaultAddValue = value.toString();
+                model->insertRow(model->rowCount());
+                model->setData(model->index(model->rowCount() - 1), value.toString());
+            }
+        }
+        lv->setModel(model);
+        QFrame *parentFrame = new QFrame(this);
+        parentFrame->setContentsMargins(0, 0, 0, 0);
+        parentFrame->setLayout(new QHBoxLayout(parentFrame));
+        parentFrame->setObjectName("frm" + id);
+        parentFrame->layout()->addWidget(lv);
+
+        QFrame *btnFrame = new QFrame(this);
+        btnFrame->setLayout(new QVBoxLayout(btnFrame));
+        QPushButton *btnAdd = new QPushButton("Add", btnFrame);
+        btnAdd->setIcon(QIcon::fromTheme("list-add"));
+        connect(btnAdd, &QPushButton::clicked, [model, defaultAddValue]() {
+            model->insertRow(model->rowCount());
+            model->setData(model->index(model->rowCount() - 1), defaultAddValue);
+        });
+        btnFrame->layout()->addWidget(btnAdd);
+        QPushButton *btnRemove = new QPushButton("Remove", btnFrame);
+        btnRemove->setIcon(QIcon::fromTheme("list-remove"));
+        btnRemove->setEnabled(model->rowCount() > 0);
+        connect(btnRemove, &QPushButton::clicked, [lv, model]() {
+            model->removeRow(lv->currentIndex().row());
+        });
+        connect(model, &QStringListModel::rowsRemoved, [btnRemove, model](const QModelIndex &, int, int) {
+            btnRemove->setEnabled(model->rowCount() > 0);
+        });
+        connect(model, &QStringListModel::rowsInserted, [btnRemove, model](const QModelIndex &, int, int) {
+            btnRemove->setEnabled(model->rowCount() > 0);
+        });
+        connect(model, &QStringListModel::rowsRemoved, this, changed);
+        connect(model, &QStringListModel::dataChanged, this, changed);
+        btnFrame->layout()->addWidget(btnRemove);
+        parentFrame->layout()->addWidget(btnFrame);
+
+        inputWidget = lv;
+        fieldWidget = parentFrame;
+
+    } else if (type == "boolean") {
+        QCheckBox *cb = new QCheckBox(this);
+        cb->setObjectName("cb_" + id);
+        if (defObj["default"].isBool())
+            cb->setChecked(defObj["default"].toBool());
+        connect(cb, &QCheckBox::stateChanged, this, changed);
+        inputWidget = cb;
+    } else if (type == "enum") {
+        QComboBox *cmb = new QComboBox(this);
+        cmb->setObjectName("cmb_" + id);
+        for (const QJsonValue &value : defObj["values"].toArray()) {
+            cmb->addItem(value.toString());
+        }
+        if (defObj["default"].isString())
+            cmb->setCurrentText(defObj["default"].toString());
+        connect(cmb, &QComboBox::currentTextChanged, this, changed);
+        inputWidget = cmb;
+    }
+    inputWidget->setToolTip(tr2i18n(description.toUtf8(), nullptr));
+    inputWidget->setProperty("InputId", id);
+    inputWidget->setProperty("InputType", type);
+    inputWidget->setProperty("InputDef", defObj);
+    setInputWidgetValue(inputWidget, QString::fromStdString(m_graph[node].value));
+
+    if (fieldWidget == nullptr) {
+        fieldWidget = inputWidget;
+    }
+    if (!label.isEmpty()) {
+        QLabel *lbl = new QLabel(this);
+        lbl->setObjectName("lbl_" + id);
+        lbl->setText(tr2i18n(label.toUtf8(), nullptr));
+        lbl->setToolTip(tr2i18n(description.toUtf8(), nullptr));
+        input.layout->setWidget(input.row, QFormLayout::LabelRole, lbl);
+        input.layout->setWidget(input.row, QFormLayout::FieldRole, fieldWidget);
+        input.label = lbl;
+    } else {
+        input.layout->setWidget(input.row, QFormLayout::SpanningRole, fieldWidget);
+    }
+    input.field = fieldWidget;
+    input.widget = inputWidget;
+}
+
+// Brings the widgets of an input in line with its state in the graph. They are created on its first time visible.
+void VPNProviderSettingView::applyInputState(int node)
+{
+    const FieldGraph::Field &field = m_graph[node];
+    Input &input = m_inputs[node];
+    VPN_LOG_TRACE("applyInputState()", "id", field.id, "visible", field.visible, "enabled", field.enabled, "required", field.required_now);
+    if (field.visible && !input.widget)
+        materializeInput(node);
+    if (input.widget) {
+        // hidden rows of a QFormLayout take no space
+        input.field->setVisible(field.visible);
+        input.field->setEnabled(field.enabled);
+        if (input.label) {
+            input.label->setVisible(field.visible);
+            input.label->setEnabled(field.enabled);
+        }
+    }
+    validateInput(node);
+}
+
+// On every change of an input widget: only the inputs whose conditions depend on it are re-evaluated
+void VPNProviderSettingView::inputChanged(int node)
+{
+    QWidget *widget = m_inputs[node].widget;
+    if (!widget)
+        return; // being created
+    bool wasValid = isValid();
+    for (int dependent : m_graph.set_value(node, inputWidgetValue(widget).toStdString()))
+        applyInputState(dependent);
+    validateInput(node);
+    Q_EMIT settingChanged();
+    if (isValid() != wasValid)
+        Q_EMIT validChanged(isValid());
+}
+
+void VPNProviderSettingView::validateInput(int node)
+{
+    const FieldGraph::Field &field = m_graph[node];
+    QWidget *widget = m_inputs[node].widget;
+    bool valid = true;
+    if (QSpinBox *sb = qobject_cast<QSpinBox *>(widget)) {
+        valid = sb->hasAcceptableInput();
+    } else if (QLineEdit *le = qobject_cast<QLineEdit *>(widget)) {
+        valid = le->text().isEmpty() ? !field.required_now : le->hasAcceptableInput();
+    } else if (PasswordField *pf = qobject_cast<PasswordField *>(widget)) {
+        valid = !field.required_now || !pf->text().isEmpty();
+    }
+    m_graph.set_valid(node, valid);
+}
+
 void VPNProviderSettingView::loadConfig(const NetworkManager::Setting::Ptr &setting)
 {
     const NMStringMap data = m_setting->data();
 
     for (const QString &key : data.keys()) {
         QString value = data.value(key);
-        qCDebug(vpnBundle, "loadConfig() -> Found VpnSettings.data: %s = %s", key.toStdString().c_str(), value.toStdString().c_str());
+        VPN_LOG_TRACE("loadConfig() Found VpnSettings.data", "key", key, "value", value);
         if (value.isEmpty()) {
             continue;
         }
-        QWidget *widget = m_inputs.value(key).second;
-        if (!widget) {
-            qCWarning(vpnBundle, "No input widget for key: %s", key.toStdString().c_str());
+        int node = m_graph.index(key.toStdString());
+        if (node < 0) {
+            VPN_LOG_WARNING("loadConfig() No input", "key", key);
             continue;
         }
-        if (QSpinBox *sb = qobject_cast<QSpinBox *>(widget)) {
-            sb->setValue(value.toInt());
-        } else if (QLineEdit *le = qobject_cast<QLineEdit *>(widget)) {
-            le->setText(value);
-        } else if (QCheckBox *cb = qobject_cast<QCheckBox *>(widget)) {
-            cb->setChecked(value == "true");
-        } else if (QListView *lv = qobject_cast<QListView *>(widget)) {
-            QJsonDocument valueJson = QJsonDocument::fromJson(value.toUtf8());
-            if (!valueJson.isArray()) {
-                continue;
-            }
-            QStringListModel *model = qobject_cast<QStringListModel *>(lv->model());
-            model->removeRows(0, model->rowCount());
-            for (const QJsonValue &value : valueJson.array()) {
-                model->insertRow(model->rowCount());
-                model->setData(model->index(model->rowCount() - 1), value.toString());
-            }
-        } else if (QComboBox *cmb = qobject_cast<QComboBox *>(widget)) {
-            cmb->setCurrentText(value);
+        if (QWidget *widget = m_inputs[node].widget) {
+            setInputWidgetValue(widget, value); // inputChanged() follows
         } else {
-            qCWarning(vpnBundle, "Unknown input widget %s for key: %s", widget->objectName().toStdString().c_str(), key.toStdString().c_str());
+            for (int dependent : m_graph.set_value(node, value.toStdString()))
+                applyInputState(dependent);
         }
     }
     // NOLINTNEXTLINE    // Or we gets "clang-analyzer-cplusplus.VirtualCall")
@@ -311,10 +447,7 @@ void VPNProviderSettingView::loadConfig(const NetworkManager::Setting::Ptr &sett
 void VPNProviderSettingView::loadSecrets(const NetworkManager::Setting::Ptr &setting)
 {
     NetworkManager::Setting *s = setting.get();
-    qCWarning(vpnBundle,
-              "XXX: loadSecrets() -> name() %s | needSecrets() %s ",
-              s ? s->name().toStdString().c_str() : "",
-              s ? s->needSecrets().join("\t").toStdString().c_str() : "");
+    VPN_LOG_DEBUG("loadSecrets()", "name", s ? s->name() : QString(), "need_secrets", s ? s->needSecrets() : QStringList());
 }
 
 QVariantMap VPNProviderSettingView::setting() const
@@ -323,29 +456,20 @@ QVariantMap VPNProviderSettingView::setting() const
     setting.setServiceType(QLatin1String(THIS_VPN_PROVIDER_DBUS_SERVICE));
     NMStringMap data;
     NMStringMap secrets;
-    for (const QString &key : m_inputs.keys()) {
-        QString value;
-        QWidget *widget = m_inputs.value(key).second;
-        if (QSpinBox *sb = qobject_cast<QSpinBox *>(widget)) {
-            data.insert(key, QString::number(sb->value()));
-        } else if (QLineEdit *le = qobject_cast<QLineEdit *>(widget)) {
-            data.insert(key, le->text());
-        } else if (PasswordField *le = qobject_cast<PasswordField *>(widget)) {
-            data.insert(key, le->text());
-        } else if (QCheckBox *cb = qobject_cast<QCheckBox *>(widget)) {
-            data.insert(key, cb->isChecked() ? "true" : "false");
-        } else if (QComboBox *cmb = qobject_cast<QComboBox *>(widget)) {
-            data.insert(key, cmb->currentText());
-        } else if (QListView *lv = qobject_cast<QListView *>(widget)) {
-            QJsonArray jsonArray;
-            QStringListModel *model = qobject_cast<QStringListModel *>(lv->model());
-            for (const QString &value : model->stringList()) {
-                jsonArray.append(value);
+    for (int node = 0; node < m_graph.size(); node++) {
+        const FieldGraph::Field &field = m_graph[node];
+        QString id = QString::fromStdString(field.id);
+        if (!field.visible) {
+            continue; // hidden by its conditions
+        }
+        if (!field.enabled) {
+            // disabled by its conditions: keeps the value the connection has, if any
+            if (m_setting && !m_setting->isNull() && !m_setting->data().value(id).isEmpty()) {
+                data.insert(id, m_setting->data().value(id));
             }
-            data.insert(key, QString::fromUtf8(QJsonDocument(jsonArray).toJson(QJsonDocument::Compact)));
-        } else {
-            qCWarning(vpnBundle, "Unknown input widget for key: %s", key.toStdString().c_str());
+            continue;
         }
+        data.insert(id, inputWidgetValue(m_inputs[node].widget));
     }
 
     setting.setData(data);
@@ -355,27 +479,6 @@ QVariantMap VPNProviderSettingView::setting() const
 
 bool VPNProviderSettingView::isValid() const
 {
-    for (const QString &key : m_inputs.keys()) {
-        QJsonObject defObj = m_inputs.value(key).first;
-        QWidget *widget = m_inputs.value(key).second;
-        if (QSpinBox *sb = qobject_cast<QSpinBox *>(widget)) {
-            if (!sb->hasAcceptableInput()) {
-                return false;
-            }
-        } else if (QLineEdit *le = qobject_cast<QLineEdit *>(widget)) {
-            if (!defObj.value("required").toBool() && le->text().isEmpty()) {
-                continue;
-            }
-            if (!le->hasAcceptableInput()) {
-                return false;
-            }
-        } else if (PasswordField *le = qobject_cast<PasswordField *>(widget)) {
-            if (!defObj.value("required").toBool() && le->text().isEmpty()) {
-                continue;
-            }
-        } else {
-            qCDebug(vpnBundle, "validation not implemented for widget %s for key: %s", widget->objectName().toStdString().c_str(), key.toStdString().c_str());
-        }
-    }
-    return true;
+    // kept up to date by inputChanged(), only the active inputs count
+    return m_schemaError.isEmpty() && m_graph.first_invalid() < 0;
 }
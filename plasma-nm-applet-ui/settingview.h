@@ -3,12 +3,17 @@
 
 #include <NetworkManagerQt/VpnSetting>
 
-#include <QtCore/QPair>
+#include <QtCore/QJsonObject>
+#include <QtCore/QVector>
 #include <QtWidgets/QWidget>
 
+#include "common/field-graph.h"
 #include "common/plasma/settingwidget.h"
 #include "shared.h"
 
+class QFormLayout;
+class QLabel;
+
 class VPNProviderSettingView : public SettingWidget
 {
     Q_OBJECT
@@ -22,8 +27,25 @@ public:
     bool isValid() const override;
 
 private:
+    struct Input {
+        QJsonObject def;
+        QFormLayout *layout = nullptr; // of the section
+        int row = 0;
+        QWidget *widget = nullptr; // nullptr until the input is first visible
+        QWidget *field = nullptr; // widget, or the frame around it
+        QLabel *label = nullptr;
+    };
+
+    void materializeInput(int node);
+    void applyInputState(int node);
+    void inputChanged(int node);
+    void validateInput(int node);
+
     NetworkManager::VpnSetting::Ptr m_setting;
-    QMap<QString, QPair<QJsonObject, QWidget *>> m_inputs;
+    FieldGraph m_graph;
+    QVector<Input> m_inputs; // by graph index
+    // Invalid input conditions of the schema, rejected like the GTK editor does: the form cannot be saved
+    QString m_schemaError;
 };
 
 #endif // PLASMA_NM_SETTINGS_VIEW_WIDGET_H
@@ -1,4 +1,7 @@
 #pragma once
 #include <QLoggingCategory>
 
-Q_DECLARE_LOGGING_CATEGORY(vpnBundle)
\ No newline at end of file
+Q_DECLARE_LOGGING_CATEGORY(vpnBundle)
+
+#define VPN_BUNDLE_LOG_QT_CATEGORY vpnBundle
+#include "common/log.h"
@@ -1,4 +1,11 @@
-from .service import main
+import sys
+import time
+
+from .linger import handoff_from_args
 
 if __name__ == "__main__":
-    main()
+    interpreter_ready_us = time.time_ns() // 1000
+    if not handoff_from_args(sys.argv[1:]):
+        from .service import main
+
+        main(interpreter_ready_us)
@@ -1,9 +1,12 @@
 import enum
 import ipaddress
 from abc import ABC, abstractmethod
-from dataclasses import dataclass
+from dataclasses import dataclass, replace
 from typing import Optional, TypedDict
 
+from .scope import ConnectionScope
+from .utils import CancelToken, SupervisedProcess, get_iface_addresses_by_family
+
 
 class NMVpnConnectionState(enum.IntEnum):
     """
@@ -142,9 +145,17 @@ class ConnectionResult(ABC):
 
 
 class VPNConnectionControlBase(ABC):
+    # How often a running connection is polled by refresh(). rtnetlink events on the tun device trigger it earlier.
+    refresh_interval_sec = 30
+
     def __init__(self, service: "ServiceBase", state_home_dir: str) -> None:
         self.service = service
         self.state_home_dir = state_home_dir
+        # Of the connect attempt in progress, set by the service before start()/resume(). The waits of their steps
+        # take it, so that a Disconnect() interrupts them.
+        self.cancel = CancelToken()
+        # Of the connection, set by the service before start(). Passed to the Subprocess of each daemon.
+        self.scope: ConnectionScope = None
 
     @abstractmethod
     def start(self, *, connection_uuid: str, connection_name: str, vpn_data: dict[str, str]) -> ConnectionResult:
@@ -154,6 +165,68 @@ class VPNConnectionControlBase(ABC):
     def stop(self):
         pass
 
+    # Whether standby(), resume() and release() are implemented, see "warm-standby-timeout".
+    supports_standby = False
+
+    def standby(self) -> dict:
+        """
+        Takes the data path down but keeps the daemon and its control session, for a quick resume().
+        Returns what resume() needs to take the daemon over, possibly in another service process (JSON serializable).
+        stop() still stops it completely.
+        """
+        raise NotImplementedError
+
+    def resume(
+        self, standby_state: dict, *, connection_uuid: str, connection_name: str, vpn_data: dict[str, str]
+    ) -> ConnectionResult:
+        """Brings the data path of a daemon put on standby() back up, like start() does for a new one."""
+        raise NotImplementedError
+
+    def release(self):
+        """Leaves the daemon on standby running when this service process exits, for the one resuming it."""
+
+    # Whether runtime_state() and adopt() are implemented, see "is-survive-service-restart".
+    supports_adopt = False
+
+    def runtime_state(self) -> dict:
+        """
+        What adopt() needs to take the running daemon over in another service process (JSON serializable), should
+        this one go away while connected. release() then leaves the daemon running.
+        """
+        raise NotImplementedError
+
+    def adopt(self, runtime_state: dict, *, connection_uuid: str, connection_name: str, vpn_data: dict[str, str]):
+        """
+        Takes over the connected daemon a previous service process left running. The service then refresh()es the
+        result that process pushed last. Raises if the daemon is not usable anymore: it is stopped and started anew.
+        """
+        raise NotImplementedError
+
+    # vpn.data keys apply_settings() can change on a running connection. Changing any other key restarts it.
+    live_settings: frozenset[str] = frozenset()
+
+    def apply_settings(self, changed: dict[str, str | None], vpn_data: dict[str, str]) -> bool:
+        """
+        Applies `changed` settings (all of them in `live_settings`; None if removed) to the running connection.
+        `vpn_data` is the whole new vpn.data. False (or an exception) if it could not: the connection is restarted.
+        """
+        return False
+
+    def daemon_pids(self) -> list[int]:
+        """Running processes of the provider (Subprocess, AdoptedProcess attributes), for the metrics."""
+        return [p.pid for p in vars(self).values() if isinstance(p, SupervisedProcess) and p.is_running]
+
+    def refresh(self, current: ConnectionResult) -> Optional[ConnectionResult]:
+        """
+        Re-reads the state of a running connection, which is then pushed to NetworkManager if it changed.
+        Default re-reads the addresses of the tun device. Providers that learn addresses or routes from their
+        control plane should override this. Returns None if the state could not be determined.
+        """
+        if not current.dev:
+            return None
+        ipv4, ipv6 = get_iface_addresses_by_family(current.dev)
+        return replace(current, ipv4=ipv4, ipv6=ipv6)
+
 
 class ServiceBase(ABC):
     def __init__(self, ctl: VPNConnectionControlBase, *args) -> None:
@@ -162,3 +235,12 @@ class ServiceBase(ABC):
     @abstractmethod
     def prompt_auth(self, prompt: dict, *items) -> None:
         pass
+
+    def daemon_exited(self, proc) -> None:
+        """Exit callback of the provider daemons (Subprocess.on_exit()), for the ones exiting on their own."""
+
+    def announce_device(self, dev: str, *, has_ipv4: bool, has_ipv6: bool) -> None:
+        """
+        Called by providers during start() once the tun device exists, before its addresses are known.
+        Lets NetworkManager begin configuring the device while the rest of the connect runs.
+        """
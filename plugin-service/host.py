@@ -0,0 +1,108 @@
+"""
+Service host: one process serving the activations of many connections, see "Service host" in README.md.
+
+    nm-<provider>-service --host --provider <provider>[,<provider>...]|all
+
+NetworkManager starts one service process per activation of a multi-connection provider, under a new bus name. While a
+host of the provider runs, that process hands the name over to it (like to a lingering process, see linger.py) and
+exits before importing anything heavy. The host serves each handed over name with a session: a VpnDBUSService with its
+own provider control object, exported on its own connection to the bus, so that NetworkManager gets the signals of a
+session from the owner of its name. The main loop, the supervision of the daemons (supervisor.py) and the status
+polling (WatcherPool: one thread, one rtnetlink subscription) are shared, a session costs its control state only.
+
+A session ends where a service process would exit (eg: after Disconnect()). Warm standby stays within the host: the
+next session of the connection takes the daemon over from the session holding it (hand_over_standby()).
+"""
+
+import functools
+import logging
+import os
+from dataclasses import dataclass
+
+from gi.repository import Gio
+from pydbus import connect
+
+from . import standby, supervisor
+from .linger import LingerListener
+from .service import VpnDBUSService, load_ctl_class, register
+from .watcher import WatcherPool
+
+
+@dataclass
+class _Session:
+    provider: str
+    bus_name: str
+    bus: object  # its own connection to the bus
+    registrations: list
+    name_owner: object
+
+
+class ServiceHost:
+    def __init__(self, state_home_dirs: dict[str, str]) -> None:
+        """`state_home_dirs`: of each provider to serve."""
+        self.watchers = WatcherPool()
+        self._state_home_dirs = state_home_dirs
+        self._sessions: dict[VpnDBUSService, _Session] = {}
+        self._listeners = {
+            provider: LingerListener(provider, functools.partial(self._open_session, provider), persistent=True)
+            for provider in state_home_dirs
+        }
+
+    def start(self) -> bool:
+        """False if it serves no provider: another process lingers or hosts each of them."""
+        serving = [provider for provider, listener in self._listeners.items() if listener.listen()]
+        if skipped := self._listeners.keys() - serving:
+            logging.warning("Not serving %s: another service process listens for their activations", sorted(skipped))
+        logging.info("Serving the activations of %s", serving)
+        return bool(serving)
+
+    def _open_session(self, provider: str, bus_name: str) -> bool:
+        bus = None
+        try:
+            bus_type = Gio.BusType.SYSTEM if os.getuid() == 0 else Gio.BusType.SESSION
+            bus = connect(Gio.dbus_address_get_for_bus_sync(bus_type, None))
+            service = VpnDBUSService(load_ctl_class(provider), self._state_home_dirs[provider], host=self)
+            service.bus = bus
+            registrations = register(bus, service)
+            name_owner = bus.request_name(bus_name)
+        except Exception as e:
+            logging.exception("Could not serve %s: %r", bus_name, e)
+            if bus:
+                bus.con.close_sync(None)
+            return False
+        self._sessions[service] = _Session(provider, bus_name, bus, registrations, name_owner)
+        logging.info("Serving %s (%s), %d sessions", bus_name, provider, len(self._sessions))
+        return True
+
+    def close_session(self, service: VpnDBUSService, reason: str):
+        """Ends the session of `service`, in place of exiting the process. Called from within it."""
+        if not (session := self._sessions.pop(service, None)):
+            return
+        logging.info("Session of %s ends: %s, %d sessions left", session.bus_name, reason, len(self._sessions))
+        # after the reply to the D-Bus call in progress, if any
+        supervisor.call_soon(lambda: self._close(service, session))
+
+    def _close(self, service: VpnDBUSService, session: _Session):
+        service.shutdown()
+        session.name_owner.unown()
+        for registration in reversed(session.registrations):
+            registration.unregister()
+        try:
+            session.bus.con.flush_sync(None)  # eg: the last StateChanged
+            session.bus.con.close_sync(None)
+        except Exception as e:
+            logging.debug("Closing the bus connection of %s: %r", session.bus_name, e)
+
+    def claim_standby(self, uuid: str, digest: str) -> dict | None:
+        """standby.claim() for a session: the daemon is held by another session, or by a service process."""
+        for service in list(self._sessions):
+            if (state := service.hand_over_standby(uuid, digest)) is not None:
+                return state
+        return standby.claim(uuid, digest)
+
+    def shutdown(self):
+        for listener in self._listeners.values():
+            listener.close()
+        for service, session in list(self._sessions.items()):
+            self._sessions.pop(service)
+            self._close(service, session)
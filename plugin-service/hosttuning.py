@@ -0,0 +1,141 @@
+"""
+Host tuning for UDP tunnels, see "is-host-tuning".
+
+While a connection with host tuning is up, host settings that limit the throughput of UDP tunnels are changed:
+net.core.rmem_max/wmem_max (never lowered), and for a tailscale exit node or subnet router IP forwarding and UDP GRO
+forwarding on the interface of the default route. They are restored when the last connection needing them goes down.
+
+The service processes of concurrent connections share `<runtime dir>/vpn-bundle-host-tuning.json`, under an flock:
+the holders (pid/connection uuid, and the start time of the process) with the values they want, and the original and
+the applied value of each changed setting. Holders that are gone (eg: a crashed process) are dropped on the next
+acquire or release. An original value is kept until it is restored.
+"""
+
+import fcntl
+import json
+import logging
+import os
+from contextlib import contextmanager
+from pathlib import Path
+
+from . import tuning
+from .netlink import Ethtool
+from .utils import process_start_time
+
+_MIN_SOCKET_BUFFER_BYTES = 4 * 1024 * 1024
+_ETHTOOL = "ethtool:"  # ethtool:<dev>:<feature>, "on" or "off"; else a sysctl, numeric
+
+
+def _state_path():
+    return Path(os.getenv("XDG_RUNTIME_DIR", "/var/run"), "vpn-bundle-host-tuning.json")
+
+
+def wanted_settings(vpn_data: dict[str, str]) -> dict[str, str]:
+    socket_buffer = str(max(tuning.socket_buffer_bytes(tuning.host()) or 0, _MIN_SOCKET_BUFFER_BYTES))
+    settings = {"net.core.rmem_max": socket_buffer, "net.core.wmem_max": socket_buffer}
+    if vpn_data.get("is-advertise-exit-node") == "true" or vpn_data.get("advertise-routes", "").strip():
+        settings["net.ipv4.ip_forward"] = "1"
+        settings["net.ipv6.conf.all.forwarding"] = "1"
+        if dev := tuning.default_route_interface():
+            # as tailscale recommends for exit nodes and subnet routers
+            settings[f"{_ETHTOOL}{dev}:rx-udp-gro-forwarding"] = "on"
+            settings[f"{_ETHTOOL}{dev}:rx-gro-list"] = "off"
+    return settings
+
+
+def acquire(uuid: str, vpn_data: dict[str, str]):
+    """Applies the settings connection `uuid` wants, in place of what this process held before."""
+    settings = wanted_settings(vpn_data)
+    logging.info("Host tuning for %s: %s", uuid, settings)
+    pid = os.getpid()
+    with _locked_state() as state:
+        state["holders"][f"{pid}/{uuid}"] = {"start_time": process_start_time(pid), "settings": settings}
+        _reconcile(state)
+
+
+def release(uuid: str):
+    """Drops the settings connection `uuid` holds; the ones no other connection wants are restored."""
+    with _locked_state() as state:
+        if state["holders"].pop(f"{os.getpid()}/{uuid}", None) is None and not state["saved"]:
+            return
+        _reconcile(state)
+
+
+@contextmanager
+def _locked_state():
+    path = _state_path()
+    path.parent.mkdir(mode=0o755, exist_ok=True)
+    with open(os.open(path, os.O_RDWR | os.O_CREAT | os.O_CLOEXEC, 0o600), "r+") as f:
+        fcntl.flock(f, fcntl.LOCK_EX)
+        try:
+            state = json.loads(f.read() or "{}")
+        except ValueError as e:
+            logging.warning("Invalid host tuning state, starting over: %r", e)
+            state = {}
+        state.setdefault("holders", {})
+        state.setdefault("saved", {})
+        yield state
+        f.seek(0)
+        f.truncate()
+        f.write(json.dumps(state))
+
+
+def _alive(holder_id: str, holder: dict):
+    try:
+        return process_start_time(int(holder_id.split("/")[0])) == holder["start_time"]
+    except (OSError, ValueError):
+        return False
+
+
+def _reconcile(state: dict):
+    """Applies, for each setting, what its holders want; restores the settings that none of them wants anymore."""
+    holders, saved = state["holders"], state["saved"]
+    for holder_id in [holder_id for holder_id, holder in holders.items() if not _alive(holder_id, holder)]:
+        logging.info("Dropping the host tuning of %s, its process is gone", holder_id)
+        del holders[holder_id]
+    wanted: dict[str, list[str]] = {}
+    for holder in holders.values():
+        for key, value in holder["settings"].items():
+            wanted.setdefault(key, []).append(value)
+    for key in sorted(wanted.keys() | saved.keys()):
+        try:
+            current = _read(key)
+            if key not in wanted:
+                entry = saved[key]
+                if current != entry["applied"]:
+                    logging.info("Not restoring %s, changed to %s meanwhile", key, current)
+                elif current != entry["original"]:
+                    _write(key, entry["original"])
+                    logging.info("Restored %s=%s", key, entry["original"])
+                del saved[key]
+                continue
+            original = saved[key]["original"] if key in saved else current
+            if key.startswith(_ETHTOOL):
+                value = wanted[key][-1]
+            else:
+                value = str(max(int(v) for v in (original, *wanted[key])))
+            if current != value:
+                _write(key, value)
+                logging.info("Set %s=%s (was %s)", key, value, current)
+            saved[key] = {"original": original, "applied": value}
+        except OSError as e:  # eg: no such device, an unsupported feature; its saved entry is retried next time
+            logging.warning("Host tuning of %s failed: %r", key, e)
+
+
+def _read(key: str) -> str:
+    if key.startswith(_ETHTOOL):
+        dev, feature = key[len(_ETHTOOL) :].split(":")
+        with Ethtool() as ethtool:
+            return "on" if feature in ethtool.active_features(dev) else "off"
+    with open(f"/proc/sys/{key.replace('.', '/')}") as f:
+        return f.read().strip()
+
+
+def _write(key: str, value: str):
+    if key.startswith(_ETHTOOL):
+        dev, feature = key[len(_ETHTOOL) :].split(":")
+        with Ethtool() as ethtool:
+            ethtool.set_features(dev, {feature: value == "on"})
+        return
+    with open(f"/proc/sys/{key.replace('.', '/')}", "w") as f:
+        f.write(value)
@@ -0,0 +1,123 @@
+"""
+HTTP clients of the providers' control APIs (tailscaled LocalAPI, zerotier-one). Not imported by utils.py:
+http.client pulls in the email package, which is startup time only the providers talking HTTP should pay.
+"""
+
+import http.client
+import json
+import logging
+import socket
+import threading
+from typing import Any, Callable
+from urllib import parse
+
+
+class HTTPStatusError(RuntimeError):
+    def __init__(self, status: int, reason: str, body: bytes) -> None:
+        super().__init__(f"HTTP {status} {reason}: {body[:200].decode('utf-8', errors='replace')}")
+        self.status = status
+        self.body = body
+
+
+class UnixHTTPConnection(http.client.HTTPConnection):
+    """HTTP over a unix socket, eg: tailscaled LocalAPI."""
+
+    def __init__(self, socket_path: str, host="localhost", timeout=10) -> None:
+        super().__init__(host, timeout=timeout)
+        self.socket_path = socket_path
+
+    def connect(self):
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.settimeout(self.timeout)
+        try:
+            sock.connect(self.socket_path)
+        except OSError:
+            sock.close()
+            raise
+        self.sock = sock
+
+
+class KeepAliveHTTPClient:
+    """
+    One persistent (HTTP/1.1 keep-alive) connection, re-established once per request if the peer closed it.
+    Thread safe: requests are serialized.
+    """
+
+    def __init__(self, connection_factory: Callable[[], http.client.HTTPConnection], headers: dict = None) -> None:
+        self._connection_factory = connection_factory
+        self._headers = headers or {}
+        self._conn: http.client.HTTPConnection = None
+        self._lock = threading.Lock()
+
+    def request(self, method: str, path: str, body: bytes | None = None, headers: dict = None) -> bytes:
+        headers = {**self._headers, **(headers or {})}
+        with self._lock:
+            for attempt in (1, 2):
+                reused = self._conn is not None
+                if not reused:
+                    self._conn = self._connection_factory()
+                try:
+                    self._conn.request(method, path, body=body, headers=headers)
+                    resp = self._conn.getresponse()
+                    data = resp.read()
+                except (http.client.RemoteDisconnected, BrokenPipeError, ConnectionResetError):
+                    self.close_unlocked()
+                    if reused and attempt == 1:  # idle connection was closed by the server
+                        continue
+                    raise
+                except Exception:
+                    self.close_unlocked()
+                    raise
+                if resp.will_close:
+                    self.close_unlocked()
+                if resp.status >= 400:
+                    raise HTTPStatusError(resp.status, resp.reason, data)
+                return data
+
+    def request_json(self, method: str, path: str, data: Any = None, headers: dict = None) -> Any:
+        body = None
+        if data is not None:
+            body = json.dumps(data).encode("utf-8")
+            headers = {"Content-Type": "application/json", **(headers or {})}
+        return json.loads(self.request(method, path, body, headers) or b"null")
+
+    def close(self):
+        with self._lock:
+            self.close_unlocked()
+
+    def close_unlocked(self):
+        if self._conn:
+            self._conn.close()
+            self._conn = None
+
+
+_http_clients: dict[tuple[str, str, float], KeepAliveHTTPClient] = {}  # by (scheme, netloc, timeout)
+_http_clients_lock = threading.Lock()
+
+
+def http_rquest(method, url, data, headers=None, timeout=10):
+    """
+    HTTP(S) request over a pooled keep-alive connection per origin (and timeout). Returns the response body as text,
+    raises HTTPStatusError for an error status.
+    """
+    headers = dict(headers or {})
+    if isinstance(data, (dict, list, tuple)):
+        data = json.dumps(data).encode("utf-8")
+        headers["Content-Type"] = "application/json"
+    elif isinstance(data, str):
+        data = data.encode("utf-8")
+    u = parse.urlsplit(url)
+    key = (u.scheme, u.netloc, timeout)
+    with _http_clients_lock:
+        if (client := _http_clients.get(key)) is None:
+            connection_cls = http.client.HTTPSConnection if u.scheme == "https" else http.client.HTTPConnection
+            client = KeepAliveHTTPClient(lambda: connection_cls(u.netloc, timeout=timeout))
+            _http_clients[key] = client
+    path = u.path + (f"?{u.query}" if u.query else "")
+    try:
+        resp = client.request(method, path or "/", body=data, headers=headers).decode("utf-8")
+    except HTTPStatusError as e:
+        logging.error("HTTP Error - %s %s: %s", method, url, e)
+        raise
+    logging.debug("http_rquest(%s %s d=%r h=%r) -> %r", method, url, data, list(headers), resp[:200])
+    return resp
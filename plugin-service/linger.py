@@ -0,0 +1,121 @@
+"""
+Lingering service processes, see "linger-timeout".
+
+NetworkManager starts one service process per activation of a multi-connection provider, under a new bus name
+(`org.freedesktop.NetworkManager.<provider>.Connection_<n>`). While a service process of the same provider lingers
+after Disconnect(), it listens on `<runtime dir>/vpn-bundle-linger/<provider>.sock`. The newly started process hands
+its bus name over to the lingering one and exits, before importing anything heavy. The lingering process takes the
+name and serves the activation. A service host (see host.py) listens on the same socket for as long as it runs.
+"""
+
+import argparse
+import json
+import logging
+import os
+import socket
+from typing import Callable
+
+_HANDOFF_TIMEOUT_SEC = 2
+
+
+def _socket_path(provider: str):
+    return os.path.join(os.getenv("XDG_RUNTIME_DIR", "/var/run"), "vpn-bundle-linger", f"{provider}.sock")
+
+
+def handoff_from_args(argv: list[str]) -> bool:
+    """handoff() for the service command line, if it was started for a multi-connection activation (--bus-name)."""
+    parser = argparse.ArgumentParser(add_help=False)
+    parser.add_argument("--provider")
+    parser.add_argument("--bus-name")
+    args, _ = parser.parse_known_args(argv)
+    if not args.provider or not args.bus_name:
+        return False
+    return handoff(args.provider, args.bus_name)
+
+
+def handoff(provider: str, bus_name: str) -> bool:
+    """Hands `bus_name` over to a lingering service process of `provider`. True if it took it."""
+    path = _socket_path(provider)
+    if not os.path.exists(path):
+        return False
+    try:
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM | socket.SOCK_CLOEXEC) as sock:
+            sock.settimeout(_HANDOFF_TIMEOUT_SEC)
+            sock.connect(path)
+            sock.sendall(json.dumps({"bus_name": bus_name}).encode() + b"\n")
+            reply = json.loads(sock.makefile("rb").readline() or b"{}")
+    except (OSError, ValueError):
+        return False
+    return reply.get("pid") is not None
+
+
+class LingerListener:
+    """
+    Accepts bus names handed over by newly started service processes, while this one lingers. `persistent`: for a
+    service host (see host.py), it keeps accepting them after the first one.
+    """
+
+    def __init__(self, provider: str, on_handoff: Callable[[str], bool], persistent=False) -> None:
+        self._path = _socket_path(provider)
+        self._on_handoff = on_handoff
+        self._persistent = persistent
+        self._sock: socket.socket = None
+
+    def listen(self) -> bool:
+        """False if another process of the provider lingers (or hosts its connections) already."""
+        from gi.repository import GLib
+
+        os.makedirs(os.path.dirname(self._path), mode=0o700, exist_ok=True)
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM | socket.SOCK_CLOEXEC)
+        try:
+            if os.path.exists(self._path):
+                try:
+                    sock.connect(self._path)
+                    sock.close()
+                    return False
+                except ConnectionRefusedError:  # stale, eg: after a crash
+                    os.unlink(self._path)
+                    sock.close()
+                    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM | socket.SOCK_CLOEXEC)
+            sock.bind(self._path)
+            sock.listen()
+        except OSError as e:
+            sock.close()
+            logging.warning("Could not listen for handoffs: %r", e)
+            return False
+        self._sock = sock
+        self._source = GLib.unix_fd_add_full(GLib.PRIORITY_DEFAULT, sock.fileno(), GLib.IOCondition.IN, self._accept)
+        return True
+
+    def close(self):
+        if self._sock:
+            from gi.repository import GLib
+
+            GLib.source_remove(self._source)
+            self._close_socket()
+
+    def _close_socket(self):
+        try:
+            os.unlink(self._path)
+        except OSError:
+            pass
+        self._sock.close()
+        self._sock = None
+
+    def _accept(self, *args):
+        conn, _ = self._sock.accept()
+        accepted = False
+        with conn:
+            conn.settimeout(_HANDOFF_TIMEOUT_SEC)
+            try:
+                if not (line := conn.makefile("rb").readline()):
+                    return True  # liveness probe of LingerListener.listen()
+                bus_name = json.loads(line)["bus_name"]
+                accepted = self._on_handoff(bus_name)
+                conn.sendall(json.dumps({"pid": os.getpid() if accepted else None}).encode() + b"\n")
+            except Exception as e:
+                logging.warning("Bus name handoff failed: %r", e)
+        if accepted and not self._persistent:  # not idle anymore
+            self._close_socket()
+            return False
+        return True
@@ -0,0 +1,228 @@
+"""
+Bounded logging of the service and its provider daemons.
+
+The stdout/stderr of the provider daemons is a pipe read by the main loop (see DaemonLog) instead of the service's
+stderr or an unbounded "log-file". Lines are kept in a bounded in-memory ring and forwarded to the service log (ie:
+the journal) at a limited rate. With "log-file" set they are also appended to that file, which is rotated at
+`max_file_bytes`. The service's own records are kept in a ring as well (RingHandler). A daemon that may outlive the
+service process (warm standby, "is-survive-service-restart") cannot write into its pipe: see DetachedOutput.
+
+GetLogTail() of org.freedesktop.NetworkManager.VPN.Bundle.Diagnostics, on the service's object path, returns the
+recent lines of both:
+
+    busctl call <bus name> /org/freedesktop/NetworkManager/VPN/Plugin \\
+        org.freedesktop.NetworkManager.VPN.Bundle.Diagnostics GetLogTail u 200
+"""
+
+import collections
+import heapq
+import logging
+import os
+import threading
+import time
+
+from . import supervisor
+
+INTERFACE_XML = """
+<node>
+    <interface name="org.freedesktop.NetworkManager.VPN.Bundle.Diagnostics">
+        <!--
+        GetLogTail:
+        @max_lines: How many of the most recent lines to return.
+        @lines: Recent log lines of the service and of the provider daemons, oldest first.
+        -->
+        <method name="GetLogTail">
+            <arg name="max_lines" type="u" direction="in" />
+            <arg name="lines" type="as" direction="out" />
+        </method>
+    </interface>
+</node>
+"""
+
+RING_LINES = 1000
+_MAX_LINE_BYTES = 4096
+
+_rings: dict[str, collections.deque] = {}  # source -> (time, line), the last DaemonLog of each daemon
+_rings_lock = threading.Lock()
+
+
+def _ring(source: str) -> collections.deque:
+    ring = collections.deque(maxlen=RING_LINES)
+    with _rings_lock:
+        _rings[source] = ring
+    return ring
+
+
+def tail(max_lines: int) -> list[str]:
+    with _rings_lock:
+        rings = [[(t, source, line) for t, line in list(ring)] for source, ring in _rings.items()]
+    lines = list(heapq.merge(*rings))[-max_lines:] if max_lines else []
+    return [
+        f"{time.strftime('%H:%M:%S', time.localtime(t))}.{int(t * 1000) % 1000:03d} {source}: {line}"
+        for t, source, line in lines
+    ]
+
+
+class Diagnostics:
+    def GetLogTail(self, max_lines: int) -> list[str]:
+        return tail(max_lines)
+
+
+class RingHandler(logging.Handler):
+    """Keeps the service's own records for GetLogTail()."""
+
+    def __init__(self) -> None:
+        super().__init__()
+        self._ring = _ring("service")
+
+    def emit(self, record: logging.LogRecord):
+        try:
+            self._ring.append((record.created, f"{record.levelname} {record.getMessage()}"))
+        except Exception:
+            self.handleError(record)
+
+
+_sampled: dict[str, float] = {}
+
+
+def sampled(key: str, interval_sec: float = 60) -> bool:
+    """True at most once per `interval_sec` for `key`: large payloads are dumped at INFO only now and then."""
+    now = time.monotonic()
+    if now - _sampled.get(key, -interval_sec) < interval_sec:
+        return False
+    _sampled[key] = now
+    return True
+
+
+class _RateLimit:
+    """Token bucket: `burst` lines at once, `per_sec` lines per second on average."""
+
+    def __init__(self, per_sec: float, burst: int) -> None:
+        self.per_sec = per_sec
+        self.burst = burst
+        self._tokens = float(burst)
+        self._refilled_at = time.monotonic()
+        self.suppressed = 0
+
+    def allow(self) -> bool:
+        now = time.monotonic()
+        self._tokens = min(self.burst, self._tokens + (now - self._refilled_at) * self.per_sec)
+        self._refilled_at = now
+        if self._tokens < 1:
+            self.suppressed += 1
+            return False
+        self._tokens -= 1
+        return True
+
+
+class _RotatingFile:
+    def __init__(self, path: str, max_bytes: int) -> None:
+        self.path = path
+        self.max_bytes = max_bytes
+        self._f = open(path, "ab")
+
+    def write(self, data: bytes):
+        if self._f.tell() + len(data) > self.max_bytes:
+            self._f.close()
+            os.replace(self.path, f"{self.path}.1")
+            self._f = open(self.path, "ab")
+        self._f.write(data)
+        self._f.flush()
+
+    def close(self):
+        self._f.close()
+
+
+class DetachedOutput:
+    """
+    Output of a daemon that may outlive this service process, passed as `Subprocess(..., output=DetachedOutput(...))`:
+    "log-file" (not rotated), else the stdout and stderr of the service (ie: the journal).
+    """
+
+    def __init__(self, log_file: str = None) -> None:
+        self.write_fd = None
+        if log_file:
+            self.write_fd = os.open(log_file, os.O_WRONLY | os.O_APPEND | os.O_CREAT | os.O_CLOEXEC, 0o644)
+
+    def start(self):
+        """Called once the daemon has the file: closes ours."""
+        if self.write_fd is not None:
+            os.close(self.write_fd)
+            self.write_fd = None
+
+
+class DaemonLog:
+    """
+    Output pipe of a provider daemon, passed as `Subprocess(..., output=DaemonLog(...))`. Read on the main loop, or
+    by a thread without one (see supervisor.py).
+    """
+
+    forward_lines_per_sec = 20
+    forward_burst = 200
+    max_file_bytes = 10 * 1024 * 1024
+
+    def __init__(self, name: str, log_file: str = None) -> None:
+        self.name = name
+        self._ring = _ring(name)
+        self._rate = _RateLimit(self.forward_lines_per_sec, self.forward_burst)
+        self._file = _RotatingFile(log_file, self.max_file_bytes) if log_file else None
+        self._partial = b""
+        self._read_fd, self.write_fd = os.pipe2(os.O_CLOEXEC)
+
+    def start(self):
+        """Called once the daemon has the write end: closes ours and starts reading."""
+        os.close(self.write_fd)
+        self.write_fd = None
+        if supervisor.attached():
+            os.set_blocking(self._read_fd, False)
+            supervisor.add_reader(self._read_fd, self._on_readable)
+        else:
+            threading.Thread(target=self._read_blocking, name=f"log-{self.name}", daemon=True).start()
+
+    def _on_readable(self) -> bool:
+        while True:
+            try:
+                data = os.read(self._read_fd, 65536)
+            except BlockingIOError:
+                return True
+            if not data:
+                self._close()
+                return False
+            self._feed(data)
+
+    def _read_blocking(self):
+        while data := os.read(self._read_fd, 65536):
+            self._feed(data)
+        self._close()
+
+    def _feed(self, data: bytes):
+        if self._file:
+            try:
+                self._file.write(data)
+            except OSError as e:
+                logging.warning("Could not write %s log file, not writing it anymore: %r", self.name, e)
+                self._file = None
+        *lines, self._partial = (self._partial + data).split(b"\n")
+        if len(self._partial) > _MAX_LINE_BYTES:
+            lines.append(self._partial)
+            self._partial = b""
+        now = time.time()
+        for line in lines:
+            text = line[:_MAX_LINE_BYTES].decode("utf-8", errors="replace").rstrip()
+            if not text:
+                continue
+            self._ring.append((now, text))
+            if self._rate.allow():
+                if self._rate.suppressed:
+                    logging.warning("(%s) %d lines suppressed", self.name, self._rate.suppressed)
+                    self._rate.suppressed = 0
+                logging.info("(%s) %s", self.name, text)
+
+    def _close(self):
+        if self._partial:
+            self._feed(b"\n")
+        if self._rate.suppressed:
+            logging.warning("(%s) %d lines suppressed", self.name, self._rate.suppressed)
+        os.close(self._read_fd)
+        if self._file:
+            self._file.close()
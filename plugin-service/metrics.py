@@ -0,0 +1,210 @@
+"""
+Data plane metrics of the running connection.
+
+Exported on the service's object path as org.freedesktop.NetworkManager.VPN.Bundle.Metrics next to
+org.freedesktop.NetworkManager.VPN.Plugin:
+
+    busctl call <bus name> /org/freedesktop/NetworkManager/VPN/Plugin \\
+        org.freedesktop.NetworkManager.VPN.Bundle.Metrics GetMetrics
+
+and, when $VPN_BUNDLE_METRICS_DIR is set (eg: the textfile directory of node_exporter), written to
+`<metrics dir>/nm-vpn-bundle-<connection uuid>.prom` in OpenMetrics text format every `textfile_interval_sec`.
+
+Counters are IFLA_STATS64 of the tun device, read with one rtnetlink request per sample; rates are per second since
+the previous sample. Nothing is sampled unless GetMetrics() is called or the textfile is enabled.
+"""
+
+import logging
+import os
+import time
+from typing import Callable
+
+from .netlink import LINK_STATS64_FIELDS, get_link_stats64, if_nametoindex
+from .scope import scope_cgroup
+
+INTERFACE_XML = """
+<node>
+    <interface name="org.freedesktop.NetworkManager.VPN.Bundle.Metrics">
+        <!--
+        GetMetrics:
+        @metrics: Counters of the tun device (rx-bytes, tx-packets, rx-dropped, ...), their rates
+        (rx-bytes-per-sec, ...), CPU time and RSS of the provider daemons and connected-sec. With the daemons in a
+        systemd scope (see scope.py), its accounting: scope-cpu-sec, scope-memory-bytes, scope-io-read-bytes, ...
+        Empty while not connected.
+        -->
+        <method name="GetMetrics">
+            <arg name="metrics" type="a{sv}" direction="out" />
+        </method>
+    </interface>
+</node>
+"""
+
+_RATE_FIELDS = ("rx_bytes", "tx_bytes", "rx_packets", "tx_packets")
+_CLK_TCK = os.sysconf("SC_CLK_TCK")
+_PAGE_SIZE = os.sysconf("SC_PAGE_SIZE")
+
+
+def _find_textfile_dir():
+    if metrics_dir := os.getenv("VPN_BUNDLE_METRICS_DIR"):
+        os.makedirs(metrics_dir, exist_ok=True)
+        return metrics_dir
+    return None
+
+
+try:
+    textfile_dir = _find_textfile_dir()
+except OSError as e:
+    logging.warning("Metrics textfile disabled: %r", e)
+    textfile_dir = None
+
+
+def _process_usage(pid: int) -> tuple[float, int] | None:
+    """(CPU seconds, RSS bytes) of `pid`."""
+    try:
+        with open(f"/proc/{pid}/stat") as f:
+            fields = f.read().rsplit(")", 1)[1].split()
+        with open(f"/proc/{pid}/statm") as f:
+            resident_pages = int(f.read().split()[1])
+    except (OSError, IndexError, ValueError):
+        return None
+    return (int(fields[11]) + int(fields[12])) / _CLK_TCK, resident_pages * _PAGE_SIZE  # utime + stime
+
+
+def _read_keyed(path: str) -> dict[str, int]:
+    """A flat keyed cgroup file (cpu.stat), or the sums of the keys of a nested keyed one (io.stat)."""
+    totals = {}
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            pairs = [fields] if len(fields) == 2 else (field.split("=", 1) for field in fields[1:])
+            for k, v in pairs:
+                totals[k] = totals.get(k, 0) + int(v)
+    return totals
+
+
+def _read_int(path: str) -> int | None:
+    try:
+        with open(path) as f:
+            return int(f.read())
+    except (OSError, ValueError):  # eg: memory.peak before linux 5.19
+        return None
+
+
+def _scope_usage(cgroup: str) -> dict[str, int | float]:
+    """Accounting of the systemd scope of the connection, see scope.py."""
+    usage: dict[str, int | float] = {}
+    try:
+        usage["scope-cpu-sec"] = _read_keyed(f"{cgroup}/cpu.stat")["usage_usec"] / 1e6
+        io = _read_keyed(f"{cgroup}/io.stat")
+        usage["scope-io-read-bytes"] = io.get("rbytes", 0)
+        usage["scope-io-write-bytes"] = io.get("wbytes", 0)
+    except (OSError, KeyError, ValueError) as e:
+        logging.debug("Could not read the accounting of %s: %r", cgroup, e)
+    for k, file in (
+        ("scope-memory-bytes", "memory.current"),
+        ("scope-memory-peak-bytes", "memory.peak"),
+        ("scope-tasks", "pids.current"),
+    ):
+        if (v := _read_int(f"{cgroup}/{file}")) is not None:
+            usage[k] = v
+    return usage
+
+
+class ConnectionMetrics:
+    textfile_interval_sec = 15
+
+    def __init__(self, connection: Callable[[], tuple | None]) -> None:
+        """`connection()` returns (connection uuid, tun device, connected at (monotonic), daemon pids) or None."""
+        self._connection = connection
+        self._previous: tuple[str, float, dict] = None  # (dev, monotonic time, counters) of the last sample
+        self._textfile_timer: int = None
+        self._textfile: str = None
+
+    def GetMetrics(self):
+        from pydbus import Variant
+
+        sample = self.sample()
+        return {
+            k: Variant("s" if isinstance(v, str) else "d" if isinstance(v, float) else "t", v)
+            for k, v in sample.items()
+        }
+
+    def sample(self) -> dict[str, int | float | str]:
+        if not (connection := self._connection()):
+            return {}
+        _, dev, connected_at, pids = connection
+        now = time.monotonic()
+        metrics: dict[str, int | float | str] = {"dev": dev, "connected-sec": now - connected_at}
+        ifindex = if_nametoindex(dev) if dev else None
+        if ifindex and (counters := get_link_stats64(ifindex)):
+            metrics.update((k.replace("_", "-"), v) for k, v in counters.items())
+            if self._previous and self._previous[0] == dev and now > self._previous[1]:
+                elapsed = now - self._previous[1]
+                for k in _RATE_FIELDS:
+                    metrics[f"{k.replace('_', '-')}-per-sec"] = max(0, counters[k] - self._previous[2][k]) / elapsed
+            self._previous = (dev, now, counters)
+        usages = [u for u in map(_process_usage, pids) if u]
+        if usages:
+            metrics["daemon-cpu-sec"] = sum(cpu for cpu, _ in usages)
+            metrics["daemon-rss-bytes"] = sum(rss for _, rss in usages)
+        if pids and (cgroup := scope_cgroup(pids[0])):
+            metrics.update(_scope_usage(cgroup))
+        return metrics
+
+    def start_textfile(self, connection_uuid: str):
+        if not textfile_dir:
+            return
+        from gi.repository import GLib
+
+        self.stop_textfile()
+        self._textfile = os.path.join(textfile_dir, f"nm-vpn-bundle-{connection_uuid}.prom")
+        self._write_textfile()
+        self._textfile_timer = GLib.timeout_add_seconds(self.textfile_interval_sec, self._write_textfile)
+
+    def stop_textfile(self):
+        if self._textfile_timer:
+            from gi.repository import GLib
+
+            GLib.source_remove(self._textfile_timer)
+            self._textfile_timer = None
+        if self._textfile:
+            try:
+                os.unlink(self._textfile)
+            except FileNotFoundError:
+                pass
+            self._textfile = None
+
+    def _write_textfile(self):
+        connection = self._connection()
+        if not connection or not self._textfile:
+            return True
+        labels = f'connection="{connection[0]}",dev="{connection[1]}"'
+        lines = []
+        metrics = self.sample()
+        for k in LINK_STATS64_FIELDS:
+            name = f"nm_vpn_bundle_{k}"
+            if (v := metrics.get(k.replace("_", "-"))) is not None:
+                lines += [f"# TYPE {name} counter", f"{name}_total{{{labels}}} {v}"]
+        for k, name, kind in (
+            ("daemon-cpu-sec", "nm_vpn_bundle_daemon_cpu_seconds", "counter"),
+            ("daemon-rss-bytes", "nm_vpn_bundle_daemon_resident_memory_bytes", "gauge"),
+            ("connected-sec", "nm_vpn_bundle_connected_seconds", "gauge"),
+            ("scope-cpu-sec", "nm_vpn_bundle_scope_cpu_seconds", "counter"),
+            ("scope-memory-bytes", "nm_vpn_bundle_scope_memory_bytes", "gauge"),
+            ("scope-memory-peak-bytes", "nm_vpn_bundle_scope_memory_peak_bytes", "gauge"),
+            ("scope-io-read-bytes", "nm_vpn_bundle_scope_io_read_bytes", "counter"),
+            ("scope-io-write-bytes", "nm_vpn_bundle_scope_io_write_bytes", "counter"),
+            ("scope-tasks", "nm_vpn_bundle_scope_tasks", "gauge"),
+        ):
+            if (v := metrics.get(k)) is not None:
+                sample_name = f"{name}_total" if kind == "counter" else name
+                lines += [f"# TYPE {name} {kind}", f"{sample_name}{{{labels}}} {v}"]
+        lines.append("# EOF")
+        tmp = f"{self._textfile}.tmp"
+        try:
+            with open(tmp, "w") as f:
+                f.write("\n".join(lines) + "\n")
+            os.replace(tmp, self._textfile)
+        except OSError as e:
+            logging.warning("Could not write metrics textfile: %r", e)
+        return True
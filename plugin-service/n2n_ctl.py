@@ -1,17 +1,26 @@
 import ipaddress
 import logging
-import sys
 
+from . import tuning
 from .common import ConnectionResult, VPNConnectionControlBase
+from .logs import DaemonLog
 from .utils import (
     Subprocess,
     find_valid_if_name,
-    get_iface_addresses,
+    get_iface_addresses_by_family,
+    get_iface_mtu,
     getter,
-    is_interface_ready,
-    timeout,
+    wait_for_interface,
 )
 
+_CIPHERS = {"none": "-A1", "Twofish": "-A2", "AES": "-A3", "ChaCha20": "-A4", "Speck": "-A5"}
+_COMPRESSIONS = {"none": None, "lzo": "-z1", "zstd": "-z2"}
+
+
+def _compression(h: tuning.Host):
+    """LZO pays off on slow links only, and with a CPU to spare."""
+    return "lzo" if h.link_mbps and h.link_mbps < 100 and h.cpus > 1 else "none"
+
 
 class N2NControl(VPNConnectionControlBase):
     _ready_check_interval_sec = 2
@@ -20,16 +29,11 @@ class N2NControl(VPNConnectionControlBase):
 
     def start(self, *, connection_uuid: str, connection_name: str, vpn_data: dict[str, str]):
         dev = self._run_n2n_edge(connection_name, vpn_data)
-        ipv4, ipv6 = None, None
-        for a in get_iface_addresses(dev):
-            if a.version == 4 and not ipv4:
-                ipv4 = a
-            elif not ipv6:
-                ipv6 = a
+        ipv4, ipv6 = get_iface_addresses_by_family(dev)
         return ConnectionResult(
             ipv4=ipv4,
             ipv6=ipv6,
-            # mtu=mtu,
+            mtu=get_iface_mtu(dev),
             # dns=dns,
             dev=dev,
             gateway=ipaddress.IPv4Address("255.255.255.255"),  # dummy
@@ -56,19 +60,30 @@ class N2NControl(VPNConnectionControlBase):
             edge_cmd.extend(("-a", static_ip))
         if vpn_data_get("force-relay-via-supernode") == "true":
             edge_cmd.append("-S1")
+        if mtu := int(vpn_data_get("mtu", 0)):
+            edge_cmd.extend(("-M", str(mtu)))
+        # the whole community must use the same transform: never derived from the host, unset keeps the edge's default
+        if cipher := _CIPHERS.get(vpn_data_get("cipher", "")):
+            edge_cmd.append(cipher)
+        if compression := _COMPRESSIONS[tuning.resolve(vpn_data, "compression", _compression)]:
+            edge_cmd.append(compression)
         for _ in range(0, int(vpn_data_get("verbose", "0"))):
             edge_cmd.append("-v")
 
-        stderr = sys.stderr
-        if log_file := vpn_data_get("log-file"):
-            stderr = open(log_file, "wb+")
         logging.info("Run n2n edge %r", edge_cmd)
-        self._proc_n2n_edge = Subprocess(edge_cmd, name="n2n-edge", stderr=stderr)
+        self._proc_n2n_edge = Subprocess(
+            edge_cmd, name="n2n-edge", output=DaemonLog("n2n-edge", vpn_data_get("log-file")), scope=self.scope
+        )
+        self._proc_n2n_edge.on_exit(self.service.daemon_exited)
 
-        with timeout(self._ready_timeout_sec, description=f"Wait for interface: {dev}") as t:
-            while not is_interface_ready(dev):
-                if not self._proc_n2n_edge.is_running:
-                    raise RuntimeError("n2n edge cmd exited prematurely")
-                t.sleep(self._ready_check_interval_sec)
+        wait_for_interface(
+            dev,
+            self._proc_n2n_edge,
+            self._ready_timeout_sec,
+            on_link=lambda: self.service.announce_device(dev, has_ipv4=True, has_ipv6=False),
+            poll_interval_sec=self._ready_check_interval_sec,
+            cancel=self.cancel,
+        )
+        tuning.set_tx_queue_length(dev, vpn_data)
 
         return dev
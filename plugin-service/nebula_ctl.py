@@ -2,56 +2,98 @@ import ipaddress
 import json
 import logging
 import os
-import sys
+import signal
 from collections import defaultdict
 from contextlib import suppress
 
+from . import tuning
 from .common import ConnectionResult, VPNConnectionControlBase
+from .logs import DaemonLog, DetachedOutput
 from .utils import (
+    AdoptedProcess,
     Subprocess,
     find_valid_if_name,
-    get_iface_addresses,
+    get_iface_addresses_by_family,
+    get_iface_mtu,
     getter,
-    is_interface_ready,
-    timeout,
+    process_start_time,
+    wait_for_interface,
+    write_file_atomic,
 )
 
 
 class NebulaControl(VPNConnectionControlBase):
     _ready_check_interval_sec = 2
     _ready_timeout_sec = 30
-    _proc_nebula: Subprocess = None
+    supports_adopt = True
+    _proc_nebula: Subprocess | AdoptedProcess = None
+    # nebula re-reads them on SIGHUP
+    live_settings = frozenset(
+        {"inbound-rules", "outbound-rules", "lighthouse-host-port", "logging-level", "realy-use_relays"}
+    )
 
     def start(self, *, connection_uuid: str, connection_name: str, vpn_data: dict[str, str]):
-        self._config_file = f"{os.getenv('XDG_RUNTIME_DIR','/var/run')}/nebula-nm/config.{connection_uuid}.json"
+        self._config_file = self._config_path(connection_uuid)
         os.makedirs(os.path.dirname(self._config_file), exist_ok=True)
 
         dev = self._run_nebula(connection_name, vpn_data)
-        ipv4, ipv6 = None, None
-        for a in get_iface_addresses(dev):
-            if a.version == 4 and not ipv4:
-                ipv4 = a
-            elif not ipv6:
-                ipv6 = a
+        ipv4, ipv6 = get_iface_addresses_by_family(dev)
         return ConnectionResult(
             ipv4=ipv4,
             ipv6=ipv6,
-            # mtu=mtu,
+            mtu=get_iface_mtu(dev),
             # dns=dns,
             dev=dev,
             gateway=ipaddress.IPv4Address("255.255.255.255"),  # dummy
         )
 
+    @staticmethod
+    def _config_path(connection_uuid: str):
+        return f"{os.getenv('XDG_RUNTIME_DIR','/var/run')}/nebula-nm/config.{connection_uuid}.json"
+
+    def runtime_state(self):
+        return {
+            "dev": self._dev,
+            "nebula_pid": self._proc_nebula.pid,
+            "nebula_start_time": process_start_time(self._proc_nebula.pid),
+        }
+
+    def adopt(self, runtime_state: dict, *, connection_uuid: str, connection_name: str, vpn_data: dict[str, str]):
+        self._config_file = self._config_path(connection_uuid)
+        self._proc_nebula = AdoptedProcess(
+            runtime_state["nebula_pid"], runtime_state["nebula_start_time"], name="nebula"
+        )
+        self._proc_nebula.on_exit(self.service.daemon_exited)
+        with open(self._config_file) as f:
+            self._config_json = f.read()
+        self._connection_name = connection_name
+        self._dev = runtime_state["dev"]
+
+    def release(self):
+        if isinstance(self._proc_nebula, Subprocess):
+            self._proc_nebula.detach()
+
     def stop(self):
         if self._proc_nebula:
             self._proc_nebula.graceful_kill()
         with suppress(FileNotFoundError):
             os.unlink(self._config_file)
 
-    def _run_nebula(self, connection_name, vpn_data: dict[str, str]):
+    def apply_settings(self, changed: dict[str, str | None], vpn_data: dict[str, str]) -> bool:
+        if not self._proc_nebula or not self._proc_nebula.is_running:
+            return False
+        config = self._config(self._connection_name, vpn_data, dev=self._dev)
+        config_json = json.dumps(config, indent=4)
+        if config_json != self._config_json:
+            write_file_atomic(self._config_file, config_json.encode())
+            self._config_json = config_json
+            logging.info("Nebula config changed, reloading nebula")
+            self._proc_nebula.send_signal(signal.SIGHUP)
+        return True
+
+    def _config(self, connection_name, vpn_data: dict[str, str], dev: str = None) -> dict:
+        """The config of nebula. `dev`: of the running nebula."""
         vpn_data_get = getter(vpn_data)
-        nebula_bin = vpn_data_get("nebula-bin", "nebula")
-        nebula_cmd = [nebula_bin, "-config", self._config_file]
         config = defaultdict(dict)
         config["pki"] = {
             "ca": vpn_data["pki-ca"],
@@ -64,7 +106,15 @@ class NebulaControl(VPNConnectionControlBase):
             "interval": 60,
             "hosts": [vpn_data["lighthouse-overlay-ip"]],
         }
-        config["tun"]["dev"] = vpn_data_get("tun-dev") or find_valid_if_name(connection_name)
+        config["tun"]["dev"] = vpn_data_get("tun-dev") or dev or find_valid_if_name(connection_name)
+        if mtu := int(vpn_data_get("mtu", 0)):
+            config["tun"]["mtu"] = mtu
+        if tx_queue := tuning.resolve(vpn_data, "tx-queue-length", tuning.tx_queue_length):
+            config["tun"]["tx_queue"] = tx_queue
+        # routines > 1: a multi-queue tun device and SO_REUSEPORT UDP sockets, one reader pair per routine
+        config["routines"] = tuning.resolve(vpn_data, "routines", tuning.workers)
+        if socket_buffer := tuning.resolve(vpn_data, "socket-buffer", tuning.socket_buffer_bytes):
+            config["listen"]["read_buffer"] = config["listen"]["write_buffer"] = socket_buffer
         if logging_level := vpn_data_get("logging-level"):
             config["logging"]["level"] = logging_level
         if "realy-use_relays" in vpn_data:
@@ -82,21 +132,37 @@ class NebulaControl(VPNConnectionControlBase):
         )
 
         logging.debug("Nebula config: %r", config)
-        with open(self._config_file, "w") as f:
-            json.dump(config, f, indent=4)
+        return config
+
+    def _run_nebula(self, connection_name, vpn_data: dict[str, str]):
+        vpn_data_get = getter(vpn_data)
+        nebula_bin = vpn_data_get("nebula-bin", "nebula")
+        nebula_cmd = [nebula_bin, "-config", self._config_file]
+        self._connection_name = connection_name
+        config = self._config(connection_name, vpn_data)
+        self._dev = config["tun"]["dev"]
+        self._config_json = json.dumps(config, indent=4)
+        write_file_atomic(self._config_file, self._config_json.encode())
 
-        stderr = sys.stderr
-        if log_file := vpn_data_get("log-file"):
-            stderr = open(log_file, "wb+")
         logging.info("Run nebula %r", nebula_cmd)
-        self._proc_nebula = Subprocess(nebula_cmd, name="nebula", stderr=stderr)
+        if vpn_data_get("is-survive-service-restart") == "true":
+            output = DetachedOutput(vpn_data_get("log-file"))
+        else:
+            output = DaemonLog("nebula", vpn_data_get("log-file"))
+        self._proc_nebula = Subprocess(nebula_cmd, name="nebula", scope=self.scope, output=output)
+        self._proc_nebula.on_exit(self.service.daemon_exited)
 
         dev = config["tun"]["dev"]
-        with timeout(self._ready_timeout_sec, description=f"Wait for interface: {dev}") as t:
-            while not is_interface_ready(dev):
-                if not self._proc_nebula.is_running:
-                    raise RuntimeError("nebula cmd exited prematurely")
-                t.sleep(self._ready_check_interval_sec)
+        # the overlay address comes from the certificate, it shares the family of the lighthouse's one
+        ipv6 = ipaddress.ip_address(vpn_data["lighthouse-overlay-ip"]).version == 6
+        wait_for_interface(
+            dev,
+            self._proc_nebula,
+            self._ready_timeout_sec,
+            on_link=lambda: self.service.announce_device(dev, has_ipv4=not ipv6, has_ipv6=ipv6),
+            poll_interval_sec=self._ready_check_interval_sec,
+            cancel=self.cancel,
+        )
 
         return dev
 
@@ -0,0 +1,287 @@
+import logging
+import os
+import socket
+import struct
+
+# https://man7.org/linux/man-pages/man7/rtnetlink.7.html
+
+RTMGRP_LINK = 0x1
+RTMGRP_IPV4_IFADDR = 0x10
+RTMGRP_IPV4_ROUTE = 0x40
+RTMGRP_IPV6_IFADDR = 0x100
+RTMGRP_IPV6_ROUTE = 0x400
+
+NLMSG_ERROR = 2
+NLM_F_REQUEST = 0x1
+NLM_F_ACK = 0x4
+NLA_F_NESTED = 0x8000
+
+RTM_NEWLINK = 16
+RTM_DELLINK = 17
+RTM_GETLINK = 18
+RTM_NEWADDR = 20
+RTM_DELADDR = 21
+RTM_NEWROUTE = 24
+RTM_DELROUTE = 25
+
+RTA_OIF = 4
+IFLA_STATS64 = 23
+
+# https://docs.kernel.org/networking/ethtool-netlink.html, over generic netlink
+NETLINK_GENERIC = 16  # not in the socket module
+GENL_ID_CTRL = 0x10
+CTRL_CMD_GETFAMILY = 3
+CTRL_ATTR_FAMILY_ID = 1
+CTRL_ATTR_FAMILY_NAME = 2
+ETHTOOL_GENL_VERSION = 1
+ETHTOOL_MSG_FEATURES_GET = 11
+ETHTOOL_MSG_FEATURES_SET = 12
+ETHTOOL_A_HEADER_DEV_NAME = 2
+ETHTOOL_A_FEATURES_HEADER = 1
+ETHTOOL_A_FEATURES_WANTED = 3
+ETHTOOL_A_FEATURES_ACTIVE = 4
+ETHTOOL_A_BITSET_BITS = 3
+ETHTOOL_A_BITSET_BITS_BIT = 1
+ETHTOOL_A_BITSET_BIT_NAME = 2
+ETHTOOL_A_BITSET_BIT_VALUE = 3
+
+_NLMSGHDR = struct.Struct("=IHHII")  # len, type, flags, seq, pid
+_IFINFOMSG = struct.Struct("=BxHiII")  # family, type, index, flags, change
+_IFADDRMSG = struct.Struct("=BBBBI")  # family, prefixlen, flags, scope, index
+_RTMSG = struct.Struct("=BBBBBBBBI")  # family, dst_len, src_len, tos, table, protocol, scope, type, flags
+_RTATTR = struct.Struct("=HH")  # len, type
+_GENLMSGHDR = struct.Struct("=BBxx")  # cmd, version
+# leading fields of struct rtnl_link_stats64, the kernel appends new ones
+_LINK_STATS64 = struct.Struct("=10Q")
+LINK_STATS64_FIELDS = (
+    "rx_packets",
+    "tx_packets",
+    "rx_bytes",
+    "tx_bytes",
+    "rx_errors",
+    "tx_errors",
+    "rx_dropped",
+    "tx_dropped",
+    "multicast",
+    "collisions",
+)
+
+
+def _align(n: int) -> int:
+    return (n + 3) & ~3
+
+
+def _find_attr(msg: bytes, offset: int, attr_type: int) -> bytes | None:
+    """Payload of the first `attr_type` attribute at and after `offset`."""
+    while offset + _RTATTR.size <= len(msg):
+        rta_len, rta_type = _RTATTR.unpack_from(msg, offset)
+        if rta_len < _RTATTR.size:
+            break
+        if rta_type == attr_type:
+            return msg[offset + _RTATTR.size : offset + rta_len]
+        offset += _align(rta_len)
+    return None
+
+
+def _iter_attrs(data: bytes):
+    """(type, payload) of the attributes of a message body or of a nested attribute."""
+    offset = 0
+    while offset + _RTATTR.size <= len(data):
+        rta_len, rta_type = _RTATTR.unpack_from(data, offset)
+        if rta_len < _RTATTR.size:
+            break
+        yield rta_type & ~NLA_F_NESTED, data[offset + _RTATTR.size : offset + rta_len]
+        offset += _align(rta_len)
+
+
+def _attr(attr_type: int, payload: bytes) -> bytes:
+    data = _RTATTR.pack(_RTATTR.size + len(payload), attr_type) + payload
+    return data.ljust(_align(len(data)), b"\0")
+
+
+def _nested(attr_type: int, *attrs: bytes) -> bytes:
+    return _attr(attr_type | NLA_F_NESTED, b"".join(attrs))
+
+
+def _route_oif(msg: bytes, offset: int) -> int | None:
+    if (oif := _find_attr(msg, offset, RTA_OIF)) is None:
+        return None
+    return struct.unpack_from("=I", oif)[0]
+
+
+def iter_message_ifindexes(data: bytes):
+    """Yields (msg_type, ifindex) for every link/address/route message in a rtnetlink datagram."""
+    offset = 0
+    while offset + _NLMSGHDR.size <= len(data):
+        msg_len, msg_type, _, _, _ = _NLMSGHDR.unpack_from(data, offset)
+        if msg_len < _NLMSGHDR.size:
+            break
+        body = offset + _NLMSGHDR.size
+        msg = data[: offset + msg_len]
+        if msg_type in (RTM_NEWLINK, RTM_DELLINK):
+            yield msg_type, _IFINFOMSG.unpack_from(msg, body)[2]
+        elif msg_type in (RTM_NEWADDR, RTM_DELADDR):
+            yield msg_type, _IFADDRMSG.unpack_from(msg, body)[4]
+        elif msg_type in (RTM_NEWROUTE, RTM_DELROUTE):
+            yield msg_type, _route_oif(msg, body + _RTMSG.size)
+        offset += _align(msg_len)
+
+
+class RtnetlinkMonitor:
+    """Non-blocking rtnetlink multicast subscription for link, address and route changes."""
+
+    def __init__(
+        self,
+        groups=RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR | RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE,
+    ) -> None:
+        self.sock = socket.socket(socket.AF_NETLINK, socket.SOCK_RAW | socket.SOCK_NONBLOCK, socket.NETLINK_ROUTE)
+        self.sock.bind((0, groups))
+
+    def fileno(self):
+        return self.sock.fileno()
+
+    def drain(self, ifindex: int | None = None) -> bool:
+        """Reads all pending messages. Returns True if any of them concerns `ifindex` (or any interface if None)."""
+        relevant = False
+        while True:
+            try:
+                data = self.sock.recv(65536)
+            except BlockingIOError:
+                return relevant
+            except OSError as e:  # ENOBUFS: we lost messages, treat as a change
+                logging.debug("rtnetlink recv failed: %r", e)
+                return True
+            if not data:
+                return relevant
+            for _, index in iter_message_ifindexes(data):
+                if ifindex is None or index is None or index == ifindex:
+                    relevant = True
+
+    def drain_ifindexes(self) -> set[int | None]:
+        """Reads all pending messages. Returns the interfaces they concern (None: any, eg: messages were lost)."""
+        ifindexes = set()
+        while True:
+            try:
+                data = self.sock.recv(65536)
+            except BlockingIOError:
+                return ifindexes
+            except OSError as e:  # ENOBUFS
+                logging.debug("rtnetlink recv failed: %r", e)
+                ifindexes.add(None)
+                continue
+            if not data:
+                return ifindexes
+            ifindexes.update(index for _, index in iter_message_ifindexes(data))
+
+    def close(self):
+        self.sock.close()
+
+    @staticmethod
+    def open():
+        try:
+            return RtnetlinkMonitor()
+        except OSError as e:
+            logging.warning("Could not subscribe to rtnetlink, fall back to polling: %r", e)
+            return None
+
+
+def get_link_stats64(ifindex: int) -> dict[str, int] | None:
+    """IFLA_STATS64 counters of a link (as `ip -s link` shows them), with one RTM_GETLINK request."""
+    with socket.socket(socket.AF_NETLINK, socket.SOCK_RAW | socket.SOCK_CLOEXEC, socket.NETLINK_ROUTE) as sock:
+        sock.settimeout(1)
+        body = _IFINFOMSG.pack(socket.AF_UNSPEC, 0, ifindex, 0, 0)
+        sock.send(_NLMSGHDR.pack(_NLMSGHDR.size + len(body), RTM_GETLINK, NLM_F_REQUEST, 1, 0) + body)
+        data = sock.recv(65536)
+    msg_len, msg_type, _, _, _ = _NLMSGHDR.unpack_from(data)
+    if msg_type != RTM_NEWLINK:  # NLMSG_ERROR, eg: ENODEV
+        return None
+    stats = _find_attr(data[:msg_len], _NLMSGHDR.size + _IFINFOMSG.size, IFLA_STATS64)
+    if stats is None or len(stats) < _LINK_STATS64.size:
+        return None
+    return dict(zip(LINK_STATS64_FIELDS, _LINK_STATS64.unpack_from(stats)))
+
+
+def if_nametoindex(dev: str) -> int | None:
+    try:
+        return socket.if_nametoindex(dev)
+    except OSError:
+        return None
+
+
+def _genl_request(sock: socket.socket, family: int, cmd: int, version: int, attrs: bytes) -> bytes:
+    """Sends a generic netlink request, returns the attributes of its reply (empty if there is none)."""
+    body = _GENLMSGHDR.pack(cmd, version) + attrs
+    sock.send(_NLMSGHDR.pack(_NLMSGHDR.size + len(body), family, NLM_F_REQUEST | NLM_F_ACK, 1, 0) + body)
+    reply = b""
+    while True:  # the reply (if any), then the ack
+        data = sock.recv(65536)
+        offset = 0
+        while offset + _NLMSGHDR.size <= len(data):
+            msg_len, msg_type, _, _, _ = _NLMSGHDR.unpack_from(data, offset)
+            if msg_len < _NLMSGHDR.size:
+                break
+            if msg_type == NLMSG_ERROR:
+                if errno := -struct.unpack_from("=i", data, offset + _NLMSGHDR.size)[0]:
+                    raise OSError(errno, os.strerror(errno))
+                return reply
+            reply = data[offset + _NLMSGHDR.size + _GENLMSGHDR.size : offset + msg_len]
+            offset += _align(msg_len)
+
+
+class Ethtool:
+    """The ethtool generic netlink family (what `ethtool -k/-K` use), for the features of a device."""
+
+    def __init__(self) -> None:
+        self.sock = socket.socket(socket.AF_NETLINK, socket.SOCK_RAW | socket.SOCK_CLOEXEC, NETLINK_GENERIC)
+        self.sock.settimeout(1)
+        reply = _genl_request(
+            self.sock, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 1, _attr(CTRL_ATTR_FAMILY_NAME, b"ethtool\0")
+        )
+        family = next((p for t, p in _iter_attrs(reply) if t == CTRL_ATTR_FAMILY_ID), None)
+        if family is None:
+            self.sock.close()
+            raise OSError("no ethtool generic netlink family")
+        self.family = struct.unpack_from("=H", family)[0]
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.sock.close()
+
+    def _header(self, dev: str):
+        return _nested(ETHTOOL_A_FEATURES_HEADER, _attr(ETHTOOL_A_HEADER_DEV_NAME, dev.encode() + b"\0"))
+
+    def active_features(self, dev: str) -> set[str]:
+        """Names of the features that are on."""
+        reply = _genl_request(self.sock, self.family, ETHTOOL_MSG_FEATURES_GET, ETHTOOL_GENL_VERSION, self._header(dev))
+        active = set()
+        for attr_type, bitset in _iter_attrs(reply):
+            if attr_type != ETHTOOL_A_FEATURES_ACTIVE:
+                continue
+            # a list of the set bits (ETHTOOL_A_BITSET_NOMASK)
+            for _, bits in (a for a in _iter_attrs(bitset) if a[0] == ETHTOOL_A_BITSET_BITS):
+                for _, bit in _iter_attrs(bits):
+                    for bit_attr, value in _iter_attrs(bit):
+                        if bit_attr == ETHTOOL_A_BITSET_BIT_NAME:
+                            active.add(value.rstrip(b"\0").decode())
+        return active
+
+    def set_features(self, dev: str, features: dict[str, bool]):
+        """Turns the named features on or off, the others are left as they are."""
+        bits = [
+            _nested(
+                ETHTOOL_A_BITSET_BITS_BIT,
+                _attr(ETHTOOL_A_BITSET_BIT_NAME, name.encode() + b"\0"),
+                *([_attr(ETHTOOL_A_BITSET_BIT_VALUE, b"")] if on else []),
+            )
+            for name, on in features.items()
+        ]
+        wanted = _nested(ETHTOOL_A_FEATURES_WANTED, _nested(ETHTOOL_A_BITSET_BITS, *bits))
+        _genl_request(
+            self.sock,
+            self.family,
+            ETHTOOL_MSG_FEATURES_SET,
+            ETHTOOL_GENL_VERSION,
+            self._header(dev) + wanted,
+        )
@@ -0,0 +1,66 @@
+"""
+Setting changes of a running connection.
+
+Changed vpn.data of the active connection is applied without a reconnect: each provider applies the keys in its
+`live_settings` (see VPNConnectionControlBase.apply_settings()), eg: `tailscale set`, a SIGHUP to nebula or tincd.
+A change of any other key restarts the provider daemon within the same activation.
+
+The service follows the connection's settings in NetworkManager (its Updated signal, ie: `nmcli connection modify`)
+while connected. Updated settings can also be passed in with Apply() of
+org.freedesktop.NetworkManager.VPN.Bundle.Settings on the service's object path, or NewSecrets().
+"""
+
+import logging
+from typing import Callable
+
+INTERFACE_XML = """
+<node>
+    <interface name="org.freedesktop.NetworkManager.VPN.Bundle.Settings">
+        <!--
+        Apply:
+        @connection: Settings of the active connection, like ConnectInteractive() takes them.
+        @outcome: "unchanged", "applying" (live), "restarting" (the provider daemon is restarted) or "pending" (applied
+            once the change in progress is done).
+        -->
+        <method name="Apply">
+            <arg name="connection" type="a{sa{sv}}" direction="in" />
+            <arg name="outcome" type="s" direction="out" />
+        </method>
+    </interface>
+</node>
+"""
+
+_NM_BUS_NAME = "org.freedesktop.NetworkManager"
+
+
+def diff(old: dict[str, str], new: dict[str, str]) -> dict[str, str | None]:
+    """Keys of `new` whose value differs from `old`, and the removed ones (None)."""
+    changed = {k: v for k, v in new.items() if old.get(k) != v}
+    changed.update((k, None) for k in old.keys() - new.keys())
+    return changed
+
+
+class Settings:
+    def __init__(self, apply: Callable[[dict], str]) -> None:
+        self._apply = apply
+
+    def Apply(self, connection: dict) -> str:
+        return self._apply(connection)
+
+
+class ConnectionFollower:
+    """Calls `on_updated(settings)` when the settings of connection `uuid` are updated in NetworkManager."""
+
+    def __init__(self, bus, uuid: str, on_updated: Callable[[dict], None]) -> None:
+        self._subscription = None
+        try:
+            path = bus.get(_NM_BUS_NAME, "/org/freedesktop/NetworkManager/Settings").GetConnectionByUuid(uuid)
+            self._connection = bus.get(_NM_BUS_NAME, path)
+            self._subscription = self._connection.Updated.connect(lambda: on_updated(self._connection.GetSettings()))
+        except Exception as e:  # eg: on the session bus in development
+            logging.info("Not following the settings of connection %s: %r", uuid, e)
+
+    def close(self):
+        if self._subscription:
+            self._subscription.disconnect()
+            self._subscription = None
@@ -0,0 +1,118 @@
+import heapq
+import ipaddress
+from typing import Iterable
+
+AnyIPNetwork = ipaddress.IPv4Network | ipaddress.IPv6Network
+
+# Summaries are never widened beyond these, so a cap can not turn routes into (almost) default routes.
+DEFAULT_MIN_SUMMARY_PREFIXLEN = {4: 8, 6: 16}
+
+
+def aggregate_routes(
+    networks: Iterable[AnyIPNetwork],
+    max_routes: int = 0,
+    min_summary_prefixlen: dict[int, int] = None,
+) -> list[AnyIPNetwork]:
+    """
+    Smallest set of prefixes routing exactly the same destinations as `networks`:
+    prefixes covered by another one are dropped and sibling prefixes are merged into their parent.
+
+    With `max_routes`, each address family is further summarized down to at most that many prefixes, by repeatedly
+    replacing the two neighbouring prefixes having the longest common prefix with that common prefix.
+    Summaries are bounded by `min_summary_prefixlen`, so the cap is best effort.
+    """
+    min_summary_prefixlen = min_summary_prefixlen or DEFAULT_MIN_SUMMARY_PREFIXLEN
+    by_family: dict[int, list[tuple[int, int]]] = {4: [], 6: []}
+    for n in networks:
+        by_family[n.version].append((int(n.network_address), n.prefixlen))
+
+    result = []
+    for version, prefixes in by_family.items():
+        if not prefixes:
+            continue
+        bits = 32 if version == 4 else 128
+        prefixes = _collapse(prefixes, bits)
+        if max_routes and len(prefixes) > max_routes:
+            prefixes = _summarize(prefixes, bits, max_routes, min_summary_prefixlen[version])
+        network_cls = ipaddress.IPv4Network if version == 4 else ipaddress.IPv6Network
+        result.extend(network_cls(p) for p in prefixes)
+    return result
+
+
+def _collapse(prefixes: list[tuple[int, int]], bits: int) -> list[tuple[int, int]]:
+    """
+    In-order walk of the (implicit) binary prefix trie: after sorting by (address, prefixlen) a covering prefix
+    comes right before everything it covers, and two siblings end up next to each other on the stack.
+    """
+    stack: list[tuple[int, int]] = []
+    for prefix in sorted(set(prefixes)):
+        if stack and _covers(stack[-1], prefix, bits):
+            continue
+        stack.append(prefix)
+        while len(stack) >= 2:
+            (a_addr, a_plen), (b_addr, b_plen) = stack[-2], stack[-1]
+            if a_plen != b_plen or not a_plen or a_addr ^ b_addr != 1 << (bits - a_plen):
+                break
+            stack[-2:] = [(a_addr, a_plen - 1)]
+    return stack
+
+
+def _common_prefixlen(a: tuple[int, int], b: tuple[int, int], bits: int) -> int:
+    return min(a[1], b[1], bits - (a[0] ^ b[0]).bit_length())
+
+
+def _covers(outer: tuple[int, int], inner: tuple[int, int], bits: int) -> bool:
+    return outer[1] <= inner[1] and _common_prefixlen(outer, inner, bits) == outer[1]
+
+
+def _summarize(prefixes: list[tuple[int, int]], bits: int, max_routes: int, min_prefixlen: int):
+    """Greedy summarization over a doubly linked list of the sorted prefixes, best merges first (heap)."""
+    nodes = list(prefixes)
+    count = len(nodes)
+    prev = list(range(-1, count - 1))
+    next_ = list(range(1, count + 1))
+    next_[-1] = -1
+    alive = [True] * count
+    # bumped whenever a node is widened, to recognize outdated heap entries
+    version = [0] * count
+
+    def pair(left, right):
+        return (-_common_prefixlen(nodes[left], nodes[right], bits), left, right, version[left], version[right])
+
+    heap = [pair(i, i + 1) for i in range(count - 1)]
+    heapq.heapify(heap)
+
+    def unlink(i):
+        nonlocal count
+        alive[i] = False
+        count -= 1
+        p, n = prev[i], next_[i]
+        if p != -1:
+            next_[p] = n
+        if n != -1:
+            prev[n] = p
+
+    while count > max_routes and heap:
+        neg_len, left, right, left_version, right_version = heapq.heappop(heap)
+        if not (alive[left] and alive[right]) or next_[left] != right:
+            continue  # stale pair
+        if version[left] != left_version or version[right] != right_version:
+            continue
+        common = -neg_len
+        if common < min_prefixlen:
+            break
+        summary = (nodes[left][0] & ~((1 << (bits - common)) - 1), common)
+        nodes[left] = summary
+        version[left] += 1
+        unlink(right)
+        # a wider summary may swallow more neighbours
+        while prev[left] != -1 and _covers(summary, nodes[prev[left]], bits):
+            unlink(prev[left])
+        while next_[left] != -1 and _covers(summary, nodes[next_[left]], bits):
+            unlink(next_[left])
+        if prev[left] != -1:
+            heapq.heappush(heap, pair(prev[left], left))
+        if next_[left] != -1:
+            heapq.heappush(heap, pair(left, next_[left]))
+
+    return _collapse([nodes[i] for i in range(len(nodes)) if alive[i]], bits)
@@ -0,0 +1,193 @@
+"""
+Runtime records of connected connections, see "is-survive-service-restart".
+
+While a connection whose provider supports adopt() is connected, its service process keeps
+`<runtime dir>/vpn-bundle-runtime/<connection uuid>.json` up to date: the service process, the daemons (pid and
+start time), what the provider's adopt() needs (eg: socket and config paths, tun device) and the last result pushed
+to NetworkManager. When that process goes away without a Disconnect() (crash, restart, upgrade), it leaves the daemons
+running; the service process of the next activation of the connection adopts them by pidfd (claim()), instead of
+starting new ones. Records whose process is gone and that nobody claimed within _ORPHAN_TIMEOUT_SEC are swept, their
+daemons stopped.
+"""
+
+import dataclasses
+import ipaddress
+import json
+import logging
+import os
+import select
+import time
+from pathlib import Path
+
+from .common import ConnectionResult
+from .utils import AdoptedProcess, process_start_time
+
+_OWNER_EXIT_TIMEOUT_SEC = 5
+_ORPHAN_TIMEOUT_SEC = 600
+
+# ConnectionResult fields holding ipaddress objects -> parser of their str()
+_IP_FIELDS = {
+    "gateway": ipaddress.ip_address,
+    "ipv4": ipaddress.ip_interface,
+    "ipv6": ipaddress.ip_interface,
+    "dns": ipaddress.ip_address,
+    "routes": ipaddress.ip_network,
+}
+
+
+def _records_dir():
+    return Path(os.getenv("XDG_RUNTIME_DIR", "/var/run"), "vpn-bundle-runtime")
+
+
+def _record_path(uuid: str):
+    return _records_dir() / f"{uuid}.json"
+
+
+def dump_result(result: ConnectionResult) -> dict:
+    record = {}
+    for field in dataclasses.fields(result):
+        value = getattr(result, field.name)
+        if field.name in _IP_FIELDS and value is not None:
+            value = [str(v) for v in value] if isinstance(value, tuple) else str(value)
+        record[field.name] = value
+    return record
+
+
+def load_result(record: dict) -> ConnectionResult:
+    values = {}
+    for name, value in record.items():
+        if (parse := _IP_FIELDS.get(name)) and value is not None:
+            value = tuple(map(parse, value)) if isinstance(value, list) else parse(value)
+        values[name] = value
+    return ConnectionResult(**values)
+
+
+def publish(uuid: str, digest: str, state: dict, result: ConnectionResult, daemon_pids: list[int]):
+    """Records that this process runs the connection `uuid`, with provider `state` for adopt() and `result`."""
+    daemons = []
+    for pid in daemon_pids:
+        try:
+            daemons.append({"pid": pid, "start_time": process_start_time(pid)})
+        except OSError:  # exited meanwhile, daemon_exited() follows
+            pass
+    pid = os.getpid()
+    record = {
+        "pid": pid,
+        "start_time": process_start_time(pid),
+        "digest": digest,
+        "state": state,
+        "result": dump_result(result),
+        "daemons": daemons,
+    }
+    path = _record_path(uuid)
+    path.parent.mkdir(mode=0o700, exist_ok=True)
+    tmp = path.with_suffix(f".{pid}.tmp")
+    tmp.write_text(json.dumps(record))
+    tmp.replace(path)
+
+
+def remove(uuid: str):
+    """Of a connection this process stopped or put on standby."""
+    path = _record_path(uuid)
+    try:
+        if json.loads(path.read_text())["pid"] != os.getpid():
+            return  # adopted by another process meanwhile
+        path.unlink()
+    except FileNotFoundError:
+        pass
+    except (OSError, ValueError, KeyError) as e:
+        logging.warning("Invalid runtime record of %s, removing it: %r", uuid, e)
+        path.unlink(missing_ok=True)
+
+
+def claim(uuid: str, digest: str) -> tuple[dict, ConnectionResult] | None:
+    """
+    Takes over the record of `uuid` left by a service process that is gone: (state for adopt(), last pushed result),
+    None if there is nothing to adopt. The daemons of a record with different settings are stopped.
+    """
+    if not (record := _take(uuid, _wait_for_owner_exit)):
+        return None
+    if record["digest"] != digest:
+        logging.info("Settings of %s changed, stopping the daemons left running", uuid)
+        _stop_daemons(uuid, record)
+        return None
+    try:
+        return record["state"], load_result(record["result"])
+    except (KeyError, TypeError, ValueError) as e:
+        logging.warning("Invalid runtime record of %s, stopping its daemons: %r", uuid, e)
+        _stop_daemons(uuid, record)
+        return None
+
+
+def sweep():
+    """Stops the daemons of the records nobody claimed within _ORPHAN_TIMEOUT_SEC after their process was gone."""
+    try:
+        paths = list(_records_dir().glob("*.json"))
+    except OSError:
+        return
+    for path in paths:
+        try:
+            if time.time() - path.stat().st_mtime < _ORPHAN_TIMEOUT_SEC:
+                continue
+        except FileNotFoundError:
+            continue
+        uuid = path.stem
+        if record := _take(uuid, _owner_exited):
+            logging.info("Nobody adopted the daemons of %s, stopping them", uuid)
+            _stop_daemons(uuid, record)
+
+
+def _take(uuid: str, owner_gone) -> dict | None:
+    """Reads and removes the record of `uuid` if `owner_gone(record)`; only one process gets it."""
+    path = _record_path(uuid)
+    try:
+        record = json.loads(path.read_text())
+        if record["pid"] == os.getpid() or not owner_gone(record):
+            return None
+        taken = path.with_suffix(f".{os.getpid()}.taken")
+        path.rename(taken)
+    except FileNotFoundError:
+        return None
+    except (OSError, ValueError, KeyError) as e:
+        logging.warning("Invalid runtime record of %s: %r", uuid, e)
+        return None
+    try:
+        return json.loads(taken.read_text())  # it may have been re-published between the read and the rename
+    except (OSError, ValueError) as e:
+        logging.warning("Invalid runtime record of %s: %r", uuid, e)
+        return None
+    finally:
+        taken.unlink(missing_ok=True)
+
+
+def _owner_exited(record: dict) -> bool:
+    try:
+        return process_start_time(record["pid"]) != record["start_time"]
+    except OSError:
+        return True
+
+
+def _wait_for_owner_exit(record: dict) -> bool:
+    """The owner may still be exiting, eg: NetworkManager activated the connection again on its bus name vanishing."""
+    pid = record["pid"]
+    try:
+        pidfd = os.pidfd_open(pid)
+    except ProcessLookupError:
+        return True
+    try:
+        if _owner_exited(record):
+            return True
+        if select.select([pidfd], [], [], _OWNER_EXIT_TIMEOUT_SEC)[0]:
+            return True
+        logging.warning("Service process %d still runs the connection, not adopting its daemons", pid)
+        return False
+    finally:
+        os.close(pidfd)
+
+
+def _stop_daemons(uuid: str, record: dict):
+    for daemon in record.get("daemons", ()):
+        try:
+            AdoptedProcess(daemon["pid"], daemon["start_time"], name=f"daemon of {uuid}").graceful_kill()
+        except (OSError, KeyError) as e:  # ProcessLookupError: exited already
+            logging.debug("Daemon %r of %s: %r", daemon, uuid, e)
@@ -0,0 +1,133 @@
+"""
+Resource controls of the provider daemons of a connection ("Resources" section of providers/*.json).
+
+With systemd, the daemons a connection starts are moved to the transient scope `nm-vpn-bundle-<connection uuid>.scope`
+(StartTransientUnit(), AttachProcessesToUnit() for the next ones), with CPU, memory, IO and tasks accounting on and
+the configured AllowedCPUs=, CPUWeight=, MemoryMax= and IOWeight=. The metrics read the accounting from its cgroup.
+A scope has no Nice= or CPUAffinity=: the nice value is set with setpriority() on the threads of each daemon. Without
+systemd (or if the scope cannot be created), the CPU placement falls back to sched_setaffinity() the same way.
+"""
+
+import logging
+import os
+import re
+from dataclasses import dataclass
+
+from .utils import getter
+
+UNIT_PREFIX = "nm-vpn-bundle-"
+_SYSTEMD = "org.freedesktop.systemd1"
+_MEMORY_SIZE = re.compile(r"^([0-9]+)([KMGT]?)$")
+
+
+def parse_cpu_list(s: str) -> set[int]:
+    """ "0-3,8" -> {0, 1, 2, 3, 8}"""
+    cpus = set()
+    for part in filter(None, (p.strip() for p in s.split(","))):
+        first, _, last = part.partition("-")
+        cpus.update(range(int(first), int(last or first) + 1))
+    return cpus
+
+
+def parse_memory_size(s: str) -> int:
+    """ "512M" -> bytes"""
+    if not (m := _MEMORY_SIZE.match(s.strip().upper())):
+        raise ValueError(f"invalid memory size {s!r}")
+    return int(m[1]) << (10 * " KMGT".index(m[2] or " "))
+
+
+@dataclass(frozen=True)
+class ResourceControls:
+    cpus: frozenset[int] = frozenset()
+    nice: int = 0
+    cpu_weight: int = 0  # 0: not set, like the others
+    memory_max: int = 0
+    io_weight: int = 0
+
+    @staticmethod
+    def from_vpn_data(vpn_data: dict[str, str]) -> "ResourceControls":
+        vpn_data_get = getter(vpn_data)
+        memory_max = vpn_data_get("memory-max", "").strip()
+        return ResourceControls(
+            cpus=frozenset(parse_cpu_list(vpn_data_get("cpu-affinity", ""))),
+            nice=int(vpn_data_get("nice", 0)),
+            cpu_weight=int(vpn_data_get("cpu-weight", 0)),
+            memory_max=parse_memory_size(memory_max) if memory_max else 0,
+            io_weight=int(vpn_data_get("io-weight", 0)),
+        )
+
+
+class ConnectionScope:
+    """Where the daemons of connection `uuid` run, see Subprocess(scope=)."""
+
+    def __init__(self, uuid: str, vpn_data: dict[str, str], bus=None) -> None:
+        self.uuid = uuid
+        self.unit = f"{UNIT_PREFIX}{uuid}.scope"
+        self.controls = ResourceControls.from_vpn_data(vpn_data)
+        # the system instance of systemd, as root only
+        self._bus = bus if bus is not None and os.getuid() == 0 else None
+
+    def attach(self, pid: int):
+        """Places the just started daemon `pid` in the scope. Failures are logged, the daemon runs unconstrained."""
+        scoped = False
+        if self._bus:
+            try:
+                scoped = self._attach_to_unit(pid)
+            except Exception as e:  # eg: no systemd
+                logging.warning("Could not place %d in %s, using sched_setaffinity(): %r", pid, self.unit, e)
+        try:
+            for tid in map(int, os.listdir(f"/proc/{pid}/task")):
+                if self.controls.cpus and not scoped:
+                    os.sched_setaffinity(tid, self.controls.cpus)
+                if self.controls.nice:
+                    os.setpriority(os.PRIO_PROCESS, tid, self.controls.nice)
+        except OSError as e:  # eg: it exited already
+            logging.warning("Could not set the CPU affinity or nice value of %d: %r", pid, e)
+
+    def _attach_to_unit(self, pid: int) -> bool:
+        systemd = self._bus.get(_SYSTEMD)
+        try:
+            systemd.StartTransientUnit(self.unit, "fail", self._unit_properties(pid), [])
+            logging.info("Started %s for %d: %s", self.unit, pid, self.controls)
+        except Exception as e:
+            if "UnitExists" not in str(e):
+                raise
+            # another daemon of the connection started it
+            systemd.AttachProcessesToUnit(self.unit, "", [pid])
+            logging.info("Attached %d to %s", pid, self.unit)
+        return True
+
+    def _unit_properties(self, pid: int):
+        from pydbus import Variant
+
+        c = self.controls
+        properties = [
+            ("Description", Variant("s", f"Daemons of NetworkManager VPN connection {self.uuid}")),
+            ("PIDs", Variant("au", [pid])),
+            ("CollectMode", Variant("s", "inactive-or-failed")),
+            *(
+                (k, Variant("b", True))
+                for k in ("CPUAccounting", "MemoryAccounting", "IOAccounting", "TasksAccounting")
+            ),
+        ]
+        if c.cpus:
+            mask = bytearray(max(c.cpus) // 8 + 1)
+            for cpu in c.cpus:
+                mask[cpu // 8] |= 1 << (cpu % 8)
+            properties.append(("AllowedCPUs", Variant("ay", bytes(mask))))
+        for name, value in (("CPUWeight", c.cpu_weight), ("MemoryMax", c.memory_max), ("IOWeight", c.io_weight)):
+            if value:
+                properties.append((name, Variant("t", value)))
+        return properties
+
+
+def scope_cgroup(pid: int) -> str | None:
+    """cgroup v2 directory of the connection scope `pid` runs in, None if it is not in one."""
+    try:
+        with open(f"/proc/{pid}/cgroup") as f:
+            path = next((line[3:].strip() for line in f if line.startswith("0::")), None)
+    except OSError:
+        return None
+    if not path or not os.path.basename(path).startswith(UNIT_PREFIX):
+        return None
+    return f"/sys/fs/cgroup{path}"
@@ -1,19 +1,20 @@
 import argparse
 import enum
 import importlib
+import ipaddress
+import itertools
 import json
 import logging
 import os
 import signal
 import sys
 import threading
+import time
 from contextlib import suppress
-
-# import dbus
+from dataclasses import replace
 from pathlib import Path
-from typing import Any
+from typing import TYPE_CHECKING, Any, Callable
 
-from dbus.mainloop.glib import DBusGMainLoop
 from pydbus import Variant
 from pydbus.generic import signal as Signal
 
@@ -22,8 +23,39 @@ dir = Path(__file__).parent
 from gi.repository import GLib
 from pydbus import SessionBus, SystemBus
 
-from .common import ServiceBase, VPNConnectionConfiguration, VPNConnectionControlBase
-from .utils import ipv4_to_u32, ipv6_to_u8_slice, set_proc_name
+from . import (
+    hosttuning,
+    logs,
+    metrics,
+    reconfigure,
+    runtime,
+    standby,
+    supervisor,
+    tracing,
+)
+from .common import (
+    ConnectionResult,
+    ServiceBase,
+    VPNConnectionConfiguration,
+    VPNConnectionControlBase,
+)
+from .linger import LingerListener
+from .routes import aggregate_routes
+from .scope import ConnectionScope
+from .utils import (
+    CancelToken,
+    Subprocess,
+    get_iface_mtu,
+    getter,
+    ipv4_to_u32,
+    ipv6_to_u8_slice,
+    probe_path_mtu,
+    set_proc_name,
+)
+from .watcher import ConnectionWatcher
+
+if TYPE_CHECKING:
+    from .host import ServiceHost
 
 loop = GLib.MainLoop()
 
@@ -72,11 +104,195 @@ class NMVpnServiceState(enum.IntEnum):
     NM_VPN_SERVICE_STATE_STOPPED = 6
 
 
+# https://cgit.freedesktop.org/NetworkManager/NetworkManager/tree/libnm-core/nm-dbus-interface.h?id=ba6c2211e8f6aebc5e5b07b77ffee938593980a6
+# https://gitlab.freedesktop.org/NetworkManager/NetworkManager/-/blob/main/src/libnm-core-public/nm-vpn-dbus-interface.h
+def _general_config(result: ConnectionResult):
+    return {
+        ## VPN interface name (tun0, tap0, etc)
+        "tundev": Variant("s", result.dev),
+        ## Proxy PAC, string
+        # "pac": Variant("s", ""),
+        ## Login message
+        "banner": Variant("s", result.banner),
+        ## uint32  array of uint8: IP address of the public external VPN gateway (network byte order)
+        "gateway": Variant("u", ipv4_to_u32(result.gateway)) if result.gateway else None,
+        ## uint32: Maximum Transfer Unit that the VPN interface should use
+        "mtu": Variant("u", result.mtu) if result.mtu else None,
+        ## Has IP4 configuratio
+        "has-ip4": Variant("b", result.ipv4 is not None),
+        ## Has IP6 configuratio  boolean
+        "has-ip6": Variant("b", result.ipv6 is not None),
+        ## If %TRUE the VPN plugin can persist/reconnect the connection over link changes and VPN server dropouts.
+        "can-persist": Variant("b", result.can_persist),
+    }
+
+
+def _ip4_config(result: ConnectionResult, routes: list):
+    if not result.ipv4:
+        return None
+    return {
+        ## IP address of the internal gateway of the subnet the VPN interface is Fon, if the VPN uses subnet configuration (network byte order)
+        # "internal-gateway":  Variant("u", 0)
+        ## Internal IP address of the local VPN interface (network byte order) # XXX Workaround: WTF? why byteorder is not respected.
+        "address": Variant("u", ipv4_to_u32(result.ipv4.ip)),
+        ## uint32: IP prefix of the VPN interface; 1 - 32 inclusive
+        "prefix": Variant("u", result.ipv4.network.prefixlen),
+        ## IP addresses of DNS servers for the VPN (network byte order) Array<uint32>:
+        "dns": Variant("au", [ipv4_to_u32(i) for i in result.dns if i.version == 4]),
+        ## IP addresses of NBNS/WINS servers for the VPN (network byte order) Array<uint32>:
+        # "nbns": Variant("au", []),
+        ## uint32: Message Segment Size that the VPN interface should use
+        "mss": Variant("u", result.mtu - _TCP_IPV4_HEADERS) if result.mtu else None,
+        ## string: DNS domain name
+        # "domain": Variant("s", ""),
+        ## array of strings: DNS domain names
+        # "domains": Variant("as", []),
+        ## custom routes the client should apply, in the format used by nm_utils_ip4_routes_to/from_gvalue  (Array<(dest,prefix,next_hop,metric)>)
+        "routes": Variant(
+            "aau",
+            [[ipv4_to_u32(r.network_address), r.prefixlen, 0, 0] for r in routes if r.version == 4],
+        ),
+        ## whether the previous IP4 routing configuration should be preserved.
+        # "preserve-routes":  Variant("b", False)
+        ## prevent this VPN connection from ever getting the default route
+        "never-default": Variant("b", result.never_default_route),
+    }
+
+
+def _ip6_config(result: ConnectionResult, routes: list):
+    if not result.ipv6:
+        return None
+    return {
+        ## array of uint8: internal IP address of the local VPN interface (network byte order)
+        "address": Variant("ay", ipv6_to_u8_slice(result.ipv6.ip)),
+        ## uint32: prefix length of the VPN interface; 0 - 128 inclusive
+        "prefix": Variant("u", result.ipv6.network.prefixlen),
+        ## array of array of uint8: IP addresses of DNS servers for the VPN (network byte order)
+        "dns": Variant("aay", [ipv6_to_u8_slice(i) for i in result.dns if i.version == 6]),
+        ## custom routes the client should apply, in the format used by nm_utils_ip6_routes_to/from_gvalue  (Array<(dest,prefix,next_hop,metric)>)
+        "routes": Variant(
+            "a(ayuayu)",
+            [
+                (ipv6_to_u8_slice(r.network_address), r.prefixlen, ipv6_to_u8_slice(_IPV6_UNSPECIFIED), 0)
+                for r in routes
+                if r.version == 6
+            ],
+        ),
+        ## prevent this VPN connection from ever getting the default route
+        "never-default": Variant("b", result.never_default_route),
+    }
+
+
+_IPV6_UNSPECIFIED = ipaddress.IPv6Address("::")
+_TCP_IPV4_HEADERS = 40
+
+# vpn.data keys of the service itself, applied on a running connection with the provider's live_settings
+_SERVICE_LIVE_SETTINGS = frozenset({"max-routes", "linger-timeout", "warm-standby-timeout", "is-host-tuning"})
+
+
+def _fingerprint(config: dict[str, Variant]):
+    return {k: (v.get_type_string(), v.unpack()) for k, v in config.items() if v is not None}
+
+
+class _Phase(enum.Enum):
+    """
+    Lifecycle of the connection. It changes on the main loop only: the blocking provider calls run in the worker
+    thread of an _Attempt, whose outcome is handed back to the main loop.
+    """
+
+    IDLE = "idle"  # also with a daemon on warm standby
+    CONNECTING = "connecting"
+    CONNECTED = "connected"
+    RECONFIGURING = "reconfiguring"  # applying changed settings, the connection stays activated
+    STOPPING = "stopping"
+
+
+_TRANSITIONS = {
+    _Phase.IDLE: {_Phase.CONNECTING},
+    _Phase.CONNECTING: {_Phase.CONNECTING, _Phase.CONNECTED, _Phase.STOPPING},
+    _Phase.CONNECTED: {_Phase.RECONFIGURING, _Phase.STOPPING},
+    _Phase.RECONFIGURING: {_Phase.CONNECTED, _Phase.STOPPING},
+    _Phase.STOPPING: {_Phase.IDLE, _Phase.CONNECTING},
+}
+
+
+class _Attempt:
+    """
+    A connect, or a change of settings, running in a worker thread. Disconnect() or a newer connect cancel it: the
+    waits of the provider's start steps are interrupted, and the worker stops the daemons it started before it exits.
+    """
+
+    _ids = itertools.count(1)
+
+    def __init__(self, kind: str, ctl: VPNConnectionControlBase) -> None:
+        self.id = next(self._ids)
+        self.kind = kind
+        self.ctl = ctl
+        self.cancel = ctl.cancel = CancelToken()
+        self.start_us = tracing.now_us()
+        self.thread: threading.Thread = None
+        self.path_mtu: int = None  # see _probe_path_mtu()
+
+    def run(self, fn: Callable, *args):
+        self.thread = threading.Thread(target=fn, args=(self, *args), name=f"{self.kind}-{self.id}", daemon=True)
+        self.thread.start()
+
+    def __repr__(self) -> str:
+        return f"<{self.kind} attempt {self.id}>"
+
+
 class VpnDBUSService(ServiceBase):
-    def __init__(self, ctl_impl: type[VPNConnectionControlBase], state_home_dir: str) -> None:
-        self.ctl = ctl_impl(self, state_home_dir)
+    def __init__(
+        self, ctl_impl: type[VPNConnectionControlBase], state_home_dir: str, host: "ServiceHost" = None
+    ) -> None:
+        self._ctl_impl = ctl_impl
+        self._state_home_dir = state_home_dir
+        # serving one of its connections, see host.py; else this process serves one at a time
+        self._host = host
         self._state = NMVpnServiceState.NM_VPN_SERVICE_STATE_UNKNOWN
-        self._connect_lock = None
+        self._phase = _Phase.IDLE
+        self._attempt: _Attempt = None  # in progress
+        # (connection uuid, settings digest, standby state) of the daemon this process keeps on warm standby
+        self._standby: tuple[str, str, dict] = None
+        self._standby_timer: int = None
+        self._standby_lock = threading.Lock()
+        # see "linger-timeout": after Disconnect() the process stays registered to serve the next connect
+        self._linger_timer: int = None
+        self._linger_listener: LingerListener = None
+        self._take_bus_name: Callable[[str], None] = None
+        self._host_tuned: str = None  # connection uuid it holds host settings for, see hosttuning.py
+        self.metrics = metrics.ConnectionMetrics(self._metrics_connection)
+        self.bus = None  # to follow the settings of the active connection, see reconfigure.py
+        self._reset_session()
+
+    def enable_handoffs(self, provider: str, take_bus_name: Callable[[str], None]):
+        """While lingering, serve the activations NetworkManager starts new service processes for (see linger.py)."""
+        self._linger_listener = LingerListener(provider, self._on_handoff)
+        self._take_bus_name = take_bus_name
+
+    def _reset_session(self):
+        """State of one connect-disconnect session. A lingering process serves the next one from scratch."""
+        self.ctl = self._ctl_impl(self, self._state_home_dir)
+        self._watcher: ConnectionWatcher = None
+        # fingerprints of the last emitted Config/Ip4Config/Ip6Config, so that unchanged ones are not re-emitted
+        self._pushed: dict[str, dict] = {}
+        self._max_routes = 0
+        # (input routes, aggregated routes) of the last push; providers report the same routes on most refreshes
+        self._aggregated_routes: tuple[tuple, list] = ((), [])
+        self._connection_uuid: str = None
+        self._auth_prompted_us: int = None
+        self._warm_standby_sec = 0
+        self._linger_sec = 0
+        self._survive_restart = False  # see "is-survive-service-restart" and runtime.py
+        self._settings_digest: str = None
+        self._result: ConnectionResult = None  # as last pushed
+        self._connected_at: float = None
+        self._connection_name: str = None
+        self._vpn_data: dict[str, str] = None  # as running
+        self._path_mtu: int = None  # probed, see "pmtu-probe-host"
+        self._follower: reconfigure.ConnectionFollower = None
+        # latest settings passed to apply_settings() while reconfiguring, applied once that is done
+        self._pending_settings: VPNConnectionConfiguration = None
 
     def Connect(self, connection: VPNConnectionConfiguration):
         """Tells the plugin to connect. Interactive secrets requests (eg, emitting
@@ -94,99 +310,126 @@ class VpnDBUSService(ServiceBase):
             connection: Describes the connection to be established.
             details: Additional details about the Connect process.
         """
-        logging.info("ConnectInteractive() %r %r  | connect_lock=%s", connection, details, self._connect_lock)
-        if self._connect_lock:
-            raise RuntimeError("Aleady connecting!")
+        logging.info(
+            "ConnectInteractive() uuid=%s id=%r details=%r | phase=%s",
+            connection["connection"]["uuid"],
+            connection["connection"]["id"],
+            details,
+            self._phase.value,
+        )
+        _log_payload("ConnectInteractive", _without_secrets(connection))
+        if self._phase in (_Phase.CONNECTED, _Phase.RECONFIGURING):
+            raise RuntimeError("Aleady connected!")
+        self._cancel_linger()
+        if previous := self._attempt:
+            self._supersede(previous)
 
         connection_uuid = connection["connection"]["uuid"]
         connection_name = connection["connection"]["id"]
         vpn_data = connection["vpn"]["data"]
+        settings_digest = standby.settings_digest(self._ctl_impl.__name__, vpn_data)
+        standby_state = None
+        if taken := self._take_standby():
+            if taken[:2] == (connection_uuid, settings_digest):
+                standby_state = taken[2]
+            else:
+                logging.info("Stopping the daemon on standby for %s", taken[0])
+                self._stop_ctl()
+        if standby_state is None:
+            self._reset_session()
+        self._max_routes = int(getter(vpn_data)("max-routes", 0))
+        self._warm_standby_sec = int(getter(vpn_data)("warm-standby-timeout", 0))
+        self._linger_sec = int(getter(vpn_data)("linger-timeout", 0))
+        self._survive_restart = self.ctl.supports_adopt and vpn_data.get("is-survive-service-restart") == "true"
+        self._settings_digest = settings_digest
+        self._connection_uuid = connection_uuid
+        self._connection_name = connection_name
+        self._vpn_data = dict(vpn_data)
+        self._pushed = {}
+        tracing.begin(connection_uuid, "connect")
+
+        self._attempt = attempt = _Attempt("connect", self.ctl)
+        self._set_phase(_Phase.CONNECTING)
+        self._change_state(NMVpnServiceState.NM_VPN_SERVICE_STATE_STARTING)
+        attempt.run(
+            self._connect_worker, previous, standby_state, settings_digest, connection_uuid, connection_name, vpn_data
+        )
 
-        def _run():
-            self._connect_lock = True
-            try:
-                result = self.ctl.start(
-                    connection_uuid=connection_uuid, connection_name=connection_name, vpn_data=vpn_data
-                )
-                logging.info("Connection Control started: %s", result)
-                # https://cgit.freedesktop.org/NetworkManager/NetworkManager/tree/libnm-core/nm-dbus-interface.h?id=ba6c2211e8f6aebc5e5b07b77ffee938593980a6
-                # https://gitlab.freedesktop.org/NetworkManager/NetworkManager/-/blob/main/src/libnm-core-public/nm-vpn-dbus-interface.h
-                general_config = {
-                    ## VPN interface name (tun0, tap0, etc)
-                    "tundev": Variant("s", result.dev),
-                    ## Proxy PAC, string
-                    # "pac": Variant("s", ""),
-                    ## Login message
-                    "banner": Variant("s", result.banner),
-                    ## uint32  array of uint8: IP address of the public external VPN gateway (network byte order)
-                    "gateway": Variant("u", ipv4_to_u32(result.gateway)) if result.gateway else None,
-                    ## uint32: Maximum Transfer Unit that the VPN interface should use
-                    # "mtu": Variant("u", 1433),
-                    ## Has IP4 configuratio
-                    "has-ip4": Variant("b", result.ipv4 is not None),
-                    ## Has IP6 configuratio  boolean
-                    "has-ip6": Variant("b", result.ipv6 is not None),
-                    ## If %TRUE the VPN plugin can persist/reconnect the connection over link changes and VPN server dropouts.
-                    "can-persist": Variant("b", result.can_persist),
-                }
-                self.emit("Config", general_config)
-                if result.ipv4:
-                    ip4_config = {
-                        ## IP address of the internal gateway of the subnet the VPN interface is Fon, if the VPN uses subnet configuration (network byte order)
-                        # "internal-gateway":  Variant("u", 0)
-                        ## Internal IP address of the local VPN interface (network byte order) # XXX Workaround: WTF? why byteorder is not respected.
-                        "address": Variant("u", ipv4_to_u32(result.ipv4.ip)),
-                        ## uint32: IP prefix of the VPN interface; 1 - 32 inclusive
-                        "prefix": Variant("u", result.ipv4.network.prefixlen),
-                        ## IP addresses of DNS servers for the VPN (network byte order) Array<uint32>:
-                        "dns": Variant("au", [ipv4_to_u32(i) for i in result.dns if i.version == 4]),
-                        ## IP addresses of NBNS/WINS servers for the VPN (network byte order) Array<uint32>:
-                        # "nbns": Variant("au", []),
-                        ## uint32: Message Segment Size that the VPN interface should use
-                        # "mss": Variant("u", 0),
-                        ## string: DNS domain name
-                        # "domain": Variant("s", ""),
-                        ## array of strings: DNS domain names
-                        # "domains": Variant("as", []),
-                        ## custom routes the client should apply, in the format used by nm_utils_ip4_routes_to/from_gvalue  (Array<(dest,prefix,next_hop,metric)>)
-                        "routes": Variant(
-                            "aau",
-                            [
-                                [ipv4_to_u32(r.network_address), r.prefixlen, 0, 0]
-                                for r in result.routes
-                                if r.version == 4
-                            ],
-                        ),
-                        ## whether the previous IP4 routing configuration should be preserved.
-                        # "preserve-routes":  Variant("b", False)
-                        ## prevent this VPN connection from ever getting the default route
-                        "never-default": Variant("b", result.never_default_route),
-                    }
-                    self.emit("Ip4Config", ip4_config)
-                if result.ipv6:
-                    ip6_config = {
-                        ## array of uint8: internal IP address of the local VPN interface (network byte order)
-                        "address": Variant("ay", ipv6_to_u8_slice(result.ipv6.ip)),
-                        ## uint32: prefix length of the VPN interface; 0 - 128 inclusive
-                        "prefix": Variant("u", result.ipv6.network.prefixlen),
-                        ## array of array of uint8: IP addresses of DNS servers for the VPN (network byte order)
-                        "dns": Variant("aay", [ipv6_to_u8_slice(i) for i in result.dns if i.version == 6]),
-                        ## prevent this VPN connection from ever getting the default route
-                        "never-default": Variant("b", result.never_default_route),
-                    }
-                    self.emit("Ip6Config", ip6_config)
-                self._change_state(NMVpnServiceState.NM_VPN_SERVICE_STATE_STARTED)
-            except Exception as e:
-                logging.error(
-                    "ConnectInteractive is failed: %r. Stopping service", e, exc_info=not isinstance(e, (RuntimeError,))
-                )
-                self._stop()
-            finally:
-                self._connect_lock = False
+    def _supersede(self, previous: _Attempt):
+        """A connect while `previous` is still in progress, or being cancelled: that one is dropped."""
+        logging.info("Cancelling %r for a new connect", previous)
+        previous.cancel.cancel("superseded by a new connect")
+        if previous.cancel.completed:  # it started its daemons, _connected() was not called yet
+            self._stop_ctl(previous.ctl)
+        self._attempt = None
+        self._unfollow_settings()
+        self.metrics.stop_textfile()
+
+    def _connect_worker(
+        self,
+        attempt: _Attempt,
+        previous: _Attempt | None,
+        standby_state: dict | None,
+        settings_digest: str,
+        connection_uuid: str,
+        connection_name: str,
+        vpn_data: dict[str, str],
+    ):
+        """Starts (or resumes) the provider, then hands the outcome over to _connected() on the main loop."""
+        result = error = None
+        try:
+            if previous:
+                # cancelled, it is stopping the daemons it started
+                previous.thread.join()
+            attempt.cancel.raise_if_cancelled()
+            attempt.ctl.scope = ConnectionScope(connection_uuid, vpn_data, self.bus)
+            result = self._resume(
+                attempt.ctl, settings_digest, connection_uuid, connection_name, vpn_data, standby_state
+            )
+            if result is None:
+                with tracing.span("ctl.start", provider=type(attempt.ctl).__name__):
+                    result = attempt.ctl.start(
+                        connection_uuid=connection_uuid, connection_name=connection_name, vpn_data=vpn_data
+                    )
+            result = self._probe_path_mtu(attempt, result, vpn_data)
+            attempt.cancel.complete()
+        except Exception as e:
+            error = e
+            self._stop_ctl(attempt.ctl)
+        supervisor.call_soon(lambda: self._connected(attempt, result, error))
 
-        self._change_state(NMVpnServiceState.NM_VPN_SERVICE_STATE_STARTING)
-        # TODO: lock
-        threading.Thread(target=_run, daemon=True).start()
+    def _connected(self, attempt: _Attempt, result: ConnectionResult | None, error: Exception | None):
+        if attempt is not self._attempt:
+            logging.info("Dropping the outcome of superseded %r", attempt)
+            return
+        self._attempt = None
+        self._trace_auth_round_trip(answered=False)
+        if attempt.cancel.cancelled:
+            logging.info("%r cancelled: %s", attempt, attempt.cancel.reason)
+            self._stop()
+            self._idle(attempt.cancel.reason)
+        elif error:
+            logging.error(
+                "ConnectInteractive is failed: %r. Stopping service",
+                error,
+                exc_info=error if not isinstance(error, RuntimeError) else None,
+            )
+            self._stop()
+        else:
+            logging.info("Connection Control started: %s", result)
+            self._path_mtu = attempt.path_mtu
+            self._push_result(result)
+            self._set_phase(_Phase.CONNECTED)
+            self._change_state(NMVpnServiceState.NM_VPN_SERVICE_STATE_STARTED)
+            self._connected_at = time.monotonic()
+            self._publish_runtime()
+            self._tune_host(self._vpn_data)
+            self.metrics.start_textfile(self._connection_uuid)
+            self._start_watcher(result)
+            if self.bus:
+                self._follow_settings(self._connection_uuid)
+        tracing.record("connect", attempt.start_us, state=self._state.name)
+        tracing.end()
 
     def NeedSecrets(self, connection: VPNConnectionConfiguration) -> str:
         """Asks the plugin whether the provided connection will require secrets to
@@ -196,7 +439,8 @@ class VpnDBUSService(ServiceBase):
         Returns:
             setting_name: The setting name within the provided connection that requires secrets, if any.
         """
-        logging.info("NeedSecrets() %r", connection)
+        logging.info("NeedSecrets() uuid=%s", connection["connection"]["uuid"])
+        _log_payload("NeedSecrets", _without_secrets(connection))
         return ""
 
     def NewSecrets(self, connection: VPNConnectionConfiguration) -> None:
@@ -208,44 +452,491 @@ class VpnDBUSService(ServiceBase):
             connection: Describes the connection that may need secrets.
         """
 
-        logging.info("NewSecrets() %r", connection)
+        logging.info("NewSecrets() uuid=%s", connection["connection"]["uuid"])
+        _log_payload("NewSecrets", _without_secrets(connection))
+        self._trace_auth_round_trip(answered=True)
+        if self._phase == _Phase.CONNECTED:
+            self.apply_settings(connection)
 
     def Disconnect(self) -> None:
         """Disconnect the plugin."""
-        logging.info("Disconnect() | connect_lock: %s", self._connect_lock)
-        self._stop()
-        quit_loop("Disconnect()")
+        logging.info("Disconnect() | phase: %s", self._phase.value)
+        if self._attempt:
+            # interrupts its waits; the outcome handler of the attempt stops the connection, see _connected()
+            if self._attempt.cancel.cancel("Disconnect()") or self._phase != _Phase.STOPPING:
+                logging.info("Cancelled %r", self._attempt)
+                self._set_phase(_Phase.STOPPING)
+                self._change_state(NMVpnServiceState.NM_VPN_SERVICE_STATE_STOPPING)
+            return
+        if self._connection_uuid:
+            tracing.begin(self._connection_uuid, "disconnect")
+        on_standby = False
+        with tracing.span("disconnect"):
+            if self._warm_standby_sec > 0 and self.ctl.supports_standby and self._phase == _Phase.CONNECTED:
+                on_standby = self._put_on_standby()
+            else:
+                self._stop()
+        tracing.end()
+        if not on_standby:
+            self._idle("Disconnect()")
 
-    def _stop(self):
-        if self._state == NMVpnServiceState.NM_VPN_SERVICE_STATE_STOPPED:
+    def _idle(self, reason: str):
+        """Exits, or lingers for linger-timeout seconds to serve the next connect."""
+        if self._linger_timer:
             return
-        self._change_state(NMVpnServiceState.NM_VPN_SERVICE_STATE_STOPPING)
+        if self._linger_sec > 0 and not self._host:  # a host serves the next connects anyway
+            logging.info("%s: lingering for %ds", reason, self._linger_sec)
+            self._linger_timer = GLib.timeout_add_seconds(self._linger_sec, self._linger_expired)
+            if self._linger_listener:
+                self._linger_listener.listen()
+        else:
+            self._exit(reason)
+
+    def _exit(self, reason: str):
+        if self._host:
+            self._host.close_session(self, reason)
+        else:
+            quit_loop(reason)
+
+    def _linger_expired(self):
+        self._linger_timer = None
+        if self._linger_listener:
+            self._linger_listener.close()
+        self._exit("idle timeout")
+        return False
+
+    def _cancel_linger(self):
+        if self._linger_timer:
+            GLib.source_remove(self._linger_timer)
+            self._linger_timer = None
+        if self._linger_listener:
+            self._linger_listener.close()
+
+    def _on_handoff(self, bus_name: str) -> bool:
+        if not self._linger_timer:
+            return False
+        logging.info("Taking over bus name %s", bus_name)
+        self._take_bus_name(bus_name)
+        # until NetworkManager connects through the new name
+        GLib.source_remove(self._linger_timer)
+        self._linger_timer = GLib.timeout_add_seconds(self._linger_sec, self._linger_expired)
+        self._change_state(NMVpnServiceState.NM_VPN_SERVICE_STATE_INIT)
+        return True
+
+    def daemon_exited(self, proc):
+        """A provider daemon exited without being asked to. A connect in progress notices it by itself."""
+        if proc.stopping:
+            return
+        if self._phase == _Phase.CONNECTED:
+            logging.error("%r exited, the connection is gone", proc)
+            self._stop()
+            self._idle(f"{proc.name} exited")
+        elif taken := self._take_standby():
+            logging.warning("%r on standby for %s exited", proc, taken[0])
+            self._stop_ctl()
+            self._idle(f"{proc.name} exited")
+
+    def _stop(self, stop_ctl=True):
+        if self._phase == _Phase.IDLE:
+            return
+        if self._phase != _Phase.STOPPING:
+            self._set_phase(_Phase.STOPPING)
+            self._change_state(NMVpnServiceState.NM_VPN_SERVICE_STATE_STOPPING)
+        self._unfollow_settings()
+        self._stop_watcher()
+        self.metrics.stop_textfile()
+        if stop_ctl:
+            self._stop_ctl()
+        self._unpublish_runtime()
+        self._untune_host()
+        self._set_phase(_Phase.IDLE)
+        self._change_state(NMVpnServiceState.NM_VPN_SERVICE_STATE_STOPPED)
+
+    def _stop_ctl(self, ctl: VPNConnectionControlBase = None):
         try:
-            self.ctl.stop()
+            with tracing.span("ctl.stop"):
+                (ctl or self.ctl).stop()
         except Exception as e:
             logging.exception("stop() failed: %r", e)
+
+    def _put_on_standby(self) -> bool:
+        """Takes the data path down but keeps the provider daemon for warm-standby-timeout seconds."""
+        if self._phase != _Phase.CONNECTED:
+            self._stop()
+            return False
+        self._set_phase(_Phase.STOPPING)
+        self._change_state(NMVpnServiceState.NM_VPN_SERVICE_STATE_STOPPING)
+        self._unfollow_settings()
+        self._stop_watcher()
+        self.metrics.stop_textfile()
+        self._unpublish_runtime()
+        self._untune_host()
+        try:
+            with tracing.span("ctl.standby"):
+                state = self.ctl.standby()
+            if not self._host:  # claimed by the other sessions of the host only, see hand_over_standby()
+                standby.publish(self._connection_uuid, self._settings_digest, state)
+        except Exception as e:
+            logging.exception("standby() failed, stopping: %r", e)
+            self._stop_ctl()
+            self._set_phase(_Phase.IDLE)
+            self._change_state(NMVpnServiceState.NM_VPN_SERVICE_STATE_STOPPED)
+            return False
+        with self._standby_lock:
+            self._standby = (self._connection_uuid, self._settings_digest, state)
+            self._standby_timer = GLib.timeout_add_seconds(self._warm_standby_sec, self._standby_expired)
+        logging.info("Connection %s is on warm standby for %ds", self._connection_uuid, self._warm_standby_sec)
+        self._set_phase(_Phase.IDLE)
         self._change_state(NMVpnServiceState.NM_VPN_SERVICE_STATE_STOPPED)
+        return True
+
+    def _take_standby(self):
+        with self._standby_lock:
+            taken, self._standby = self._standby, None
+            if taken:
+                GLib.source_remove(self._standby_timer)
+                standby.remove(taken[0])
+        return taken
+
+    def _resume(
+        self,
+        ctl: VPNConnectionControlBase,
+        settings_digest: str,
+        connection_uuid: str,
+        connection_name: str,
+        vpn_data: dict[str, str],
+        state: dict | None,
+    ):
+        """
+        Result of resuming a daemon on warm standby, held by this (`state`) or another service process, or of
+        adopting the daemon a gone service process left running. None if there is none.
+        """
+        if state is None and ctl.supports_standby:
+            with tracing.span("standby claim"):
+                if self._host:
+                    state = self._host.claim_standby(connection_uuid, settings_digest)
+                else:
+                    state = standby.claim(connection_uuid, settings_digest)
+        if state is None and ctl.supports_adopt:
+            with tracing.span("runtime claim"):
+                claimed = runtime.claim(connection_uuid, settings_digest)
+            if claimed:
+                return self._adopt(ctl, connection_uuid, connection_name, vpn_data, *claimed)
+        if state is None:
+            return None
+        try:
+            with tracing.span("ctl.resume", provider=type(ctl).__name__):
+                return ctl.resume(
+                    state, connection_uuid=connection_uuid, connection_name=connection_name, vpn_data=vpn_data
+                )
+        except Exception as e:
+            if ctl.cancel.cancelled:
+                raise
+            logging.warning("Could not resume the daemon on standby, starting a new one: %r", e)
+            self._stop_ctl(ctl)
+            return None
+
+    def _adopt(
+        self,
+        ctl: VPNConnectionControlBase,
+        connection_uuid: str,
+        connection_name: str,
+        vpn_data: dict[str, str],
+        state: dict,
+        last_result: ConnectionResult,
+    ):
+        """Result of adopting the daemon left running, None if it is not usable: a new one is started."""
+        try:
+            with tracing.span("ctl.adopt", provider=type(ctl).__name__):
+                ctl.adopt(state, connection_uuid=connection_uuid, connection_name=connection_name, vpn_data=vpn_data)
+                if (result := ctl.refresh(last_result)) is None:
+                    raise RuntimeError("its state could not be determined")
+        except Exception as e:
+            if ctl.cancel.cancelled:
+                raise
+            logging.warning("Could not adopt the daemon left running, starting a new one: %r", e)
+            self._stop_ctl(ctl)
+            return None
+        logging.info("Adopted the daemon left running for %s: %s", connection_uuid, ctl.daemon_pids())
+        return result
+
+    def _standby_expired(self):
+        if taken := self._take_standby():
+            logging.info("Warm standby of %s expired", taken[0])
+            self._stop_ctl()
+            self._idle("warm standby expired")
+        return False
+
+    def release_standby(self):
+        """Leaves the daemon on standby running for the service process that claimed it, and exits."""
+        if taken := self._take_standby():
+            self.ctl.release()
+            standby.publish(*taken, released=True)
+            self._exit("standby released")
+
+    def hand_over_standby(self, uuid: str, digest: str) -> dict | None:
+        """
+        For the connect worker of another session of the service host: the standby state of the daemon of `uuid`
+        held by this one, to resume() it there. A daemon with other settings is stopped. This session then ends.
+        """
+        with self._standby_lock:
+            if not self._standby or self._standby[0] != uuid:
+                return None
+        if not (taken := self._take_standby()):
+            return None
+        state = None
+        if taken[1] == digest:
+            logging.info("Handing the daemon on standby for %s over", uuid)
+            self.ctl.release()
+            state = taken[2]
+        else:
+            logging.info("Stopping the daemon on standby for %s, its settings changed", uuid)
+            self._stop_ctl()
+        supervisor.call_soon(lambda: self._idle("standby handed over"))
+        return state
+
+    def apply_settings(self, connection: VPNConnectionConfiguration) -> str:
+        """Applies changed settings of the running connection: live, or by restarting the provider daemon."""
+        if connection["connection"]["uuid"] == self._connection_uuid and self._phase == _Phase.RECONFIGURING:
+            self._pending_settings = connection
+            return "pending"
+        if self._phase != _Phase.CONNECTED or connection["connection"]["uuid"] != self._connection_uuid:
+            raise RuntimeError("Not connected to this connection")
+        vpn_data = dict(connection["vpn"]["data"])
+        if not (changed := reconfigure.diff(self._vpn_data, vpn_data)):
+            return "unchanged"
+        live = changed.keys() <= self.ctl.live_settings | _SERVICE_LIVE_SETTINGS
+        logging.info("Settings changed: %s, %s", sorted(changed), "applying them live" if live else "restarting")
+        # refreshes are pointless meanwhile, it is started again with the outcome
+        self._stop_watcher()
+        self._attempt = attempt = _Attempt("reconfigure", self.ctl)
+        self._set_phase(_Phase.RECONFIGURING)
+        attempt.run(
+            self._reconfigure_worker,
+            changed,
+            vpn_data,
+            live,
+            self._result,
+            self._connection_uuid,
+            self._connection_name,
+        )
+        return "applying" if live else "restarting"
+
+    def _reconfigure_worker(
+        self,
+        attempt: _Attempt,
+        changed: dict[str, str | None],
+        vpn_data: dict[str, str],
+        live: bool,
+        current: ConnectionResult | None,
+        connection_uuid: str,
+        connection_name: str,
+    ):
+        """Applies the settings with the running provider or a new one, then hands it over to _reconfigured()."""
+        ctl, result, error = attempt.ctl, None, None
+        try:
+            if live and (provider_changed := {k: v for k, v in changed.items() if k not in _SERVICE_LIVE_SETTINGS}):
+                try:
+                    live = ctl.apply_settings(provider_changed, vpn_data)
+                except Exception as e:
+                    logging.warning("Could not apply the settings live, restarting: %r", e)
+                    live = False
+            if live:
+                result = current and ctl.refresh(current)
+            else:
+                self._stop_ctl(ctl)
+                ctl = None
+                ctl = attempt.ctl = self._ctl_impl(self, self._state_home_dir)
+                ctl.cancel = attempt.cancel
+                ctl.scope = ConnectionScope(connection_uuid, vpn_data, self.bus)
+                result = ctl.start(connection_uuid=connection_uuid, connection_name=connection_name, vpn_data=vpn_data)
+                result = self._probe_path_mtu(attempt, result, vpn_data)
+            attempt.cancel.complete()
+        except Exception as e:
+            error = e
+            if ctl:
+                self._stop_ctl(ctl)
+        supervisor.call_soon(lambda: self._reconfigured(attempt, vpn_data, result, error))
+
+    def _reconfigured(
+        self,
+        attempt: _Attempt,
+        vpn_data: dict[str, str],
+        result: ConnectionResult | None,
+        error: Exception | None,
+    ):
+        """Outcome of a settings change, on the main loop. `attempt.ctl` is the provider started with them."""
+        if attempt is not self._attempt:
+            return
+        self._attempt = None
+        pending, self._pending_settings = self._pending_settings, None
+        if attempt.cancel.cancelled or error:
+            if attempt.cancel.cancelled:
+                logging.info("%r cancelled: %s", attempt, attempt.cancel.reason)
+            else:
+                logging.error(
+                    "Could not apply the settings, stopping: %r",
+                    error,
+                    exc_info=error if not isinstance(error, RuntimeError) else None,
+                )
+            # the worker stopped the previous provider if it restarted it, and the one it ran into the error
+            self.ctl = attempt.ctl
+            self._stop(stop_ctl=not error)
+            self._idle(attempt.cancel.reason or "settings not applied")
+            return
+        if attempt.ctl is not self.ctl:  # restarted
+            self._path_mtu = attempt.path_mtu
+        self.ctl = attempt.ctl
+        self._max_routes = int(getter(vpn_data)("max-routes", 0))
+        self._linger_sec = int(getter(vpn_data)("linger-timeout", 0))
+        self._warm_standby_sec = int(getter(vpn_data)("warm-standby-timeout", 0))
+        self._aggregated_routes = ((), [])
+        self._vpn_data = vpn_data
+        self._settings_digest = standby.settings_digest(self._ctl_impl.__name__, vpn_data)
+        self._tune_host(vpn_data)
+        self._set_phase(_Phase.CONNECTED)
+        if result:
+            self._push_result(result)
+        if not (survive_restart := self.ctl.supports_adopt and vpn_data.get("is-survive-service-restart") == "true"):
+            self._unpublish_runtime()
+        self._survive_restart = survive_restart
+        self._publish_runtime()
+        self._start_watcher(self._result)
+        logging.info("Settings applied")
+        if pending:
+            try:
+                self.apply_settings(pending)
+            except Exception as e:
+                logging.warning("Settings updated meanwhile not applied: %r", e)
+
+    def _probe_path_mtu(self, attempt: _Attempt, result: ConnectionResult, vpn_data: dict[str, str]):
+        """With "pmtu-probe-host" set, lowers the MTU of `result` to the path MTU to that host over the tunnel."""
+        host = getter(vpn_data)("pmtu-probe-host")
+        device_mtu = result.mtu or (result.dev and get_iface_mtu(result.dev))
+        if not host or not device_mtu:
+            return result
+        with tracing.span("pmtu probe", host=host):
+            attempt.path_mtu = probe_path_mtu(host, result.dev, device_mtu, cancel=attempt.cancel)
+        if attempt.path_mtu is None:
+            logging.warning("Path MTU probe: no reply from %s over %s, keeping MTU %d", host, result.dev, device_mtu)
+            return result
+        logging.info("Path MTU to %s: %d (%s MTU: %d)", host, attempt.path_mtu, result.dev, device_mtu)
+        return replace(result, mtu=attempt.path_mtu)
+
+    def _publish_runtime(self):
+        """Keeps the runtime record of the connection up to date, see runtime.py."""
+        if not self._survive_restart or self._phase != _Phase.CONNECTED:
+            return
+        try:
+            runtime.publish(
+                self._connection_uuid,
+                self._settings_digest,
+                self.ctl.runtime_state(),
+                self._result,
+                self.ctl.daemon_pids(),
+            )
+        except Exception as e:
+            logging.exception("Could not write the runtime record: %r", e)
+
+    def _unpublish_runtime(self):
+        if self._survive_restart:
+            runtime.remove(self._connection_uuid)
+
+    def _tune_host(self, vpn_data: dict[str, str]):
+        """Applies (or re-applies, for changed settings) the host settings of "is-host-tuning"."""
+        if vpn_data.get("is-host-tuning", "false") != "true":
+            self._untune_host()
+            return
+        try:
+            hosttuning.acquire(self._connection_uuid, vpn_data)
+            self._host_tuned = self._connection_uuid
+        except Exception as e:
+            logging.exception("Host tuning failed: %r", e)
+
+    def _untune_host(self):
+        if not (uuid := self._host_tuned):
+            return
+        self._host_tuned = None
+        try:
+            hosttuning.release(uuid)
+        except Exception as e:
+            logging.exception("Could not restore the host settings: %r", e)
+
+    def _start_watcher(self, result: ConnectionResult):
+        watcher = (self._host.watchers.watcher if self._host else ConnectionWatcher)(
+            self.ctl, result, lambda r: supervisor.call_soon(lambda: self._refreshed(watcher, r))
+        )
+        self._watcher = watcher
+        watcher.start()
+
+    def _refreshed(self, watcher: ConnectionWatcher, result: ConnectionResult):
+        """A refresh of the watcher's thread, on the main loop."""
+        if watcher is self._watcher and self._push_result(result):
+            self._publish_runtime()
+
+    def _stop_watcher(self):
+        if self._watcher:
+            self._watcher.stop()
+            self._watcher = None
+
+    def _follow_settings(self, connection_uuid: str):
+        def on_updated(settings: dict):
+            if settings.get("vpn", {}).get("data") is None:
+                return
+            try:
+                self.apply_settings(settings)
+            except Exception as e:
+                logging.warning("Updated settings of %s not applied: %r", connection_uuid, e)
+
+        if self._phase == _Phase.CONNECTED and not self._follower:
+            self._follower = reconfigure.ConnectionFollower(self.bus, connection_uuid, on_updated)
+
+    def _unfollow_settings(self):
+        if self._follower:
+            self._follower.close()
+            self._follower = None
+
+    def shutdown(self):
+        self._cancel_linger()
+        self.metrics.stop_textfile()
+        if attempt := self._attempt:
+            # its worker stops the daemons it started
+            attempt.cancel.cancel("shutdown")
+            attempt.thread.join(Subprocess.DEFAULT_GRACEFUL_EXIT_TIMEOUT + 1)
+        if taken := self._take_standby():
+            logging.info("Stopping the daemon on standby for %s", taken[0])
+            self._stop_ctl()
+        if self._phase == _Phase.CONNECTED and self._survive_restart:
+            logging.info("Leaving the daemon of %s running for the next service process", self._connection_uuid)
+            self._stop_watcher()
+            self.ctl.release()
+            # its holder is dropped once this process is gone, the adopting one acquires the settings again
+            self._host_tuned = None
+        self._untune_host()
 
     def SetConfig(self, config: dict[str, Any]) -> None:
         """Set generic connection details on the connection.
         Args:
             config: in_type="a{sv} Generic configuration details for the connection.
         """
-        logging.info("SetConfig() %r", config)
+        logging.info("SetConfig()")
+        _log_payload("SetConfig", config)
 
     def SetIp4Config(self, config: dict[str, Any]) -> None:
         """Set IPv4 details on the connection
         Args:
             config: Ip4Config details for the connection. You must call SetConfig() before calling this.
         """
-        logging.info("SetIp4Config() %r", config)
+        logging.info("SetIp4Config()")
+        _log_payload("SetIp4Config", config)
 
     def SetIp6Config(self, config: dict[str, Any]) -> None:
         """Set IPv6 details on the connection.
         Args:
             config: Ip6Config details for the connection. You must call SetConfig() before calling this.
         """
-        logging.info("SetIp6Config() %r", config)
+        logging.info("SetIp6Config()")
+        _log_payload("SetIp6Config", config)
 
     def SetFailure(self, reason: str) -> None:
         """Indicate a failure to the plugin.
@@ -295,17 +986,108 @@ class VpnDBUSService(ServiceBase):
     Failure = Signal()  # type="u"
 
     def emit(self, signal_name: str, value, *args):
-        logging.info("Emitting signal %s: %r : %r", signal_name, value, args)
+        logging.info("Emitting signal %s", signal_name)
+        _log_payload(f"signal {signal_name}", (value, args))
         if isinstance(value, dict):
             value = {k: v for k, v in value.items() if v is not None}
         if isinstance(value, (list, tuple)):
             value = [v for v in value if v is not None]
         getattr(self, signal_name).emit(value, *args)
 
+    def _push_result(self, result: ConnectionResult) -> bool:
+        """Emits the configs derived from `result` which differ from what NetworkManager was last told, if any."""
+        if self._path_mtu and (not result.mtu or result.mtu > self._path_mtu):
+            result = replace(result, mtu=self._path_mtu)
+        self._result = result
+        routes = self._aggregate_routes(result.routes)
+        emitted = False
+        for signal_name, config in (
+            ("Config", _general_config(result)),
+            ("Ip4Config", _ip4_config(result, routes)),
+            ("Ip6Config", _ip6_config(result, routes)),
+        ):
+            if config is None:
+                continue
+            fingerprint = _fingerprint(config)
+            if self._pushed.get(signal_name) == fingerprint:
+                continue
+            self.emit(signal_name, config)
+            self._pushed[signal_name] = fingerprint
+            emitted = True
+        return emitted
+
+    def announce_device(self, dev: str, *, has_ipv4: bool, has_ipv6: bool):
+        """
+        Emits Config ahead of the connect result, so that NetworkManager takes the device over while the provider
+        is still waiting for its addresses. The has-ip4/has-ip6 predicted here must hold: NetworkManager waits for
+        the Ip4Config/Ip6Config they announce. _push_result() re-emits Config only if the final one differs.
+        Called from the worker of an attempt, emitted on the main loop.
+        """
+        attempt = self._attempt
+        if not attempt or attempt.thread is not threading.current_thread():
+            return
+        config = _general_config(ConnectionResult(dev=dev))
+        config["has-ip4"] = Variant("b", has_ipv4)
+        config["has-ip6"] = Variant("b", has_ipv6)
+
+        def _emit():
+            if attempt is not self._attempt or attempt.cancel.cancelled:
+                return
+            with tracing.span("announce device", dev=dev):
+                self.emit("Config", config)
+            self._pushed["Config"] = _fingerprint(config)
+
+        supervisor.call_soon(_emit)
+
+    def _metrics_connection(self):
+        if self._state != NMVpnServiceState.NM_VPN_SERVICE_STATE_STARTED or not self._result:
+            return None
+        return self._connection_uuid, self._result.dev, self._connected_at, self.ctl.daemon_pids()
+
+    def _aggregate_routes(self, routes) -> list:
+        key = tuple(routes)
+        cached_key, aggregated = self._aggregated_routes
+        if key == cached_key:
+            return aggregated
+        started_at = time.monotonic()
+        aggregated = aggregate_routes(routes, max_routes=self._max_routes)
+        logging.info(
+            "Aggregated %d routes into %d (max-routes=%d) in %.1fms",
+            len(key),
+            len(aggregated),
+            self._max_routes,
+            (time.monotonic() - started_at) * 1000,
+        )
+        if self._max_routes and max(sum(r.version == v for r in aggregated) for v in (4, 6)) > self._max_routes:
+            logging.warning("Could not summarize routes down to max-routes=%d", self._max_routes)
+        self._aggregated_routes = (key, aggregated)
+        return aggregated
+
     def prompt_auth(self, prompt: dict, *items: str):
         message = json.dumps(prompt, separators=(",", ":"))
         logging.info("prompt_auth() prompt=%r items=%r", prompt, items)
-        self.SecretsRequired.emit(message, items)
+        attempt = self._attempt
+
+        def _emit():  # on the main loop
+            if attempt is not self._attempt or (attempt and attempt.cancel.cancelled):
+                return
+            with tracing.span("prompt_auth", auth_type=prompt.get("auth_type")):
+                self.SecretsRequired.emit(message, items)
+            self._auth_prompted_us = self._auth_prompted_us or tracing.now_us()
+
+        supervisor.call_soon(_emit)
+
+    def _trace_auth_round_trip(self, answered: bool):
+        """From the first SecretsRequired to NewSecrets(): NetworkManager, its secret agent and the auth dialog."""
+        if self._auth_prompted_us:
+            tracing.record("auth round-trip", self._auth_prompted_us, answered=answered)
+            self._auth_prompted_us = None
+
+    def _set_phase(self, phase: _Phase):
+        if phase not in _TRANSITIONS[self._phase]:
+            raise RuntimeError(f"Invalid phase transition: {self._phase.value} -> {phase.value}")
+        logging.info("phase %s -> %s", self._phase.value, phase.value)
+        self._phase = phase
 
     def _change_state(self, state: NMVpnServiceState):
         logging.info("change_state() %r -> %r", self._state, state)
@@ -325,28 +1107,65 @@ class VpnDBUSService(ServiceBase):
 VpnDBUSService.__doc__ = (dir / "nm-vpn-plugin.xml").read_text()
 
 
+def _without_secrets(connection: VPNConnectionConfiguration):
+    vpn = connection.get("vpn", {})
+    return {**connection, "vpn": {**vpn, "secrets": {k: "***" for k in vpn.get("secrets", {})}}}
+
+
+def _log_payload(what: str, payload):
+    """Payloads are dumped at INFO once a minute per kind, at DEBUG otherwise."""
+    level = logging.INFO if logs.sampled(what) else logging.DEBUG
+    if logging.getLogger().isEnabledFor(level):
+        logging.log(level, "%s payload: %r", what, payload)
+
+
 def quit_loop(reason):
     logging.info("Quit Glib main loop. Reason= %s", reason)
     loop.quit()
 
 
-def main():
-    parser = argparse.ArgumentParser()
-    parser.add_argument("--provider", required=True)
-    parser.add_argument("--bus-name", required=False)
-    parser.add_argument("--state-home-dir", required=False)
-    dbus_object_path = "/org/freedesktop/NetworkManager/VPN/Plugin"
-    args, unknown_args = parser.parse_known_args()
+def _report_startup(launch_us: int, phases: list[tuple[str, int]], **args):
+    """Logs (and traces) the time spent in each startup phase: [(phase, end time)], in order, from `launch_us`."""
+    durations = []
+    start_us = launch_us
+    for name, end_us in phases:
+        durations.append((name, end_us - start_us))
+        tracing.record(f"startup: {name}", start_us, end_us, **args)
+        start_us = end_us
+    tracing.record("service startup", launch_us, start_us, **args)
+    logging.info(
+        "Startup: total=%.1fms %s",
+        (start_us - launch_us) / 1000,
+        " ".join(f"[{name}]={us / 1000:.1f}ms" for name, us in durations),
+    )
 
-    provider = args.provider
-    dbus_service_type = f"org.freedesktop.NetworkManager.{provider}"
 
-    dbus_bus_name = args.bus_name or dbus_service_type
+DBUS_OBJECT_PATH = "/org/freedesktop/NetworkManager/VPN/Plugin"
 
-    state_home_dir = args.state_home_dir
-    if not state_home_dir:
-        state_home_dir = f"/etc/NetworkManager/{dbus_service_type}"
 
+def load_ctl_class(provider: str) -> type[VPNConnectionControlBase]:
+    return next(
+        c
+        for c in vars(importlib.import_module(f"{__package__}.{provider}_ctl")).values()
+        if isinstance(c, type) and c is not VPNConnectionControlBase and issubclass(c, VPNConnectionControlBase)
+    )
+
+
+def default_state_home_dir(provider: str):
+    return f"/etc/NetworkManager/org.freedesktop.NetworkManager.{provider}"
+
+
+def register(bus, service: VpnDBUSService) -> list:
+    """Exports `service` and its companion interfaces on `bus`. Returns the registrations, to unregister in order."""
+    return [
+        bus.register_object(DBUS_OBJECT_PATH, service, None),
+        bus.register_object(DBUS_OBJECT_PATH, logs.Diagnostics(), logs.INTERFACE_XML),
+        bus.register_object(DBUS_OBJECT_PATH, service.metrics, metrics.INTERFACE_XML),
+        bus.register_object(DBUS_OBJECT_PATH, reconfigure.Settings(service.apply_settings), reconfigure.INTERFACE_XML),
+    ]
+
+
+def _setup_logging(name: str):
     log_level = logging.INFO
     if os.environ.get("VPN_BUNDLE_DEV_MODE", "").lower() in ("true", "1"):
         log_level = logging.DEBUG
@@ -355,8 +1174,8 @@ def main():
             log_level = logging.DEBUG
 
     with suppress(Exception):
-        set_proc_name(f"NM:{provider}")
-    log_format = f"{provider}(%(filename)s) %(levelname)s: %(message)s"
+        set_proc_name(f"NM:{name}")
+    log_format = f"{name}(%(filename)s) %(levelname)s: %(message)s"
     if os.environ.get("NM_VPN_LOG_SYSLOG") == "1":
         from logging.handlers import SysLogHandler
 
@@ -364,20 +1183,97 @@ def main():
     else:
         log_format = "%(asctime)s " + log_format
         log_handler = logging.StreamHandler(sys.stderr)
-    logging.basicConfig(level=log_level, format=log_format, handlers=[log_handler])
+    logging.basicConfig(level=log_level, format=log_format, handlers=[log_handler, logs.RingHandler()])
 
-    logging.info("args=%r , unknown_args=%r, environ=%s, ", args, unknown_args, os.environ)
 
-    ctl_class = next(
-        c
-        for c in vars(importlib.import_module(f"{__package__}.{provider}_ctl")).values()
-        if isinstance(c, type) and c is not VPNConnectionControlBase and issubclass(c, VPNConnectionControlBase)
-    )
+def _sweep_runtime_records():
+    """Stops the daemons nobody adopted, see runtime.py. In the background: it waits for them to exit."""
+    threading.Thread(target=runtime.sweep, name="runtime-sweep", daemon=True).start()
+
+
+def _host_main(providers: str, state_home_dir: str | None):
+    """--host, see host.py"""
+    from .host import ServiceHost
+
+    _setup_logging("host")
+    if providers == "all":
+        providers = ",".join(sorted(p.name[: -len("_ctl.py")] for p in dir.glob("*_ctl.py")))
+    providers = providers.split(",")
+    logging.info("Service host for %s", providers)
+    host = ServiceHost({p: state_home_dir or default_state_home_dir(p) for p in providers})
+    supervisor.attach()
+    _sweep_runtime_records()
+    signal.signal(signal.SIGTERM, lambda *a: quit_loop("SIGTERM"))
+    if not host.start():
+        logging.error("No provider to serve, exiting")
+        return
+    loop.run()
+    host.shutdown()
+    logging.info("Adios!")
+
+
+def main(interpreter_ready_us: int = None):
+    imported_us = tracing.now_us()
+    # set by nm-<provider>-service (service-launcher/), else the process start time (clock tick resolution)
+    launch_us = int(os.environ.pop("VPN_BUNDLE_LAUNCH_US", 0)) or tracing.process_start_us()
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--provider", required=True)
+    parser.add_argument("--bus-name", required=False)
+    parser.add_argument("--state-home-dir", required=False)
+    parser.add_argument("--host", action="store_true", help="serve many connections, see host.py")
+    args, unknown_args = parser.parse_known_args()
+
+    if args.host:
+        return _host_main(args.provider, args.state_home_dir)
+    provider = args.provider
+    dbus_service_type = f"org.freedesktop.NetworkManager.{provider}"
+
+    dbus_bus_name = args.bus_name or dbus_service_type
+
+    state_home_dir = args.state_home_dir or default_state_home_dir(provider)
+
+    _setup_logging(provider)
+    logging.info("args=%r , unknown_args=%r", args, unknown_args)
+    logging.debug("environ=%s", os.environ)
+
+    ctl_class = load_ctl_class(provider)
     logging.info("Using provider: %s class=%r", provider, ctl_class)
+    provider_imported_us = tracing.now_us()
 
+    service = VpnDBUSService(ctl_class, state_home_dir)
+    supervisor.attach()
+    if ctl_class.supports_adopt:
+        _sweep_runtime_records()
     signal.signal(signal.SIGTERM, lambda *a: quit_loop("SIGTERM"))
+    signal.signal(standby.RELEASE_SIGNAL, lambda *a: service.release_standby())
     with (SystemBus if os.getuid() == 0 else SessionBus)() as bus:
-        bus.publish(dbus_bus_name, (dbus_object_path, VpnDBUSService(ctl_class, state_home_dir)))
+        registrations = register(bus, service)
+        service.bus = bus
+        bus_name_owner = bus.request_name(dbus_bus_name)
+        registered_us = tracing.now_us()
+
+        def take_bus_name(name: str):
+            nonlocal bus_name_owner
+            previous_owner, bus_name_owner = bus_name_owner, bus.request_name(name)
+            previous_owner.unown()
+
+        if args.bus_name:  # multi-connection activation: next ones get new bus names, see linger.py
+            service.enable_handoffs(provider, take_bus_name)
+        _report_startup(
+            launch_us,
+            [
+                ("interpreter", interpreter_ready_us or launch_us),
+                ("imports", imported_us),
+                ("provider module", provider_imported_us),
+                ("bus registration", registered_us),
+            ],
+            provider=provider,
+            bus_name=dbus_bus_name,
+        )
         loop.run()
+        service.shutdown()
+        bus_name_owner.unown()
+        for registration in reversed(registrations):
+            registration.unregister()
 
     logging.info("Adios!")
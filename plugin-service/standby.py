@@ -0,0 +1,109 @@
+"""
+Warm standby records, see "warm-standby-timeout".
+
+After Disconnect() the service process of a connection can keep its provider daemon running with the data path down,
+for a quick reconnect. NetworkManager starts a new service process (new bus name) for the next activation, which
+takes the daemon over from the standby process:
+`<runtime dir>/vpn-bundle-standby/<connection uuid>.json` tells which process holds it and what resume() needs.
+SIGUSR1 asks the holder to release the daemon and exit, SIGTERM to stop it.
+"""
+
+import json
+import logging
+import os
+import select
+import signal
+import time
+from pathlib import Path
+
+from .utils import process_start_time
+
+RELEASE_SIGNAL = signal.SIGUSR1
+_HOLDER_EXIT_TIMEOUT_SEC = 10
+
+
+def _records_dir():
+    return Path(os.getenv("XDG_RUNTIME_DIR", "/var/run"), "vpn-bundle-standby")
+
+
+def _record_path(uuid: str):
+    return _records_dir() / f"{uuid}.json"
+
+
+def settings_digest(provider: str, vpn_data: dict[str, str]):
+    """A daemon is only resumed for unchanged settings."""
+    import hashlib  # loads libcrypto, not at service startup
+
+    return hashlib.sha256(json.dumps([provider, vpn_data], sort_keys=True).encode()).hexdigest()
+
+
+def publish(uuid: str, digest: str, state: dict, released=False):
+    """
+    Announces that this process holds the daemon of `uuid` on standby. Re-published as `released` right before
+    exiting, when it was released to a claiming process.
+    """
+    record = {"pid": os.getpid(), "start_time": process_start_time(os.getpid()), "digest": digest, "state": state}
+    _write(uuid, dict(record, released=released))
+
+
+def remove(uuid: str):
+    try:
+        _record_path(uuid).unlink()
+    except FileNotFoundError:
+        pass
+
+
+def claim(uuid: str, digest: str) -> dict | None:
+    """
+    Takes the daemon of `uuid` over from the standby process holding it, if any. Returns its standby state for
+    resume(), or None if there is nothing to resume. A holder with different settings is stopped.
+    """
+    record = _read(uuid)
+    if not record or record["pid"] == os.getpid():
+        return None
+    pid = record["pid"]
+    try:
+        pidfd = os.pidfd_open(pid)
+    except ProcessLookupError:
+        pidfd = None
+    if pidfd is None or process_start_time(pid) != record["start_time"]:
+        logging.info("Standby process of %s is gone", uuid)
+        remove(uuid)
+        return None
+    try:
+        resumable = record["digest"] == digest
+        logging.info("%s standby process %d of %s", "Claiming" if resumable else "Stopping", pid, uuid)
+        signal.pidfd_send_signal(pidfd, RELEASE_SIGNAL if resumable else signal.SIGTERM)
+        started_at = time.monotonic()
+        if not select.select([pidfd], [], [], _HOLDER_EXIT_TIMEOUT_SEC)[0]:
+            logging.warning("Standby process %d did not exit, killing it", pid)
+            signal.pidfd_send_signal(pidfd, signal.SIGKILL)
+            remove(uuid)
+            return None
+        logging.debug("Standby process %d exited in %.1fms", pid, (time.monotonic() - started_at) * 1000)
+    finally:
+        if pidfd is not None:
+            os.close(pidfd)
+    record = _read(uuid)
+    remove(uuid)
+    if not resumable or not record or not record.get("released"):
+        return None  # stopped (eg: idle timeout) meanwhile
+    return record["state"]
+
+
+def _read(uuid: str) -> dict | None:
+    try:
+        return json.loads(_record_path(uuid).read_text())
+    except FileNotFoundError:
+        return None
+    except (OSError, ValueError) as e:
+        logging.warning("Invalid standby record of %s: %r", uuid, e)
+        return None
+
+
+def _write(uuid: str, record: dict):
+    path = _record_path(uuid)
+    path.parent.mkdir(mode=0o700, exist_ok=True)
+    tmp = path.with_suffix(".tmp")
+    tmp.write_text(json.dumps(record))
+    tmp.replace(path)
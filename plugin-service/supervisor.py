@@ -0,0 +1,113 @@
+"""
+Child process supervision on the service's GLib main loop.
+
+Every Subprocess and AdoptedProcess holds a pidfd. Once attach() is called by the main loop's thread, the pidfd of
+each process is watched by the loop: its exit is noticed (and the child reaped) right away and reported to the
+callbacks registered with on_exit(), without a thread blocking in wait() or a readiness loop polling is_running.
+Timers, eg: SIGTERM to SIGKILL escalation, are main loop timeouts too.
+
+Without a main loop (eg: the benchmarks drive the providers directly) exits are only noticed by poll()/wait(),
+exit callbacks are not called, and timers fall back to threading.Timer.
+"""
+
+import logging
+import threading
+from typing import Callable
+
+_GLib = None
+_sources: dict[object, int] = {}  # process -> pidfd watch
+_lock = threading.Lock()
+
+
+def attach():
+    """Supervises the processes started from now on with the GLib main loop (of the default main context)."""
+    global _GLib
+    from gi.repository import GLib
+
+    _GLib = GLib
+
+
+def attached() -> bool:
+    return _GLib is not None
+
+
+def watch(proc):
+    """Called by the process classes once they have a pidfd."""
+    if not _GLib or proc.pidfd is None:
+        return
+    with _lock:
+        _sources[proc] = _GLib.unix_fd_add_full(
+            _GLib.PRIORITY_HIGH, proc.pidfd, _GLib.IOCondition.IN, _on_pidfd_readable, proc
+        )
+
+
+def unwatch(proc):
+    with _lock:
+        source = _sources.pop(proc, None)
+    if source:
+        _GLib.source_remove(source)
+
+
+def _on_pidfd_readable(fd, condition, proc):
+    with _lock:
+        _sources.pop(proc, None)
+    try:
+        proc.poll()  # reaps it
+        proc.notify_exit()
+    except Exception as e:
+        logging.exception("Exit handling of %r failed: %r", proc, e)
+    return False
+
+
+def add_reader(fd: int, on_readable: Callable[[], bool]):
+    """Calls `on_readable()` on the main loop while `fd` is readable (or hung up), until it returns False."""
+    _GLib.unix_fd_add_full(
+        _GLib.PRIORITY_DEFAULT, fd, _GLib.IOCondition.IN | _GLib.IOCondition.HUP, lambda *_: on_readable()
+    )
+
+
+class Timer:
+    """Calls `fn` once after `delay_sec`, unless cancel()ed before (from any thread)."""
+
+    def __init__(self, delay_sec: float, fn: Callable[[], None]) -> None:
+        self._fn = fn
+        # a cancel() racing the timer firing: whichever takes the lock first wins
+        self._lock = threading.Lock()
+        self._done = False
+        if _GLib:
+            self._source = _GLib.timeout_add(max(0, int(delay_sec * 1000)), self._fire)
+        else:
+            self._source = threading.Timer(delay_sec, self._fire)
+            self._source.daemon = True
+            self._source.start()
+
+    def _fire(self):
+        with self._lock:
+            fire, self._done = not self._done, True
+            self._source = None
+        if fire:
+            self._fn()
+        return False
+
+    def cancel(self):
+        with self._lock:
+            if self._done:
+                return
+            self._done = True
+            source, self._source = self._source, None
+        if isinstance(source, threading.Timer):
+            source.cancel()
+        else:
+            _GLib.source_remove(source)
+
+
+def call_later(delay_sec: float, fn: Callable[[], None]) -> Timer:
+    return Timer(delay_sec, fn)
+
+
+def call_soon(fn: Callable[[], None]):
+    """Calls `fn` on the main loop, or right away without one."""
+    if _GLib:
+        _GLib.idle_add(lambda: fn() and False)
+    else:
+        fn()
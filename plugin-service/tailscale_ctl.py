@@ -1,29 +1,56 @@
-import json
+import http.client
 import logging
 import os
 import shlex
 import stat
 import subprocess
-import sys
-from ipaddress import ip_address
+from dataclasses import replace
+from ipaddress import ip_address, ip_network
 
+from . import tracing, tuning
 from .common import ConnectionResult, VPNConnectionControlBase
+from .httpclient import HTTPStatusError, KeepAliveHTTPClient, UnixHTTPConnection
+from .logs import DaemonLog, DetachedOutput
 from .utils import (
+    AdoptedProcess,
+    JSONStreamDecoder,
     Subprocess,
     find_valid_if_name,
+    get_iface_mtu,
     ip_interface_addresses_by_family,
     iter_until,
+    process_start_time,
     timeout,
 )
 
 _DEFAULT_SOCKPATH = f"/var/run/tailscale/tailscaled.sock"
 _DEFAULT_TAILSCALED_UP_TIMEOUT_SEC = 90
+# vpn.data key -> `tailscale set` flag, with the value `tailscale up` is called with if it is unset
+_SET_FLAGS = {
+    "hostname": ("--hostname", ""),
+    "advertise-routes": ("--advertise-routes", ""),
+    "exit-node": ("--exit-node", ""),
+    "is-accept-dns": ("--accept-dns", "false"),
+    "is-accept-routes": ("--accept-routes", "false"),
+    "is-ssh": ("--ssh", "false"),
+    "is-advertise-exit-node": ("--advertise-exit-node", "false"),
+    "is-exit-node-allow-lan-access=false": ("--exit-node-allow-lan-access", "false"),
+    "is-snat-subnet-routes": ("--snat-subnet-routes", "false"),
+}
 
 
 class TailscaleControl(VPNConnectionControlBase):
-    _proc_tailscaled: Subprocess = None
+    refresh_interval_sec = 10
+    supports_standby = True
+    supports_adopt = True
+    _accept_routes = False
+    _proc_tailscaled: Subprocess | AdoptedProcess = None
     _proc_tailscale_cli: Subprocess = None
+    _local_api: KeepAliveHTTPClient = None
     _tailscale_socket_appear_timeout_sec = 60
+    _tailscale_socket_poll_interval_sec = 0.05
+    # `tailscale set` changes them on the running tailscaled. It has no --advertise-tags.
+    live_settings = frozenset({*_SET_FLAGS, "tailscale-up-timeout"})
 
     def start(self, *, connection_uuid: str, connection_name: str, vpn_data: dict[str, str]):
         self._assert_processes_not_running()
@@ -58,46 +85,137 @@ class TailscaleControl(VPNConnectionControlBase):
             self.tailscaled_cmd.extend(shlex.split(extra_tailscaled_args))
 
         logging.info(f"Exec: {self.tailscaled_cmd}")
-        stderr = sys.stderr
-        if log_file := vpn_data.get("log-file", ""):
-            stderr = open(log_file, "wb+")
-        self._proc_tailscaled = Subprocess(self.tailscaled_cmd, name="tailscaled", stderr=stderr)
+        log_file = vpn_data.get("log-file")
+        if int(vpn_data.get("warm-standby-timeout") or 0) > 0 or vpn_data.get("is-survive-service-restart") == "true":
+            # may be handed over to another service process, so it must not write into a pipe of this one
+            output = DetachedOutput(log_file)
+        else:
+            output = DaemonLog("tailscaled", log_file)
+        self._proc_tailscaled = Subprocess(self.tailscaled_cmd, name="tailscaled", scope=self.scope, output=output)
+        self._proc_tailscaled.on_exit(self.service.daemon_exited)
 
         logging.info("Wating for tailscaled to be up and running")
-        with timeout(self._tailscale_socket_appear_timeout_sec) as t:
-            while True:
-                if self._tailscale_sock_is_available():
-                    break
-            logging.debug("Wating for tailscaled. will timeout after: %ds", t.remaining)
-            t.sleep(0.5)
-
-        self._call_cli_up(vpn_data)
+        self._connect_local_api()
+        with timeout(
+            self._tailscale_socket_appear_timeout_sec, description="Wait for tailscaled socket", cancel=self.cancel
+        ) as t:
+            while not self._tailscale_local_api_is_ready():
+                if self._proc_tailscaled.poll() is not None:
+                    raise RuntimeError(f"tailscaled exited with code: {self._proc_tailscaled.returncode}")
+                logging.debug("Wating for tailscaled. will timeout after: %ds", t.remaining)
+                t.sleep(self._tailscale_socket_poll_interval_sec)
+
+        return self._up(vpn_data, dev)
+
+    def _up(self, vpn_data: dict[str, str], dev: str):
+        self._accept_routes = vpn_data.get("is-accept-routes", "false") == "true"
+        # tailscaled has the tun device up already, the node gets an address of either family from the tailnet
+        self.service.announce_device(dev, has_ipv4=True, has_ipv6=True)
+        with tracing.span("tailscale up"):
+            self._call_cli_up(vpn_data)
         status = self._get_status()
         logging.info("tailscale status: %s", status)
         if status["BackendState"] != "Running":
             raise RuntimeError("Could not up tailscale")
         ipv4, ipv6 = ip_interface_addresses_by_family(status["Self"]["TailscaleIPs"])
+        tuning.set_tx_queue_length(dev, vpn_data)
+        self._dev = dev
         result = ConnectionResult(
             # dns=[ip_address("100.100.100.100")],  if use this, NerworkManager will update /etc/resolv.conf, whcih overwrites changes updated by tailscaled.
-            mtu=1280,
+            mtu=get_iface_mtu(dev) or 1280,  # tailscaled's default
             ipv4=ipv4,
             ipv6=ipv6,
+            routes=self._accepted_routes(status),
             dev=dev,
             gateway=ip_address("255.255.255.255"),  # dummy
         )
 
         return result
 
+    def standby(self):
+        Subprocess.check_output_text(*self.tailscale_cli_cmd, "down", process_timeout=10)
+        return self.runtime_state()
+
+    def runtime_state(self):
+        return {
+            "sockpath": self._sockpath,
+            "dev": self._dev,
+            "tailscaled_pid": self._proc_tailscaled.pid,
+            "tailscaled_start_time": process_start_time(self._proc_tailscaled.pid),
+        }
+
+    def resume(self, standby_state: dict, *, connection_uuid: str, connection_name: str, vpn_data: dict[str, str]):
+        if not self._proc_tailscaled:  # put on standby by another service process
+            self._adopt_tailscaled(standby_state)
+        if not self._tailscale_local_api_is_ready():
+            raise RuntimeError("tailscaled on standby is not responding")
+        return self._up(vpn_data, standby_state["dev"])
+
+    def adopt(self, runtime_state: dict, *, connection_uuid: str, connection_name: str, vpn_data: dict[str, str]):
+        self._adopt_tailscaled(runtime_state)
+        if not self._tailscale_local_api_is_ready():
+            raise RuntimeError("tailscaled left running is not responding")
+        self._accept_routes = vpn_data.get("is-accept-routes", "false") == "true"
+        self._dev = runtime_state["dev"]
+
+    def _adopt_tailscaled(self, state: dict):
+        self._proc_tailscaled = AdoptedProcess(
+            state["tailscaled_pid"], state["tailscaled_start_time"], name="tailscaled"
+        )
+        self._proc_tailscaled.on_exit(self.service.daemon_exited)
+        self._sockpath = state["sockpath"]
+        self.tailscale_cli_cmd = ["tailscale", "--socket=" + self._sockpath]
+        self._connect_local_api()
+
+    def release(self):
+        if isinstance(self._proc_tailscaled, Subprocess):
+            self._proc_tailscaled.detach()
+
+    def refresh(self, current: ConnectionResult):
+        status = self._get_status()
+        if status.get("BackendState") != "Running":
+            logging.warning("tailscale backend state is %s", status.get("BackendState"))
+            return None
+        ipv4, ipv6 = ip_interface_addresses_by_family(status["Self"]["TailscaleIPs"])
+        return replace(current, ipv4=ipv4, ipv6=ipv6, routes=self._accepted_routes(status))
+
+    def apply_settings(self, changed: dict[str, str | None], vpn_data: dict[str, str]) -> bool:
+        flags = [
+            f"{flag}={(vpn_data.get(k) or '').strip() or default}"
+            for k, (flag, default) in _SET_FLAGS.items()
+            if k in changed
+        ]
+        if flags:
+            logging.info("Calling tailscale set: %r", flags)
+            Subprocess.check_output_text(*self.tailscale_cli_cmd, "set", *flags, process_timeout=10)
+        self._accept_routes = vpn_data.get("is-accept-routes", "false") == "true"
+        return True
+
+    def _accepted_routes(self, status):
+        """Subnet routes served by peers. Exit node default routes are left to tailscaled."""
+        if not self._accept_routes:
+            return ()
+        routes = set()
+        for peer in (status.get("Peer") or {}).values():
+            for r in peer.get("PrimaryRoutes") or ():
+                net = ip_network(r, strict=False)
+                if net.prefixlen:
+                    routes.add(net)
+        return tuple(sorted(routes, key=lambda n: (n.version, n)))
+
     def _get_status(self):
+        if self._local_api:
+            try:
+                return self._local_api.request_json("GET", "/localapi/v0/status")
+            except Exception as e:
+                logging.warning("tailscaled LocalAPI is not usable, falling back to tailscale cli: %r", e)
+                self._local_api.close()
+                self._local_api = None
         status = Subprocess.check_output_json(*self.tailscale_cli_cmd, "status", "--json", process_timeout=10)
         return status
 
     def _get_ips(self):
-        stdout = Subprocess.check_output_text(*self.tailscale_cli_cmd, "ip", process_timeout=10)
-        addresses = []
-        for line in stdout.split("\n"):
-            addresses.append(ip_address(line))
-        return addresses
+        return [ip_address(a) for a in self._get_status()["Self"]["TailscaleIPs"]]
 
     def _call_cli_up(self, vpn_data: dict[str, str]):
         tailscale_cli_up_cmd = [*self.tailscale_cli_cmd, "up", "--reset", "--json"]
@@ -123,16 +241,18 @@ class TailscaleControl(VPNConnectionControlBase):
             tailscale_cli_up_cmd.extend(shlex.split(extra_tailscale_up_args))
         logging.info("Calling tailscale up: %r", tailscale_cli_up_cmd)
         with Subprocess.bg_process(
-            *tailscale_cli_up_cmd, name="tailscale up", process_timeout=up_timeout + 1, stdout=subprocess.PIPE
+            *tailscale_cli_up_cmd,
+            name="tailscale up",
+            process_timeout=up_timeout + 1,
+            cancel=self.cancel,
+            stdout=subprocess.PIPE,
         ) as p:
-            output = ""
+            decoder = JSONStreamDecoder()
             try:
-                auth_url = False
                 for line in iter_until(p.stdout.readline, b"", ValueError):
-                    output += line.decode("utf-8", errors="replace")
-                    try:
-                        parsed = json.loads(output)
-                        output = ""
+                    for parsed in decoder.feed(line.decode("utf-8", errors="replace")):
+                        if not isinstance(parsed, dict):
+                            continue
                         logging.info("(tailscale up) parsed> %r", parsed)
                         if auth_url := parsed.get("AuthURL"):
                             qr_png_b64 = parsed.get("QR", "").removeprefix("data:image/png;base64,")
@@ -140,15 +260,10 @@ class TailscaleControl(VPNConnectionControlBase):
                             self._prompt_auth(auth_url, qr_png_b64)
                         if parsed.get("BackendState") == "Running":
                             logging.info("tailscale is already up and running")
-                    except json.JSONDecodeError:
-                        pass
-                    except Exception as e:
-                        logging.exception("Unexpected: %r", e)
-                        raise
             finally:  # EOF
                 ec = p.wait()
                 logging.log(logging.INFO if ec == 0 else logging.ERROR, "tailscale up exited with code: %d", ec)
-                if output.strip():
+                if output := decoder.pending.strip():
                     logging.warn("(tailscale up) stdout> %s", output)
                 if ec is not None and ec != 0 and not p.gracefully_killed:  # not due to graceful exit
                     raise RuntimeError(f"While reading stdout, {p} exited")
@@ -165,6 +280,26 @@ class TailscaleControl(VPNConnectionControlBase):
             "__dummy__",
         )
 
+    def _connect_local_api(self):
+        self._local_api = KeepAliveHTTPClient(
+            lambda: UnixHTTPConnection(self._sockpath, host="local-tailscaled.sock", timeout=10)
+        )
+
+    def _tailscale_local_api_is_ready(self):
+        if not self._tailscale_sock_is_available():
+            return False
+        if not self._local_api:  # dropped by _get_status() on a failure, eg: before a resume()
+            self._connect_local_api()
+        try:
+            self._local_api.request("GET", "/localapi/v0/status")
+            return True
+        except (OSError, http.client.HTTPException) as e:  # socket is created before tailscaled serves requests
+            logging.debug("tailscaled LocalAPI not ready yet: %r", e)
+            return False
+        except HTTPStatusError as e:  # serving, _get_status() falls back to the cli
+            logging.warning("tailscaled LocalAPI: %s", e)
+            return True
+
     def _tailscale_sock_is_available(self):
         try:
             return stat.S_ISSOCK(os.stat(self._sockpath).st_mode)
@@ -178,6 +313,9 @@ class TailscaleControl(VPNConnectionControlBase):
             raise RuntimeError("tailscale process already running")
 
     def stop(self):
+        if self._local_api:
+            self._local_api.close()
+            self._local_api = None
         if self._proc_tailscale_cli:
             self._proc_tailscale_cli.graceful_kill()
             self._proc_tailscale_cli = None
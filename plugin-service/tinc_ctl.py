@@ -3,65 +3,137 @@ import json
 import logging
 import os
 import re
-import shutil
-import sys
+import signal
+import socket
+import subprocess
 from collections import defaultdict
 from contextlib import suppress
+from dataclasses import replace
 
+from . import tuning
 from .common import ConnectionResult, VPNConnectionControlBase
+from .logs import DaemonLog
 from .utils import (
+    RenderedFiles,
     Subprocess,
     find_valid_if_name,
-    get_iface_addresses,
+    get_iface_addresses_by_family,
+    get_iface_mtu,
     getter,
-    is_interface_ready,
-    timeout,
+    wait_for_interface,
 )
 
+_PEER_NAME = re.compile(r"[a-zA-Z0-9_-]+")
+
+
+def _replay_window(h: tuning.Host):
+    """In bytes, 8 packets each (default 32): packets of fast links get reordered further than that."""
+    if h.multi_gigabit:
+        return 256
+    if h.gigabit:
+        return 128
+    return None
+
+
+def _compression(h: tuning.Host):
+    """Fast LZO (10) pays off on slow links only, and with a CPU to spare."""
+    if h.link_mbps and h.link_mbps < 100 and h.cpus > 1:
+        return 10
+    return None
+
 
 class TincControl(VPNConnectionControlBase):
     _ready_check_interval_sec = 2
     _ready_timeout_sec = 30
     _proc_tincd: Subprocess = None
+    _tinc_cli_cmd: list[str] = None
+    _static_routes = frozenset()
+    # they only change host files (hosts/), which reload() applies with a SIGHUP; tinc.conf changes need a restart
+    live_settings = frozenset({"peers", "external-address", "additional-host-conf"})
 
     def start(self, *, connection_uuid: str, connection_name: str, vpn_data: dict[str, str]):
         self._config_dir = f"{os.getenv('XDG_RUNTIME_DIR','/var/run')}/tinc-nm/config.{connection_uuid}"
         os.makedirs(self._config_dir, exist_ok=True)
         dev, routes = self._run_tincd(connection_name, vpn_data)
-        ipv4, ipv6 = None, None
-        for a in get_iface_addresses(dev):
-            if a.version == 4:
-                ipv4 = a
-            else:
-                ipv6 = a
+        ipv4, ipv6 = get_iface_addresses_by_family(dev)
         return ConnectionResult(
             ipv4=ipv4,
             ipv6=ipv6,
-            # mtu=mtu,
+            mtu=get_iface_mtu(dev),
             # dns=dns,
             routes=tuple(routes),
             dev=dev,
             gateway=ipaddress.IPv4Address("255.255.255.255"),  # dummy
         )
 
+    def refresh(self, current: ConnectionResult):
+        result = super().refresh(current)
+        if result and (subnets := self._dump_subnets()) is not None:
+            result = replace(result, routes=tuple(sorted(self._static_routes | subnets, key=lambda n: (n.version, n))))
+        return result
+
+    def _dump_subnets(self):
+        """
+        Subnets currently known to tincd, including the ones learned from peers which are not in our hosts/ files.
+        Needs the tinc 1.1 control CLI; returns None if it is not available.
+        eg: 10.1.2.0/24#10 owner bob
+        """
+        if not self._tinc_cli_cmd:
+            return None
+        try:
+            stdout = Subprocess.check_output_text(*self._tinc_cli_cmd, "dump", "subnets", process_timeout=10)
+        except (OSError, subprocess.CalledProcessError) as e:
+            logging.info("tinc dump subnets is not available, using configured peer subnets only: %r", e)
+            self._tinc_cli_cmd = None
+            return None
+        subnets = set()
+        for line in stdout.splitlines():
+            parts = line.split()
+            if len(parts) < 3 or parts[1] != "owner" or parts[2] == self._node_name:
+                continue
+            with suppress(ValueError):
+                subnets.add(ipaddress.ip_network(parts[0].split("#")[0], strict=False))
+        return subnets
+
     def stop(self):
         if self._proc_tincd:
             self._proc_tincd.graceful_kill()
         # with suppress(FileNotFoundError):
         #     shutil.rmtree(self._config_dir)
 
-    def _run_tincd(self, connection_name, vpn_data: dict[str, str]):
+    def apply_settings(self, changed: dict[str, str | None], vpn_data: dict[str, str]) -> bool:
+        return self.reload(vpn_data)
+
+    def reload(self, vpn_data: dict[str, str]) -> bool:
+        """
+        Re-renders the config of the running tincd. Peer (hosts/) changes are applied with SIGHUP: tincd re-reads
+        its host files and closes the connections of removed peers. False if tincd needs a restart instead, ie:
+        tinc.conf or tinc-up changed (nothing is rendered then).
+        """
+        if not self._proc_tincd or not self._proc_tincd.is_running:
+            return False
+        rendered = self._render(self._connection_name, vpn_data, dev=self._rendered["dev"])
+        if rendered["tinc_bin"] != self._rendered["tinc_bin"] or any(
+            rendered["files"][f] != self._rendered["files"][f] for f in ("tinc.conf", "tinc-up")
+        ):
+            return False
+        self._rendered = rendered
+        if changed := self._files.write(rendered["files"]):
+            logging.info("tinc config changed: %d files, reloading tincd", len(changed))
+            self._proc_tincd.send_signal(signal.SIGHUP)
+        self._static_routes = frozenset(rendered["routes"])
+        return True
+
+    def _render(self, connection_name, vpn_data: dict[str, str], dev: str = None) -> dict:
+        """The config files of tincd, and what is needed to start it. `dev`: of the running tincd."""
         vpn_data_get = getter(vpn_data)
 
-        tinc_bin = vpn_data_get("tincd-bin", "tincd")  # ip or ethernet
-        debug_level = int(vpn_data_get("debug-level", 1))
+        tinc_bin = vpn_data_get("tincd-bin", "tincd")
         node_name = vpn_data_get("node-name", "$HOST")
-        tincd_cmd = [tinc_bin, "--config", self._config_dir, "--no-detach", "--debug", str(debug_level)]
-
-        device_type = "tun"
+        device_type = "tun"  # ip or ethernet
         if "ETHERNET" in vpn_data_get("net-mode", "").upper():
             device_type = "tap"
-        dev = vpn_data_get("dev") or find_valid_if_name(connection_name)
+        dev = vpn_data_get("dev") or dev or find_valid_if_name(connection_name)
         listen_port = vpn_data_get("listen-port", 655)
         server_conf = {
             "Name": node_name,
@@ -72,6 +144,8 @@ class TincControl(VPNConnectionControlBase):
         }
         rsa_private_key_file = vpn_data_get("rsa-private-key", ...)
         server_conf["PrivateKeyFile"] = rsa_private_key_file
+        if replay_window := tuning.resolve(vpn_data, "replay-window", _replay_window):
+            server_conf["ReplayWindow"] = replay_window
         if additional_server_cfg := vpn_data_get("additional-server-conf"):
             server_conf.update(self._parse_config_entries(additional_server_cfg))
 
@@ -84,111 +158,136 @@ class TincControl(VPNConnectionControlBase):
             "Address": external_address.replace(":", " "),
             "Subnet": [str(cidr.network) for cidr in cidrs],
         }
+        if (compression := tuning.resolve(vpn_data, "compression", _compression)) is not None:
+            host_conf["Compression"] = compression
         if additional_host_cfg := vpn_data_get("additional-host-conf"):
             host_conf.update(self._parse_config_entries(additional_host_cfg))
 
-        tinc_up_file = os.path.join(self._config_dir, "tinc-up")
-        with open(tinc_up_file, "w") as f:
-            f.write("#!/bin/sh\nset -ex\n")
-            for cidr in cidrs:
-                if cidr.network.network_address != cidr.ip or (
-                    cidr.version == 4 and cidr.network.prefixlen == 32
-                ):  # CIDR is not a network address
-                    f.write(f"ip addr add {cidr.with_prefixlen} dev $INTERFACE\n")
-        os.chmod(tinc_up_file, 0o755)
-
-        hosts_dir = os.path.join(self._config_dir, "hosts")
-        os.makedirs(hosts_dir, exist_ok=True)
+        tinc_up = ["#!/bin/sh\nset -ex\n"]
+        if mtu := int(vpn_data_get("mtu", 0)):
+            tinc_up.append(f"ip link set dev $INTERFACE mtu {mtu}\n")
+        for cidr in cidrs:
+            if cidr.network.network_address != cidr.ip or (
+                cidr.version == 4 and cidr.network.prefixlen == 32
+            ):  # CIDR is not a network address
+                tinc_up.append(f"ip addr add {cidr.with_prefixlen} dev $INTERFACE\n")
 
+        files = {}
         routes: set[ipaddress.IPv4Network | ipaddress.IPv6Address] = set()
         for peer_name, peer_cfg in self._parse_peer_config(vpn_data_get("peers", [])).items():
-            peer_cfg_content = self._stringify_conf(peer_cfg["entries"]) + "\n" + peer_cfg["public_key"]
-            logging.debug("tinc peer host config: %s: %r", peer_name, peer_cfg_content)
-            peer_host_file = os.path.join(hosts_dir, peer_name)
-            for cidr in peer_cfg["entries"]["Subnet"]:
+            files[os.path.join("hosts", peer_name)] = (
+                self._stringify_conf(peer_cfg["entries"]) + "\n" + peer_cfg["public_key"],
+                0o644,
+            )
+            for cidr in peer_cfg["entries"].get("Subnet", ()):
                 routes.add(ipaddress.ip_network(cidr))
-            with open(peer_host_file, "w") as f:
-                f.write(peer_cfg_content)
-
-        server_conf_file = os.path.join(self._config_dir, "tinc.conf")
-        server_conf_content = self._stringify_conf(server_conf)
-        logging.debug("tinc server config: %r", server_conf_content)
-        with open(server_conf_file, "w") as f:
-            f.write(server_conf_content)
-
-        host_conf_file = os.path.join(hosts_dir, node_name)
-        host_conf_content = self._stringify_conf(host_conf)
-        logging.debug("tinc host config: %r", host_conf_content)
-        with open(host_conf_file, "w") as f:
-            f.write(host_conf_content)
-
-        stderr = sys.stderr
-        if log_file := vpn_data_get("log-file"):
-            stderr = open(log_file, "wb+")
+        files["tinc.conf"] = (self._stringify_conf(server_conf), 0o644)
+        files["tinc-up"] = ("".join(tinc_up), 0o755)
+        # tincd expands $HOST in Name the same way
+        node_name = node_name.replace("$HOST", re.sub(r"[^a-zA-Z0-9_]", "_", socket.gethostname()))
+        files[os.path.join("hosts", node_name)] = (self._stringify_conf(host_conf), 0o644)
+        logging.debug("tinc server config: %r", files["tinc.conf"][0])
+        logging.debug("tinc host config: %r", files[os.path.join("hosts", node_name)][0])
+
+        return {
+            "tinc_bin": tinc_bin,
+            "node_name": node_name,
+            "dev": dev,
+            "cidrs": cidrs,
+            "routes": routes,
+            "files": files,
+        }
+
+    def _run_tincd(self, connection_name, vpn_data: dict[str, str]):
+        vpn_data_get = getter(vpn_data)
+
+        debug_level = int(vpn_data_get("debug-level", 1))
+        self._connection_name = connection_name
+        self._rendered = rendered = self._render(connection_name, vpn_data)
+        tinc_bin, dev, cidrs = rendered["tinc_bin"], rendered["dev"], rendered["cidrs"]
+        pid_file = os.path.join(self._config_dir, "tinc.pid")
+        tincd_cmd = [
+            tinc_bin,
+            "--config",
+            self._config_dir,
+            "--pidfile",
+            pid_file,
+            "--no-detach",
+            "--debug",
+            str(debug_level),
+        ]
+        self._tinc_cli_cmd = [
+            os.path.join(os.path.dirname(tinc_bin), "tinc") if tinc_bin.endswith("tincd") else "tinc",
+            "--config",
+            self._config_dir,
+            "--pidfile",
+            pid_file,
+        ]
+        self._node_name = rendered["node_name"]
+
+        # only the changed files are written, the config dir of the connection is kept across connects
+        self._files = RenderedFiles(self._config_dir)
+        changed = self._files.write(rendered["files"])
+        logging.info("tinc config: %d of %d files changed", len(changed), len(rendered["files"]))
+        self._static_routes = frozenset(rendered["routes"])
+
         logging.info("Run tincd: %r", tincd_cmd)
-        self._proc_tincd = Subprocess(tincd_cmd, name="tincd", stderr=stderr)
+        self._proc_tincd = Subprocess(
+            tincd_cmd, name="tincd", output=DaemonLog("tincd", vpn_data_get("log-file")), scope=self.scope
+        )
+        self._proc_tincd.on_exit(self.service.daemon_exited)
 
-        with timeout(self._ready_timeout_sec, description=f"Wait for interface: {dev}") as t:
-            while not is_interface_ready(dev):
-                if not self._proc_tincd.is_running:
-                    raise RuntimeError("tincd cmd exited prematurely")
-                t.sleep(self._ready_check_interval_sec)
+        versions = {cidr.version for cidr in cidrs}
+        wait_for_interface(
+            dev,
+            self._proc_tincd,
+            self._ready_timeout_sec,
+            on_link=lambda: self.service.announce_device(dev, has_ipv4=4 in versions, has_ipv6=6 in versions),
+            poll_interval_sec=self._ready_check_interval_sec,
+            cancel=self.cancel,
+        )
+        tuning.set_tx_queue_length(dev, vpn_data)
 
-        return dev, routes
+        return dev, rendered["routes"]
 
     def _parse_peer_config(self, peer_configs_serilaized):
+        """
+        Peer entries: `<name> <address> <subnet,...> [<key=value,...>] <public key words...>`.
+        Each entry is split once; multi-valued keys are ordered sets (dicts), so this is linear in the input.
+        """
         peers = {}
-        peerr_configs = json.loads(peer_configs_serilaized)
-        for config_str in peerr_configs:
+        for config_str in json.loads(peer_configs_serilaized):
             try:
-                entries = defaultdict(list)
-                peer_name = ""
-                public_key = ""
-                expected = "name"
-                for w in config_str.split(" "):
-                    w = w.strip()
-                    if not w or w == "<edit>":
-                        continue
-                    if expected == "name":
-                        if not re.match(r"^[a-zA-Z0-9_-]+$", w):
-                            raise ValueError(f"Invalid peer name: {w}")
-                        peer_name = w
-                        expected = "address"
-                        continue
-                    if expected == "address":
-                        entries["Address"] = w.replace(":", " ")
-                        expected = "subnet_csv"
-                        continue
-                    elif expected == "subnet_csv":
-                        entries["Subnet"] = w.split(",")
-                        expected = "kv_csv"
-                        continue
-                    elif expected == "kv_csv":
-                        try:
-                            for kv in w.split(","):
-                                k, v = kv.split("=")
-                                k = k.strip()
-                                v = v.strip()
-                                if v not in entries[k]:
-                                    entries[k].append(v)
-                            continue
-                        except ValueError:
-                            pass
-                        finally:
-                            expected = "publickey"
-                    assert expected == "publickey"
-                    public_key += w
-                public_key = public_key.strip().replace("\\n", "\n").replace(" ", "\n")
+                words = [w for w in map(str.strip, config_str.split(" ")) if w and w != "<edit>"]
+                if not words:
+                    continue
+                peer_name = words[0]
+                if not _PEER_NAME.fullmatch(peer_name):
+                    raise ValueError(f"Invalid peer name: {peer_name}")
+                entries = {}
+                if len(words) > 1:
+                    entries["Address"] = words[1].replace(":", " ")
+                if len(words) > 2:
+                    entries["Subnet"] = dict.fromkeys(words[2].split(","))
+                key_words = words[3:]
+                if key_words and "=" in key_words[0]:
+                    try:
+                        for kv in key_words[0].split(","):
+                            k, v = kv.split("=")
+                            entries.setdefault(k.strip(), {})[v.strip()] = None
+                        key_words = key_words[1:]
+                    except ValueError:  # not a key=value list, the public key starts here
+                        pass
+                public_key = "".join(key_words).strip().replace("\\n", "\n")
                 if "--BEGIN" not in public_key:
                     public_key = f"-----BEGIN RSA PUBLIC KEY-----\n{public_key}\n-----END RSA PUBLIC KEY-----"
-                if peer_name:
-                    peers[peer_name] = {"public_key": public_key, "entries": entries}
+                peers[peer_name] = {"public_key": public_key, "entries": entries}
             except Exception as e:
                 raise ValueError(f"Could not parse peer config: {config_str}") from e
         return peers
 
     def _parse_config_entries(self, confg_entries_serilaized):
-        entries = defaultdict(list)
+        entries = defaultdict(dict)  # key -> ordered set of values
         try:
             for kv in json.loads(confg_entries_serilaized):
                 if not kv.strip() or kv == "<edit>":
@@ -196,19 +295,18 @@ class TincControl(VPNConnectionControlBase):
                 k, v = kv.split("=")
                 k = k.strip()
                 v = v.strip()
-                if k and v and v not in entries[k]:
-                    entries[k].append(v)
+                if k and v:
+                    entries[k][v] = None
         except Exception as e:
             raise ValueError(f"Invalid config entries: {confg_entries_serilaized}") from e
         return entries
 
     def _stringify_conf(self, entries):
-        content = ""
+        lines = []
         for k, v in entries.items():
-            if isinstance(v, list):
-                for i in v:
-                    content += f"{k} = {i}\n"
+            if isinstance(v, str):
+                lines.append(f"{k} = {v}\n")
             else:
-                content += f"{k} = {v}\n"
-
-        return content
+                for i in v:
+                    lines.append(f"{k} = {i}\n")
+        return "".join(lines)
@@ -0,0 +1,166 @@
+"""
+Connect-phase tracing.
+
+Enabled when $VPN_BUNDLE_TRACE_DIR is set or `<runtime dir>/vpn-bundle-trace/` exists. Spans are appended as Chrome
+trace events (JSON array format, loadable by chrome://tracing and https://ui.perfetto.dev) to
+`<trace dir>/<connection uuid>.json`. nm-vpn-bundle-auth-dialog, running as the desktop user, appends its spans to
+`<connection uuid>.auth-dialog.json` (common/trace.h): the connection uuid is the correlation id across processes.
+Timestamps are wall-clock microseconds. The trace directory may be world-writable (sticky): a trace file is only
+written if it is a regular file (not a symlink) owned by the writing user.
+
+Only the connect and disconnect phases are recorded (between begin() and end()), periodic refreshes are not.
+"""
+
+import contextlib
+import fcntl
+import json
+import logging
+import os
+import stat
+import threading
+import time
+
+_lock = threading.Lock()
+_connection_uuid: str | None = None
+_phase: str | None = None
+_phase_start_us = 0
+_pending: list[dict] | None = []  # recorded before the first phase begins (eg: process startup)
+_phase_spans: list[dict] = []  # for the summary line
+
+
+def _find_trace_dir():
+    if trace_dir := os.getenv("VPN_BUNDLE_TRACE_DIR"):
+        os.makedirs(trace_dir, exist_ok=True)
+        return trace_dir
+    trace_dir = f"{os.getenv('XDG_RUNTIME_DIR','/var/run')}/vpn-bundle-trace"
+    return trace_dir if os.path.isdir(trace_dir) else None
+
+
+try:
+    trace_dir = _find_trace_dir()
+except OSError as e:
+    logging.warning("Tracing disabled: %r", e)
+    trace_dir = None
+
+
+def enabled():
+    return trace_dir is not None
+
+
+def now_us() -> int:
+    return time.time_ns() // 1000
+
+
+def process_start_us() -> int:
+    """Wall-clock start time of this process, ie: including interpreter startup and imports."""
+    with open("/proc/self/stat") as f:
+        start_ticks = int(f.read().rsplit(")", 1)[1].split()[19])
+    with open("/proc/stat") as f:
+        boot_time = next(int(line.split()[1]) for line in f if line.startswith("btime "))
+    return (boot_time * 1_000_000) + start_ticks * 1_000_000 // os.sysconf("SC_CLK_TCK")
+
+
+def begin(uuid: str, phase: str):
+    """Starts recording `phase` (connect, disconnect) of connection `uuid`."""
+    global _connection_uuid, _phase, _phase_start_us, _pending
+    if not enabled():
+        return
+    with _lock:
+        _connection_uuid, _phase, _phase_start_us = uuid, phase, now_us()
+        pending = [dict(e, args=dict(e["args"], uuid=uuid)) for e in _pending or ()]
+        _pending = None
+        _phase_spans[:] = pending
+    _write(uuid, pending)
+
+
+def end():
+    """Stops recording and logs a summary line of the phase: its wall time and the time spent per span name."""
+    global _phase
+    if not enabled():
+        return
+    with _lock:
+        phase, _phase = _phase, None
+        spans = sorted(_phase_spans, key=lambda e: e["ts"])
+        _phase_spans.clear()
+    if not phase or not spans:
+        return
+    total_ms = (now_us() - _phase_start_us) / 1000
+    by_name: dict[str, list[int]] = {}
+    for e in spans:
+        by_name.setdefault(e["name"], []).append(e["dur"])
+    logging.info(
+        "%s trace %s: total=%.0fms %s (%s)",
+        phase.capitalize(),
+        _connection_uuid,
+        total_ms,
+        " ".join(
+            f"[{name}]={sum(d) / 1000:.0f}ms" + (f"(x{len(d)})" if len(d) > 1 else "") for name, d in by_name.items()
+        ),
+        _trace_file(_connection_uuid),
+    )
+
+
+def record(name: str, start_us: int, end_us: int = None, **args):
+    if not enabled():
+        return
+    end_us = now_us() if end_us is None else end_us
+    event = {
+        "name": name,
+        "cat": "plugin-service",
+        "ph": "X",
+        "ts": start_us,
+        "dur": max(0, end_us - start_us),
+        "pid": os.getpid(),
+        "tid": threading.get_native_id(),
+        "args": {k: v if isinstance(v, (int, float, bool)) else str(v) for k, v in args.items()},
+    }
+    with _lock:
+        if not _phase:
+            if _pending is not None:
+                _pending.append(event)
+            return
+        uuid = _connection_uuid
+        event["args"]["uuid"] = uuid
+        _phase_spans.append(event)
+    _write(uuid, [event])
+
+
+@contextlib.contextmanager
+def span(name: str, **args):
+    if not enabled():
+        yield
+        return
+    start_us = now_us()
+    try:
+        yield
+    except BaseException as e:
+        args["error"] = repr(e)
+        raise
+    finally:
+        record(name, start_us, **args)
+
+
+def _trace_file(uuid: str):
+    return os.path.join(trace_dir, f"{uuid}.json")
+
+
+def _write(uuid: str, events: list[dict]):
+    if not events:
+        return
+    data = "".join(json.dumps(e, separators=(",", ":")) + ",\n" for e in events)
+    try:
+        # O_NONBLOCK: a FIFO planted in its place fails with ENXIO instead of blocking
+        flags = os.O_WRONLY | os.O_APPEND | os.O_CREAT | os.O_NOFOLLOW | os.O_NONBLOCK | os.O_CLOEXEC
+        fd = os.open(_trace_file(uuid), flags, 0o644)
+        try:
+            st = os.fstat(fd)
+            if not stat.S_ISREG(st.st_mode) or st.st_uid != os.geteuid():
+                raise PermissionError(f"{_trace_file(uuid)} is not a regular file of ours")
+            fcntl.flock(fd, fcntl.LOCK_EX)  # shared with other service processes of the same connection
+            if os.fstat(fd).st_size == 0:
+                data = "[\n" + data
+            os.write(fd, data.encode("utf-8"))
+        finally:
+            os.close(fd)
+    except OSError as e:
+        logging.debug("Could not write trace events: %r", e)
@@ -0,0 +1,104 @@
+"""
+Performance settings of the providers ("Performance" section of providers/*.json).
+
+A setting left on "auto" (or unset) is derived from the host: its CPU count and the speed of the link of the default
+route (unknown for most virtual interfaces). Settings that peers must agree on (eg: the n2n cipher) are never "auto". An auto rule returning None leaves
+the daemon's default in place.
+"""
+
+import functools
+import logging
+import os
+from dataclasses import dataclass
+from typing import Any, Callable
+
+AUTO = "auto"
+
+
+@dataclass(frozen=True)
+class Host:
+    cpus: int
+    link_mbps: int | None  # of the default route's interface
+
+    @property
+    def multi_gigabit(self) -> bool:
+        return (self.link_mbps or 0) >= 2500
+
+    @property
+    def gigabit(self) -> bool:
+        return (self.link_mbps or 0) >= 1000
+
+
+def default_route_interface() -> str | None:
+    with open("/proc/net/route") as f:
+        next(f)  # header
+        for line in f:
+            fields = line.split()
+            if fields[1] == "00000000" and fields[7] == "00000000":  # destination and mask 0.0.0.0
+                return fields[0]
+    return None
+
+
+def _link_mbps() -> int | None:
+    try:
+        if not (iface := default_route_interface()):
+            return None
+        with open(f"/sys/class/net/{iface}/speed") as f:
+            speed = int(f.read())
+    except (OSError, ValueError):  # eg: EINVAL while the link is down
+        return None
+    return speed if speed > 0 else None
+
+
+@functools.cache
+def host() -> Host:
+    h = Host(cpus=len(os.sched_getaffinity(0)), link_mbps=_link_mbps())
+    logging.info("Host profile for auto performance settings: %s", h)
+    return h
+
+
+def resolve(vpn_data: dict[str, str], key: str, auto: Callable[[Host], Any]) -> Any:
+    """
+    Value of performance setting `key`: `auto(host())` for "auto" or unset, else the value (an int if numeric).
+    None leaves the daemon's default.
+    """
+    value = (vpn_data.get(key) or "").strip() or AUTO
+    if value == AUTO:
+        value = auto(host())
+        logging.info("Performance setting %s=auto: %r", key, value)
+        return value
+    return int(value) if value.isdigit() else value
+
+
+def tx_queue_length(h: Host) -> int | None:
+    """Of the tun device: the default (500 for tun) drops bursts once a gigabit link is saturated."""
+    if h.multi_gigabit:
+        return 5000
+    if h.gigabit:
+        return 1000
+    return None
+
+
+def socket_buffer_bytes(h: Host) -> int | None:
+    """SO_RCVBUF/SO_SNDBUF of the UDP socket of a daemon."""
+    if h.multi_gigabit:
+        return 16 * 1024 * 1024
+    if h.gigabit:
+        return 4 * 1024 * 1024
+    return None
+
+
+def workers(h: Host) -> int:
+    """Packet processing threads: one per CPU."""
+    return h.cpus
+
+
+def set_tx_queue_length(dev: str, vpn_data: dict[str, str]):
+    """Applies "tx-queue-length" to the tun device `dev`."""
+    if not (length := resolve(vpn_data, "tx-queue-length", tx_queue_length)):
+        return
+    try:
+        with open(f"/sys/class/net/{dev}/tx_queue_len", "w") as f:
+            f.write(str(length))
+    except OSError as e:
+        logging.warning("Could not set the tx queue length of %s to %s: %r", dev, length, e)
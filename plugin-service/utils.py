@@ -4,18 +4,27 @@ import ipaddress
 import json
 import logging
 import math
+import os
 import re
+import select
+import signal
 import socket
 import struct
 import subprocess
 import threading
 import time
-from typing import Any
-from urllib import request
+from typing import TYPE_CHECKING, Any, Callable
 from weakref import WeakSet
 
 import netifaces
 
+from . import supervisor, tracing
+from .logs import DaemonLog, DetachedOutput
+from .netlink import RtnetlinkMonitor
+
+if TYPE_CHECKING:
+    from .scope import ConnectionScope
+
 
 def ipv4_to_u32(addr: str | ipaddress.IPv4Address):
     return struct.unpack("I", socket.inet_aton(str(addr)))[0]  # native byte-order
@@ -26,11 +35,105 @@ def ipv6_to_u8_slice(addr: str | ipaddress.IPv6Address):
     return struct.unpack("16B", socket.inet_pton(socket.AF_INET6, str(addr)))
 
 
+class Cancelled(Exception):
+    """Raised by the waits of a start step whose CancelToken got cancelled."""
+
+
+class CancelToken:
+    """
+    Cancellation of one connect attempt, threaded through the start steps of the providers.
+
+    cancel() (from any thread) wakes up the waits given the token right away: timeout.sleep(), wait_for_interface()
+    (its fileno() is selectable), and stops the processes of Subprocess.check_output()/bg_process(). complete() marks
+    the attempt as done: a later cancel() does not interrupt anything anymore.
+    """
+
+    def __init__(self) -> None:
+        self.reason: str = None
+        self._event = threading.Event()
+        self._lock = threading.Lock()
+        self._completed = False
+        self._callbacks: list[Callable[[], None]] = []
+        self._pipe: tuple[int, int] = None
+
+    @property
+    def cancelled(self) -> bool:
+        return self._event.is_set()
+
+    @property
+    def completed(self) -> bool:
+        """complete() was called before any cancel()."""
+        return self._completed
+
+    def cancel(self, reason: str) -> bool:
+        """Whether this interrupted the attempt: False if it was cancelled or completed already."""
+        with self._lock:
+            if self._event.is_set():
+                return False
+            self.reason = reason
+            self._event.set()
+            if self._pipe:
+                os.write(self._pipe[1], b"\0")
+            callbacks, self._callbacks = self._callbacks, []
+        for callback in callbacks:
+            try:
+                callback()
+            except Exception as e:
+                logging.exception("Cancel callback failed: %r", e)
+        return not self._completed
+
+    def complete(self):
+        """Raises Cancelled if it got cancelled before."""
+        with self._lock:
+            if not self._event.is_set():
+                self._completed = True
+                self._callbacks.clear()
+                return
+        raise Cancelled(self.reason)
+
+    def raise_if_cancelled(self):
+        if self._event.is_set():
+            raise Cancelled(self.reason)
+
+    def wait(self, timeout_sec: float) -> bool:
+        """Sleeps for `timeout_sec`. True if cancelled."""
+        return self._event.wait(timeout_sec)
+
+    def on_cancel(self, callback: Callable[[], None]) -> Callable[[], None]:
+        """Calls `callback()` once cancelled, right away if it is. Returns a function removing it."""
+        with self._lock:
+            if not self._event.is_set():
+                self._callbacks.append(callback)
+                return lambda: self._remove_callback(callback)
+        callback()
+        return lambda: None
+
+    def _remove_callback(self, callback):
+        with self._lock:
+            with contextlib.suppress(ValueError):
+                self._callbacks.remove(callback)
+
+    def fileno(self) -> int:
+        """Becomes readable once cancelled, eg: for select()."""
+        with self._lock:
+            if not self._pipe:
+                self._pipe = os.pipe2(os.O_CLOEXEC | os.O_NONBLOCK)
+                if self._event.is_set():
+                    os.write(self._pipe[1], b"\0")
+            return self._pipe[0]
+
+    def __del__(self):
+        if self._pipe:
+            os.close(self._pipe[0])
+            os.close(self._pipe[1])
+
+
 class timeout:
-    def __init__(self, timeout_sec=0, description=None) -> None:
+    def __init__(self, timeout_sec=0, description=None, cancel: CancelToken = None) -> None:
         self.timeout_sec = timeout_sec
         self.starttime = None
         self.description = description or f"After {timeout_sec}s"
+        self.cancel = cancel
         self._sleep_orginal = time.sleep
 
     @property
@@ -57,21 +160,66 @@ class timeout:
     def sleep(self, sec):
         if self.timedout:
             raise TimeoutError(self.description)
-        self._sleep_orginal(sec)
+        if not self.cancel:
+            self._sleep_orginal(sec)
+        elif self.cancel.wait(sec):
+            raise Cancelled(self.cancel.reason)
 
     def __enter__(self):
         if self.starttime:
             raise RuntimeError("Timer aleady started")
 
         self.starttime = time.time()
+        self._trace_start_us = tracing.now_us()
         return self
 
     def __exit__(self, exc_type, value, traceback):
+        tracing.record(f"wait: {self.description}", self._trace_start_us, timedout=exc_type is TimeoutError)
         self.starttime = time.time()
         self.clear()
 
 
-class Subprocess(subprocess.Popen):
+class SupervisedProcess:
+    """Exit notification through a pidfd watched by the main loop, see supervisor.py."""
+
+    pidfd: int = None
+
+    def _supervise(self, pidfd: int | None):
+        self.pidfd = pidfd
+        # set once we asked it to exit, its exit is expected from then on
+        self.stopping = False
+        self._exit_callbacks: list[Callable] = []
+        self._exit_notified = False
+        self._exit_lock = threading.Lock()
+        supervisor.watch(self)
+
+    def on_exit(self, callback: Callable[[Any], None]):
+        """Calls `callback(process)` on the main loop when it exits. Never without a main loop."""
+        with self._exit_lock:
+            if not self._exit_notified:
+                self._exit_callbacks.append(callback)
+                return
+        supervisor.call_soon(lambda: callback(self))
+
+    def notify_exit(self):
+        with self._exit_lock:
+            self._exit_notified = True
+            callbacks, self._exit_callbacks = self._exit_callbacks, []
+        for callback in callbacks:
+            callback(self)
+
+    def _wait_pidfd(self, timeout) -> bool:
+        """False if still running after `timeout` seconds."""
+        return bool(select.select([self.pidfd], [], [], timeout)[0])
+
+    def _close_pidfd(self):
+        # on finalization only: a watched process is referenced by its watch
+        if self.pidfd is not None:
+            os.close(self.pidfd)
+            self.pidfd = None
+
+
+class Subprocess(SupervisedProcess, subprocess.Popen):
     _refs = WeakSet()
 
     DEFAULT_GRACEFUL_EXIT_TIMEOUT = 3
@@ -80,13 +228,53 @@ class Subprocess(subprocess.Popen):
     def is_running(self):
         return self.poll() is None
 
-    def __init__(self, *args, name=None, **kwargs):
+    def __init__(
+        self, *args, name=None, output: DaemonLog | DetachedOutput = None, scope: "ConnectionScope" = None, **kwargs
+    ):
+        """`output`: captures stdout and stderr, see logs.py. `scope`: the resource controls of a daemon, see scope.py."""
         logging.debug("Exec() %s", args[0])
-        super().__init__(*args, **kwargs)
+        self._trace_spawn_us = tracing.now_us()
+        self._trace_exited = False
+        if output:
+            kwargs.update(stdout=output.write_fd, stderr=output.write_fd)
+        try:
+            super().__init__(*args, **kwargs)
+        finally:
+            if output:
+                output.start()
         Subprocess._refs.add(self)
         self.name = self.args[0] if name is None else name
         self.started_time = time.time()
         self.gracefully_killed = None
+        if scope:
+            scope.attach(self.pid)
+        try:
+            pidfd = os.pidfd_open(self.pid)
+        except OSError as e:  # eg: kernel < 5.3, exits are noticed by polling
+            logging.debug("pidfd_open(%d) failed: %r", self.pid, e)
+            pidfd = None
+        self._supervise(pidfd)
+        tracing.record(f"spawn: {self.name}", self._trace_spawn_us, pid=self.pid)
+
+    def __del__(self, *args, **kwargs):
+        self._close_pidfd()
+        super().__del__(*args, **kwargs)
+
+    def poll(self):
+        return self._traced_exit(super().poll())
+
+    def wait(self, timeout=None):
+        # Popen.wait(timeout) polls with sleeps, the pidfd becomes readable as soon as the process exits
+        if timeout is not None and self.pidfd is not None and self.returncode is None:
+            if not self._wait_pidfd(timeout) and self.poll() is None:
+                raise subprocess.TimeoutExpired(self.args, timeout)
+        return self._traced_exit(super().wait(timeout))
+
+    def _traced_exit(self, returncode):
+        if returncode is not None and not self._trace_exited:
+            self._trace_exited = True
+            tracing.record(f"process: {self.name}", self._trace_spawn_us, pid=self.pid, ec=returncode)
+        return returncode
 
     def __repr__(self) -> str:
         r = f"Proc({self.pid}) {self.name}"
@@ -97,6 +285,7 @@ class Subprocess(subprocess.Popen):
     def graceful_kill(self, graceful_exit_timeout=None):
         if graceful_exit_timeout is None:
             graceful_exit_timeout = Subprocess.DEFAULT_GRACEFUL_EXIT_TIMEOUT
+        self.stopping = True
         if ec := self.poll():
             logging.warn("Process already exited %r", self)
             return ec
@@ -116,53 +305,80 @@ class Subprocess(subprocess.Popen):
             self.gracefully_killed = True
             logging.warn("Exited %r", self)
 
+    def stop_async(self, graceful_exit_timeout=None):
+        """graceful_kill() without waiting: SIGTERM now, SIGKILL on a timer if it is still running by then."""
+        if graceful_exit_timeout is None:
+            graceful_exit_timeout = Subprocess.DEFAULT_GRACEFUL_EXIT_TIMEOUT
+        self.stopping = True
+        if self.poll() is not None:
+            return
+        logging.warn("Terminating %r", self)
+        self.terminate()
+        self.gracefully_killed = True
+
+        def _escalate():
+            if self.poll() is None:
+                logging.warn("%r sigterm timeout. send kill signal", self)
+                self.kill()
+
+        timer = supervisor.call_later(graceful_exit_timeout, _escalate)
+        self.on_exit(lambda _: timer.cancel())
+
     @staticmethod
     @contextlib.contextmanager
-    def bg_process(*popenargs, name=None, process_timeout=None, graceful_exit_timeout=None, **kwargs):
+    def bg_process(
+        *popenargs, name=None, process_timeout=None, graceful_exit_timeout=None, cancel: CancelToken = None, **kwargs
+    ):
+        """
+        Runs a process for the duration of the block. It is stopped after `process_timeout` seconds by a timer, or
+        as soon as `cancel` is cancelled, which ends the caller's reads of its output. Raises Cancelled after the
+        block in the latter case.
+        """
         if graceful_exit_timeout is None:
             graceful_exit_timeout = Subprocess.DEFAULT_GRACEFUL_EXIT_TIMEOUT
-        _proc_called = threading.Event()
-        _proc: Subprocess = None
-
-        def _run():
-            nonlocal _proc_called
-            nonlocal _proc
+        if cancel:
+            cancel.raise_if_cancelled()
+        with Subprocess(popenargs, name=name, **kwargs) as p:
+            deadline = None
+            if process_timeout is not None:
+                deadline = supervisor.call_later(process_timeout, lambda: p.stop_async(graceful_exit_timeout))
+                p.on_exit(lambda _: deadline.cancel())
+            remove_cancel = cancel.on_cancel(lambda: p.stop_async(graceful_exit_timeout)) if cancel else None
             try:
-                with Subprocess(popenargs, name=name, **kwargs) as p:
-                    _proc = p
-                    _proc_called.set()
-                    try:
-                        p.wait(timeout=process_timeout)
-                    except:  # Including KeyboardInterrupt, wait handled that.
-                        p.graceful_kill(graceful_exit_timeout)
-                        raise
-            except Exception as e:
-                _proc.__error = e
+                yield p
             finally:
-                _proc_called = True
-
-        try:
-            t = threading.Thread(target=_run, args=())
-            t.start()
-            _proc_called.wait(1)
-            err = getattr(_proc, "__error", None)
-            if err is not None:
-                raise err
-            yield _proc
-        finally:
-            if _proc and _proc.is_running:
-                _proc.graceful_kill(graceful_exit_timeout)
-            t.join(1)
+                if remove_cancel:
+                    remove_cancel()
+                if deadline:
+                    deadline.cancel()
+                if p.is_running and not p.stopping:
+                    p.graceful_kill(graceful_exit_timeout)
+        if cancel:
+            cancel.raise_if_cancelled()
 
     @staticmethod
-    def check_output(*popenargs, name=None, input="", process_timeout=None, graceful_exit_timeout=None, **kwargs):
+    def check_output(
+        *popenargs,
+        name=None,
+        input="",
+        process_timeout=None,
+        graceful_exit_timeout=None,
+        cancel: CancelToken = None,
+        **kwargs,
+    ):
         with Subprocess(popenargs, name=name, **kwargs, stdin=subprocess.PIPE, stdout=subprocess.PIPE) as p:
+            remove_cancel = cancel.on_cancel(lambda: p.stop_async(graceful_exit_timeout)) if cancel else None
             try:
                 stdout, stderr = p.communicate(input, timeout=process_timeout)
             except:  # Including KeyboardInterrupt, communicate handled that.
                 p.graceful_kill(graceful_exit_timeout)
                 # We don't call process.wait() as .__exit__ does that for us.
                 raise
+            finally:
+                if remove_cancel:
+                    remove_cancel()
+            if cancel:
+                cancel.raise_if_cancelled()
             retcode = p.poll()
             if retcode:
                 logging.error("Process %r failed with exit code %d| stdout=%s stderr=%s", p, retcode, stdout, stderr)
@@ -170,12 +386,15 @@ class Subprocess(subprocess.Popen):
         return stdout
 
     @staticmethod
-    def check_output_json(*popenargs, name=None, process_timeout=None, graceful_exit_timeout=None, **kwargs) -> Any:
+    def check_output_json(
+        *popenargs, name=None, process_timeout=None, graceful_exit_timeout=None, cancel: CancelToken = None, **kwargs
+    ) -> Any:
         stdout = Subprocess.check_output(
             *popenargs,
             name=name,
             process_timeout=process_timeout,
             graceful_exit_timeout=graceful_exit_timeout,
+            cancel=cancel,
             **kwargs,
         )
         try:
@@ -185,16 +404,24 @@ class Subprocess(subprocess.Popen):
             raise
 
     @staticmethod
-    def check_output_text(*popenargs, name=None, process_timeout=None, graceful_exit_timeout=None, **kwargs) -> str:
+    def check_output_text(
+        *popenargs, name=None, process_timeout=None, graceful_exit_timeout=None, cancel: CancelToken = None, **kwargs
+    ) -> str:
         stdout = Subprocess.check_output(
             *popenargs,
             name=name,
             process_timeout=process_timeout,
             graceful_exit_timeout=graceful_exit_timeout,
+            cancel=cancel,
             **kwargs,
         )
         return stdout.decode("utf-8", errors="replace")
 
+    def detach(self):
+        """Leaves the process running when this service exits, eg: handed over to another service process."""
+        Subprocess._refs.discard(self)
+        supervisor.unwatch(self)
+
     @atexit.register
     @staticmethod
     def _cleanup():
@@ -204,6 +431,72 @@ class Subprocess(subprocess.Popen):
                 p.graceful_kill(Subprocess.DEFAULT_GRACEFUL_EXIT_TIMEOUT)
 
 
+def process_start_time(pid: int) -> int:
+    """Start time of `pid` in clock ticks since boot; with the pid, identifies a process across pid reuse."""
+    with open(f"/proc/{pid}/stat") as f:
+        return int(f.read().rsplit(")", 1)[1].split()[19])
+
+
+class AdoptedProcess(SupervisedProcess):
+    """
+    A daemon started by another service process and taken over by this one. It is not our child, so its exit is
+    observed through a pidfd and its exit code is unknown (-1).
+    """
+
+    def __init__(self, pid: int, start_time: int, name: str) -> None:
+        self.pid = pid
+        self.name = name
+        self.returncode = None
+        self.gracefully_killed = None
+        pidfd = os.pidfd_open(pid)
+        if process_start_time(pid) != start_time:  # pid got reused
+            os.close(pidfd)
+            raise ProcessLookupError(f"{name}({pid}) is not running")
+        self._supervise(pidfd)
+
+    def __del__(self):
+        self._close_pidfd()
+
+    @property
+    def is_running(self):
+        return self.poll() is None
+
+    def poll(self):
+        return self.wait(0)
+
+    def wait(self, timeout=None):
+        if self.returncode is None and self._wait_pidfd(timeout):
+            self.returncode = -1
+        return self.returncode
+
+    def __repr__(self) -> str:
+        r = f"Proc({self.pid}) {self.name} adopted"
+        if self.returncode is not None:
+            r += " exited"
+        return f"<{r}>"
+
+    def send_signal(self, sig: int):
+        if self.poll() is None:
+            signal.pidfd_send_signal(self.pidfd, sig)
+
+    def graceful_kill(self, graceful_exit_timeout=None):
+        if graceful_exit_timeout is None:
+            graceful_exit_timeout = Subprocess.DEFAULT_GRACEFUL_EXIT_TIMEOUT
+        self.stopping = True
+        if self.poll() is not None:
+            logging.warn("Process already exited %r", self)
+            return self.returncode
+        logging.warn("Terminating %r", self)
+        signal.pidfd_send_signal(self.pidfd, signal.SIGTERM)
+        if self.wait(graceful_exit_timeout) is None:
+            logging.warn("%r sigterm timeout. send kill signal", self)
+            signal.pidfd_send_signal(self.pidfd, signal.SIGKILL)
+            self.wait()
+        self.gracefully_killed = True
+        logging.warn("Exited %r", self)
+        return self.returncode
+
+
 def set_proc_name(name: str):
     import ctypes
 
@@ -234,6 +527,169 @@ def is_interface_ready(iface: str, check_for_address=True):
     return None
 
 
+def wait_for_interface(
+    dev: str,
+    process,
+    timeout_sec: float,
+    on_link: Callable[[], None] = None,
+    poll_interval_sec=2,
+    cancel: CancelToken = None,
+):
+    """
+    Waits until `dev` exists and has an address, calling `on_link()` as soon as it exists.
+    Woken up by rtnetlink events, the exit of `process` and `cancel`, so all are noticed right away;
+    `poll_interval_sec` is the polling fallback.
+    """
+    monitor = RtnetlinkMonitor.open()
+    linked = False
+    try:
+        with timeout(timeout_sec, description=f"Wait for interface: {dev}", cancel=cancel) as t:
+            while True:
+                if cancel:
+                    cancel.raise_if_cancelled()
+                ready = is_interface_ready(dev)
+                if ready is not None and not linked:
+                    linked = True
+                    if on_link:
+                        on_link()
+                if ready:
+                    return
+                if not process.is_running:
+                    raise RuntimeError(f"{process.name} exited prematurely")
+                if not monitor:
+                    t.sleep(poll_interval_sec)
+                    continue
+                if t.timedout:
+                    raise TimeoutError(t.description)
+                waitables = [monitor] if process.pidfd is None else [monitor, process.pidfd]
+                if cancel:
+                    waitables.append(cancel)
+                select.select(waitables, [], [], min(poll_interval_sec, t.remaining))
+                monitor.drain()
+    finally:
+        if monitor:
+            monitor.close()
+
+
+def get_iface_mtu(iface: str) -> int | None:
+    try:
+        with open(f"/sys/class/net/{iface}/mtu") as f:
+            return int(f.read())
+    except (OSError, ValueError):
+        return None
+
+
+def probe_path_mtu(host: str, dev: str, max_mtu: int, cancel: CancelToken = None, reply_timeout_sec=1) -> int | None:
+    """
+    Largest packet (IP header included, up to `max_mtu`) reaching `host` through `dev` unfragmented: bisection with
+    `ping -M do`, whose echoes have the DF bit set. An oversized echo is lost, or refused with EMSGSIZE once an
+    ICMP "fragmentation needed" lowered the route's PMTU. None if `host` does not reply to the smallest one.
+    """
+    version = ipaddress.ip_address(host).version
+    overhead, lowest = (28, 576) if version == 4 else (48, 1280)  # IP + ICMP headers, the minimum MTU
+
+    def fits(mtu: int) -> bool:
+        cmd = ["ping", f"-{version}", "-n", "-q", "-c", "2", "-i", "0.2", "-W", str(reply_timeout_sec)]
+        cmd.extend(("-M", "do", "-s", str(mtu - overhead), "-I", dev, host))
+        with Subprocess(cmd, name="ping", stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL) as p:
+            remove_cancel = cancel.on_cancel(p.kill) if cancel else None
+            try:
+                ec = p.wait()
+            finally:
+                if remove_cancel:
+                    remove_cancel()
+        if cancel:
+            cancel.raise_if_cancelled()
+        logging.debug("Path MTU probe to %s: %d %s", host, mtu, "fits" if ec == 0 else "does not fit")
+        return ec == 0
+
+    if max_mtu < lowest or not fits(lowest):
+        return None
+    low, high = lowest, max_mtu
+    while low < high:
+        mid = (low + high + 1) // 2
+        if fits(mid):
+            low = mid
+        else:
+            high = mid - 1
+    return low
+
+
+def run_concurrently(**steps: Callable[[], Any]) -> dict[str, Any]:
+    """Runs independent steps in parallel threads. Returns their results by name, raises the first failure."""
+    results: dict[str, Any] = {}
+    errors: list[BaseException] = []
+
+    def _run(name, fn):
+        try:
+            with tracing.span(f"step: {name}"):
+                results[name] = fn()
+        except BaseException as e:
+            errors.append(e)
+
+    threads = [threading.Thread(target=_run, args=item, name=f"step-{item[0]}") for item in steps.items()]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    if errors:
+        raise errors[0]
+    return results
+
+
+def write_file_atomic(path: str, data: bytes, mode: int = 0o644):
+    """Readers of `path` see either the previous content or `data`, never a partial write."""
+    tmp = f"{path}.tmp"
+    fd = os.open(tmp, os.O_WRONLY | os.O_CREAT | os.O_TRUNC | os.O_CLOEXEC, mode)
+    try:
+        os.fchmod(fd, mode)  # umask
+        os.write(fd, data)
+    finally:
+        os.close(fd)
+    os.replace(tmp, path)
+
+
+class RenderedFiles:
+    """
+    Generated files of a config directory. write() only (atomically) writes the files whose content or mode changed
+    since the previous write(), by their digests kept in `<directory>/.rendered.json`, and removes the files it
+    generated before but not anymore.
+    """
+
+    def __init__(self, directory: str) -> None:
+        self.directory = directory
+        self._manifest_file = os.path.join(directory, ".rendered.json")
+        try:
+            with open(self._manifest_file) as f:
+                self._digests: dict[str, list] = json.load(f)
+        except (OSError, ValueError):
+            self._digests = {}
+
+    def write(self, files: dict[str, tuple[str, int]]) -> set[str]:
+        """`files`: relative path -> (content, mode). Returns the paths written or removed."""
+        import hashlib
+
+        changed = set()
+        digests = {}
+        for rel_path, (content, mode) in files.items():
+            data = content.encode("utf-8")
+            digests[rel_path] = [hashlib.blake2b(data, digest_size=16).hexdigest(), mode]
+            path = os.path.join(self.directory, rel_path)
+            if self._digests.get(rel_path) == digests[rel_path] and os.path.exists(path):
+                continue
+            os.makedirs(os.path.dirname(path), exist_ok=True)
+            write_file_atomic(path, data, mode)
+            changed.add(rel_path)
+        for rel_path in self._digests.keys() - digests.keys():
+            with contextlib.suppress(FileNotFoundError):
+                os.unlink(os.path.join(self.directory, rel_path))
+            changed.add(rel_path)
+        if changed or digests != self._digests:
+            write_file_atomic(self._manifest_file, json.dumps(digests).encode("utf-8"), 0o600)
+            self._digests = digests
+        return changed
+
+
 def iter_until(fn, sentinal_value, sentinal_error):
     while True:
         try:
@@ -245,34 +701,49 @@ def iter_until(fn, sentinal_value, sentinal_error):
             return e
 
 
-def http_rquest(method, url, data, headers=None, timeout=10):
-    headers = headers or {}
-    if isinstance(data, (dict, list, tuple)):
-        data = json.dumps(data).encode("utf-8")
-        headers["Content-Type"] = "application/json"
-    elif isinstance(data, str):
-        data = data.encode("utf-8")
-    req = request.Request(url, method=method, data=data, headers=headers)
-    try:
-        with request.urlopen(req, timeout=timeout) as r:
-            resp = r
-            return r.read().decode("utf-8")
-    except request.HTTPError as e:
-        resp = e
-        logging.error(
-            "HTTP Error - Response:%r | Headers:%r", resp.read().decode("utf-8", errors="replace"), dict(resp.headers)
-        )
-        raise
-    finally:
-        logging.debug(
-            "http_rquest(%s %s d=%r h=%r) -> (code=%s h=%r",
-            method,
-            url,
-            data,
-            headers,
-            resp.status if resp else None,
-            dict(resp.headers) if resp else None,
-        )
+class JSONStreamDecoder:
+    """
+    Incremental decoder of a stream of concatenated (eg: pretty printed) JSON objects/arrays, like `tailscale up --json`.
+    Every fed character is scanned once; text outside of top-level objects/arrays is skipped.
+    """
+
+    def __init__(self) -> None:
+        self._buf: list[str] = []
+        self._depth = 0
+        self._in_string = False
+        self._escaped = False
+
+    def feed(self, text: str):
+        """Yields the values completed by `text`."""
+        for c in text:
+            if self._depth == 0:
+                if c not in "{[":
+                    continue
+                self._buf.clear()
+            self._buf.append(c)
+            if self._in_string:
+                if self._escaped:
+                    self._escaped = False
+                elif c == "\\":
+                    self._escaped = True
+                elif c == '"':
+                    self._in_string = False
+            elif c == '"':
+                self._in_string = True
+            elif c in "{[":
+                self._depth += 1
+            elif c in "}]":
+                self._depth -= 1
+                if self._depth == 0:
+                    try:
+                        yield json.loads("".join(self._buf))
+                    except json.JSONDecodeError as e:
+                        logging.warning("Skipping invalid JSON in stream: %r", e)
+
+    @property
+    def pending(self) -> str:
+        """Incomplete value, if any."""
+        return "".join(self._buf) if self._depth else ""
 
 
 def ip_interface_addresses_by_family(addrs):
@@ -306,6 +777,17 @@ def get_iface_addresses(iface: str, ipv4=True, ipv6=True) -> list[ipaddress.IPv4
     return addresses
 
 
+def get_iface_addresses_by_family(iface: str):
+    """First IPv4 and first non link-local IPv6 address of the interface."""
+    ipv4, ipv6 = None, None
+    for a in get_iface_addresses(iface):
+        if a.version == 4 and not ipv4:
+            ipv4 = a
+        elif a.version == 6 and not ipv6 and not a.is_link_local:
+            ipv6 = a
+    return ipv4, ipv6
+
+
 def get_network_interfaces_by_ip(ip: AnyIPAddr | str) -> list[str]:
     try:
         addr = ipaddress.ip_address(ip)
@@ -0,0 +1,197 @@
+import logging
+import os
+import select
+import threading
+import time
+from typing import Callable
+
+from .common import ConnectionResult, VPNConnectionControlBase
+from .netlink import RtnetlinkMonitor, if_nametoindex
+
+
+class ConnectionWatcher(threading.Thread):
+    """
+    Keeps the configuration of a running connection up to date.
+
+    Wakes up every `ctl.refresh_interval_sec`, or as soon as rtnetlink reports a link/address/route change on the
+    tun device, asks the provider for its current state and hands it to `on_update`.
+    `on_update` is called at most once per `min_update_interval_sec`; the caller decides whether anything changed.
+    """
+
+    min_update_interval_sec = 5
+    _netlink_settle_sec = 0.5
+
+    def __init__(
+        self,
+        ctl: VPNConnectionControlBase,
+        result: ConnectionResult,
+        on_update: Callable[[ConnectionResult], None],
+    ) -> None:
+        super().__init__(name="connection-watcher", daemon=True)
+        self.ctl = ctl
+        self.result = result
+        self.on_update = on_update
+        # of the tun device, resolved once: matched against every rtnetlink event (None: any)
+        self._ifindex = if_nametoindex(result.dev) if result.dev else None
+        self._stopped = threading.Event()
+        self._wakeup_r, self._wakeup_w = os.pipe()  # interrupts select() on stop()
+        self._last_update_time = time.monotonic()
+
+    def stop(self):
+        if self._stopped.is_set():
+            return
+        self._stopped.set()
+        os.write(self._wakeup_w, b"\0")
+        if self.is_alive() and threading.current_thread() is not self:
+            self.join(1)
+        if not self.is_alive():
+            os.close(self._wakeup_r)
+            os.close(self._wakeup_w)
+
+    def run(self):
+        monitor = RtnetlinkMonitor.open()
+        try:
+            self._loop(monitor)
+        except Exception as e:
+            logging.exception("Connection watcher failed: %r", e)
+        finally:
+            if monitor:
+                monitor.close()
+
+    def _loop(self, monitor: RtnetlinkMonitor | None):
+        interval = self.ctl.refresh_interval_sec
+        logging.debug("Watching connection: dev=%s interval=%ss netlink=%s", self.result.dev, interval, bool(monitor))
+        next_poll = time.monotonic() + interval
+        while not self._stopped.is_set():
+            wait_sec = max(0.0, next_poll - time.monotonic())
+            if monitor:
+                readable, _, _ = select.select([monitor, self._wakeup_r], [], [], wait_sec)
+                if self._stopped.is_set():
+                    return
+                if readable:
+                    if not monitor.drain(self._ifindex):
+                        continue
+                    # a single address/route change is usually followed by a burst of related messages.
+                    if self._stopped.wait(self._netlink_settle_sec):
+                        return
+                    monitor.drain()
+            elif self._stopped.wait(wait_sec):
+                return
+
+            holdoff = self._last_update_time + self.min_update_interval_sec - time.monotonic()
+            if holdoff > 0 and self._stopped.wait(holdoff):
+                return
+            next_poll = time.monotonic() + interval
+            self._refresh()
+
+    def _refresh(self):
+        _refresh(self, self._stopped.is_set)
+
+
+def _refresh(watcher: "ConnectionWatcher | PooledWatcher", stopped: Callable[[], bool]):
+    try:
+        result = watcher.ctl.refresh(watcher.result)
+    except Exception as e:
+        logging.warning("Could not refresh connection state: %r", e)
+        return
+    if result is None or stopped():
+        return
+    watcher._last_update_time = time.monotonic()
+    watcher.result = result
+    watcher.on_update(result)
+
+
+class PooledWatcher:
+    """A ConnectionWatcher of a WatcherPool."""
+
+    min_update_interval_sec = ConnectionWatcher.min_update_interval_sec
+
+    def __init__(
+        self,
+        pool: "WatcherPool",
+        ctl: VPNConnectionControlBase,
+        result: ConnectionResult,
+        on_update: Callable[[ConnectionResult], None],
+    ) -> None:
+        self.pool = pool
+        self.ctl = ctl
+        self.result = result
+        self.on_update = on_update
+        # of the tun device, resolved once: every rtnetlink event of the pool is matched against it (None: any)
+        self.ifindex = if_nametoindex(result.dev) if result.dev else None
+        self.stopped = False
+        self._last_update_time = time.monotonic()
+        self.next_poll = self._last_update_time + ctl.refresh_interval_sec
+
+    def start(self):
+        self.pool.add(self)
+
+    def stop(self):
+        self.stopped = True
+        self.pool.remove(self)
+
+    def changed(self, now: float):
+        """rtnetlink reported a change on the tun device: refresh soon, see ConnectionWatcher."""
+        settled = now + ConnectionWatcher._netlink_settle_sec
+        self.next_poll = min(self.next_poll, max(settled, self._last_update_time + self.min_update_interval_sec))
+
+    def poll(self):
+        self.next_poll = time.monotonic() + self.ctl.refresh_interval_sec
+        _refresh(self, lambda: self.stopped)
+
+
+class WatcherPool(threading.Thread):
+    """
+    ConnectionWatchers of the many connections of a service host (see host.py) in one thread, with one rtnetlink
+    subscription. Their refreshes run one after the other.
+    """
+
+    def __init__(self) -> None:
+        super().__init__(name="connection-watchers", daemon=True)
+        self._watchers: set[PooledWatcher] = set()
+        self._lock = threading.Lock()
+        self._wakeup_r, self._wakeup_w = os.pipe()
+
+    def watcher(
+        self, ctl: VPNConnectionControlBase, result: ConnectionResult, on_update: Callable[[ConnectionResult], None]
+    ) -> PooledWatcher:
+        return PooledWatcher(self, ctl, result, on_update)
+
+    def add(self, watcher: PooledWatcher):
+        with self._lock:
+            self._watchers.add(watcher)
+            if not self.is_alive():
+                self.start()
+        os.write(self._wakeup_w, b"\0")
+
+    def remove(self, watcher: PooledWatcher):
+        with self._lock:
+            self._watchers.discard(watcher)
+
+    def run(self):
+        monitor = RtnetlinkMonitor.open()
+        while True:
+            try:
+                self._run_once(monitor)
+            except Exception as e:
+                logging.exception("Connection watchers failed: %r", e)
+                time.sleep(1)
+
+    def _run_once(self, monitor: RtnetlinkMonitor | None):
+        with self._lock:
+            watchers = list(self._watchers)
+        now = time.monotonic()
+        for watcher in sorted(watchers, key=lambda w: w.next_poll):
+            if watcher.next_poll <= now and not watcher.stopped:
+                watcher.poll()
+        with self._lock:
+            wait_sec = min((w.next_poll for w in self._watchers), default=now + 3600) - time.monotonic()
+        readable, _, _ = select.select([self._wakeup_r] + ([monitor] if monitor else []), [], [], max(0.0, wait_sec))
+        if self._wakeup_r in readable:
+            os.read(self._wakeup_r, 4096)
+        if monitor in readable:
+            changed = monitor.drain_ifindexes()
+            now = time.monotonic()
+            for watcher in watchers:
+                if watcher.ifindex is None or None in changed or watcher.ifindex in changed:
+                    watcher.changed(now)
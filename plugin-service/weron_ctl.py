@@ -1,15 +1,16 @@
 import ipaddress
 import logging
-import sys
 
+from . import tuning
 from .common import ConnectionResult, VPNConnectionControlBase
+from .logs import DaemonLog
 from .utils import (
     Subprocess,
     find_valid_if_name,
-    get_iface_addresses,
+    get_iface_addresses_by_family,
+    get_iface_mtu,
     getter,
-    is_interface_ready,
-    timeout,
+    wait_for_interface,
 )
 
 
@@ -20,16 +21,11 @@ class WeronControl(VPNConnectionControlBase):
 
     def start(self, *, connection_uuid: str, connection_name: str, vpn_data: dict[str, str]):
         dev = self._run_weron(connection_name, vpn_data)
-        ipv4, ipv6 = None, None
-        for a in get_iface_addresses(dev):
-            if a.version == 4:
-                ipv4 = a
-            else:
-                ipv6 = a
+        ipv4, ipv6 = get_iface_addresses_by_family(dev)
         return ConnectionResult(
             ipv4=ipv4,
             ipv6=ipv6,
-            # mtu=mtu,
+            mtu=get_iface_mtu(dev),
             # dns=dns,
             dev=dev,
             gateway=ipaddress.IPv4Address("255.255.255.255"),  # dummy
@@ -63,17 +59,29 @@ class WeronControl(VPNConnectionControlBase):
             weron_cmd.extend(("--ice", ice))
         if verbose := vpn_data_get("verbose"):
             weron_cmd.extend(("--verbose", verbose))
+        weron_cmd.extend(("--parallel", str(tuning.resolve(vpn_data, "parallel", tuning.workers))))
 
-        stderr = sys.stderr
-        if log_file := vpn_data_get("log-file"):
-            stderr = open(log_file, "wb+")
         logging.info("Run weron: %r", weron_cmd)
-        self._proc_weron = Subprocess(weron_cmd, name="weron", stderr=stderr)
+        self._proc_weron = Subprocess(
+            weron_cmd, name="weron", output=DaemonLog("weron", vpn_data_get("log-file")), scope=self.scope
+        )
+        self._proc_weron.on_exit(self.service.daemon_exited)
+
+        def announce():
+            if mode == "ip":  # addresses of ethernet mode are not known upfront
+                versions = {
+                    ipaddress.ip_interface(ip.strip()).version for ip in vpn_data["ips"].split(",") if ip.strip()
+                }
+                self.service.announce_device(dev, has_ipv4=4 in versions, has_ipv6=6 in versions)
 
-        with timeout(self._ready_timeout_sec, description=f"Wait for interface: {dev}") as t:
-            while not is_interface_ready(dev):
-                if not self._proc_weron.is_running:
-                    raise RuntimeError("weron cmd exited prematurely")
-                t.sleep(self._ready_check_interval_sec)
+        wait_for_interface(
+            dev,
+            self._proc_weron,
+            self._ready_timeout_sec,
+            on_link=announce,
+            poll_interval_sec=self._ready_check_interval_sec,
+            cancel=self.cancel,
+        )
+        tuning.set_tx_queue_length(dev, vpn_data)
 
         return dev
@@ -1,23 +1,55 @@
+import http.client
 import ipaddress
 import json
 import logging
+import os
+import threading
+from dataclasses import replace
 
-from .common import ConnectionResult, VPNConnectionControlBase
+from . import tracing, tuning
+from .common import ConnectionResult, ServiceBase, VPNConnectionControlBase
+from .httpclient import KeepAliveHTTPClient, http_rquest
 from .utils import (
     Subprocess,
     getter,
-    http_rquest,
     ip_interface_addresses_by_family,
+    run_concurrently,
     timeout,
 )
 
 
 class ZeroTierControl(VPNConnectionControlBase):
+    refresh_interval_sec = 10
+    supports_standby = True
     _status_check_interval_sec = 2
+    _api_status_check_interval_sec = 0.2
     _join_timeout_sec = 30
     _cli_invoke_timeout_sec = 30
+    _local_api: KeepAliveHTTPClient = None
+    # only used for a later ACCESS_DENIED; the rest (eg: network-id, primary-port) is another network or daemon
+    live_settings = frozenset({"api-token"})
+
+    def __init__(self, service: ServiceBase, state_home_dir: str) -> None:
+        super().__init__(service, state_home_dir)
+        self._local_api_lock = threading.Lock()  # of this connection: the sessions of a service host run concurrently
 
     def start(self, *, connection_uuid: str, connection_name: str, vpn_data: dict[str, str]):
+        self._init(vpn_data)
+
+        # independent of each other; in parallel, the cli invocations of the fallback cost one process start-up
+        steps = run_concurrently(version=self._version, join=lambda: self._join(self.network_id), info=self._info)
+        logging.info("Zerotier version: %s", steps["version"])
+        state = steps["join"]
+        logging.info("Join state: %s", state)
+        member_info = steps["info"]
+        logging.debug("Member info: %s", member_info)
+        self.member_id = member_info["address"]
+        result = self._wait_for_network(state)
+        # the device outlives a standby of the network, resume() has nothing to re-apply
+        tuning.set_tx_queue_length(result.dev, vpn_data)
+        return result
+
+    def _init(self, vpn_data: dict[str, str]):
         vpn_data_get = getter(vpn_data)
         self.network_id = vpn_data_get("network-id")
         if not self.network_id:
@@ -27,15 +59,11 @@ class ZeroTierControl(VPNConnectionControlBase):
         self.service_work_dir = vpn_data_get("service-working-directory") or "/var/lib/zerotier-one"
         self._zerotier_service_cmd = ["zerotier-one"]
         self._zerotier_cli_cmd = ["zerotier-one", "-q", f"-D{self.service_work_dir}", f"-p{self.primray_port}"]
+        self._local_api = self._local_api_client()
 
-        logging.info("Zerotier version: %s", self._cli_version())
-        state = self._cli_join(self.network_id)
-        logging.info("Join state: %s", state)
-        member_info = self._cli_info()
-        logging.debug("Member info: %s", member_info)
-        self.member_id = member_info["address"]
+    def _wait_for_network(self, state):
         has_found_access_denied = False
-        with timeout(self._join_timeout_sec, description="wait for connection OK") as t:
+        with timeout(self._join_timeout_sec, description="wait for connection OK", cancel=self.cancel) as t:
             # [Literal["REQUESTING_CONFIGURATION", "ACCESS_DENIED", "OK"]]
             while state["status"] != "OK":
                 state = self._network_state(self.network_id)
@@ -44,15 +72,17 @@ class ZeroTierControl(VPNConnectionControlBase):
                     has_found_access_denied = True
                     if self.api_token:
                         logging.info("Status is ACCESS_DENIED. Self authorize using given API token")
-                        resp = self._api_authorize_memeber(self.network_id, self.member_id, self.api_token)
+                        with tracing.span("zerotier authorize"):
+                            resp = self._api_authorize_memeber(self.network_id, self.member_id, self.api_token)
                         logging.debug("Self authorize API response: %s", resp)
                     else:
                         self._prompt_auth()
-                t.sleep(self._status_check_interval_sec)
+                t.sleep(self._api_status_check_interval_sec if self._local_api else self._status_check_interval_sec)
 
         ipv4, ipv6 = ip_interface_addresses_by_family(state["assignedAddresses"])
         dns = [ipaddress.ip_address(n) for n in state["dns"]["servers"]]
         mtu = state["mtu"]
+        routes = self._managed_routes(state)
 
         # iface_in_devicemap_file = None
         # try:
@@ -77,14 +107,66 @@ class ZeroTierControl(VPNConnectionControlBase):
             ipv6=ipv6,
             mtu=mtu,
             # dns=dns,
+            routes=routes,
             dev=dev,
             gateway=ipaddress.IPv4Address("255.255.255.255"),  # dummy
         )
 
+    def apply_settings(self, changed: dict[str, str | None], vpn_data: dict[str, str]) -> bool:
+        self.api_token = getter(vpn_data)("api-token")
+        return True
+
+    def standby(self):
+        """Managed addresses and routes are removed from the device, the node stays a member of the network."""
+        self._set_network(self.network_id, allowManaged=False)
+        return {"network_id": self.network_id, "member_id": self.member_id}
+
+    def resume(self, standby_state: dict, *, connection_uuid: str, connection_name: str, vpn_data: dict[str, str]):
+        if not hasattr(self, "network_id"):  # put on standby by another service process
+            self._init(vpn_data)
+            self.member_id = standby_state["member_id"]
+        if self.network_id != standby_state["network_id"]:
+            raise RuntimeError(f"network {standby_state['network_id']} is on standby, not {self.network_id}")
+        return self._wait_for_network(self._set_network(self.network_id, allowManaged=True))
+
+    def refresh(self, current: ConnectionResult):
+        state = self._network_state(self.network_id)
+        if not state or state["status"] != "OK":
+            logging.warning("Network %s state: %s", self.network_id, state and state["status"])
+            return None
+        ipv4, ipv6 = ip_interface_addresses_by_family(state["assignedAddresses"])
+        return replace(
+            current,
+            ipv4=ipv4,
+            ipv6=ipv6,
+            mtu=state["mtu"],
+            routes=self._managed_routes(state),
+            dev=state["portDeviceName"],
+        )
+
+    def _managed_routes(self, state):
+        """
+        Managed routes pushed by the network controller, except the ones already covered by an assigned address.
+        eg: "routes":[{"flags":0,"metric":0,"target":"10.147.17.0/24","via":null}]
+        """
+        if not state.get("allowManaged", True):
+            return ()
+        connected = {ipaddress.ip_interface(a).network for a in state["assignedAddresses"]}
+        routes = set()
+        for r in state.get("routes") or ():
+            net = ipaddress.ip_network(r["target"], strict=False)
+            if net in connected or (not net.prefixlen and not state.get("allowDefault")):
+                continue
+            routes.add(net)
+        return tuple(sorted(routes, key=lambda n: (n.version, n)))
+
     def stop(self):
         if hasattr(self, "network_id"):
-            resp = self._cli_leave(self.network_id)
+            resp = self._leave(self.network_id)
             logging.debug("Leave action esponse: %s", resp)
+        if self._local_api:
+            self._local_api.close()
+            self._local_api = None
 
     def _prompt_auth(self):
         page_url = f"https://my.zerotier.com/network/{self.network_id}"
@@ -98,14 +180,75 @@ class ZeroTierControl(VPNConnectionControlBase):
         )
 
     def _network_state(self, network_id):
-        for n in self._cli_listnetworks():
+        for n in self._call(lambda api: api.request_json("GET", "/network"), self._cli_listnetworks):
             if n["id"] == network_id:
                 return n
         return None
 
+    def _version(self):
+        return self._call(lambda api: api.request_json("GET", "/status")["version"], self._cli_version)
+
+    def _join(self, network_id: str):
+        return self._call(
+            lambda api: api.request_json("POST", f"/network/{network_id}", {}), lambda: self._cli_join(network_id)
+        )
+
+    def _leave(self, network_id: str):
+        return self._call(
+            lambda api: api.request_json("DELETE", f"/network/{network_id}"), lambda: self._cli_leave(network_id)
+        )
+
+    def _info(self):
+        return self._call(lambda api: api.request_json("GET", "/status"), self._cli_info)
+
+    def _local_api_client(self):
+        """
+        Persistent client of the zerotier-one service JSON API (the one the cli talks to), authenticated with the
+        token it writes to its working directory. None if the token is not readable.
+        """
+        try:
+            with open(os.path.join(self.service_work_dir, "authtoken.secret")) as f:
+                auth_token = f.read().strip()
+        except OSError as e:
+            logging.info("Zerotier local API is not usable, using cli: %r", e)
+            return None
+        return KeepAliveHTTPClient(
+            lambda: http.client.HTTPConnection("127.0.0.1", self.primray_port, timeout=self._cli_invoke_timeout_sec),
+            headers={"X-ZT1-Auth": auth_token},
+        )
+
+    def _call(self, api_call, cli_call):
+        # the start steps call it concurrently: a failing call drops the client for the others
+        if api := self._local_api:
+            try:
+                return api_call(api)
+            except Exception as e:
+                logging.warning("Zerotier local API call failed, falling back to cli: %r", e)
+                with self._local_api_lock:
+                    if self._local_api is api:
+                        self._local_api = None
+                api.close()
+        return cli_call()
+
+    def _set_network(self, network_id: str, **settings: bool):
+        return self._call(
+            lambda api: api.request_json("POST", f"/network/{network_id}", settings),
+            lambda: self._cli_set(network_id, settings),
+        )
+
+    def _cli_set(self, network_id: str, settings: dict[str, bool]):
+        return Subprocess.check_output_json(
+            *self._zerotier_cli_cmd,
+            "-j",
+            "set",
+            network_id,
+            *(f"{k}={int(v)}" for k, v in settings.items()),
+            process_timeout=self._cli_invoke_timeout_sec,
+        )
+
     def _cli_version(self):
         ver = Subprocess.check_output_text(
-            *self._zerotier_service_cmd, "-v", process_timeout=self._cli_invoke_timeout_sec
+            *self._zerotier_service_cmd, "-v", process_timeout=self._cli_invoke_timeout_sec, cancel=self.cancel
         ).strip()
         return ver
 
@@ -115,7 +258,12 @@ class ZeroTierControl(VPNConnectionControlBase):
         {"allowDNS":false,"allowDefault":false,"allowGlobal":false,"allowManaged":true,"assignedAddresses":[],"bridge":false,"broadcastEnabled":false,"dhcp":false,"dns":{"domain":"","servers":[]},"id":"1e2938dfd34a83ee","mac":"ee:e6:cb:c8:76:41","mtu":2800,"multicastSubscriptions":[],"name":"","netconfRevision":0,"nwid":"9e1948db634a83ee","portDeviceName":"ztiv5aewen","portError":0,"routes":[],"status":"REQUESTING_CONFIGURATION","type":"PRIVATE"}
         """
         return Subprocess.check_output_json(
-            *self._zerotier_cli_cmd, "-j", "join", network_id, process_timeout=self._cli_invoke_timeout_sec
+            *self._zerotier_cli_cmd,
+            "-j",
+            "join",
+            network_id,
+            process_timeout=self._cli_invoke_timeout_sec,
+            cancel=self.cancel,
         )
 
     def _cli_leave(self, network_id: str):
@@ -125,12 +273,16 @@ class ZeroTierControl(VPNConnectionControlBase):
 
     def _cli_info(self):
         return Subprocess.check_output_json(
-            *self._zerotier_cli_cmd, "-j", "info", process_timeout=self._cli_invoke_timeout_sec
+            *self._zerotier_cli_cmd, "-j", "info", process_timeout=self._cli_invoke_timeout_sec, cancel=self.cancel
         )
 
     def _cli_listnetworks(self):
         return Subprocess.check_output_json(
-            *self._zerotier_cli_cmd, "-j", "listnetworks", process_timeout=self._cli_invoke_timeout_sec
+            *self._zerotier_cli_cmd,
+            "-j",
+            "listnetworks",
+            process_timeout=self._cli_invoke_timeout_sec,
+            cancel=self.cancel,
         )
 
     def _api_authorize_memeber(self, network_id: str, member_id: str, api_token: str):
@@ -4,12 +4,15 @@
 // #include <glib/gi18n-lib.h>
 #include <iostream>
 #include <json-glib/json-glib.h>
+#include <memory>
 #include <regex>
 #include <sstream>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "common/field-graph.h"
+#include "common/log.h"
 #include "common/nm-service-defines.h"
 #include "widget.h"
 
@@ -192,14 +195,26 @@ struct Pair {
 using namespace std;
 
 typedef struct {
-    GtkWidget *widget;
     JsonObject *input_def_obj;
+    GtkWidget *grid; // of the section
+    int row;
+    bool has_connection_value;
+    string connection_value; // saved as is while the input is disabled
+    GtkWidget *widget; // nullptr until the input is first visible
+    GtkWidget *holder; // widget, or the box around it
+    GtkWidget *label;
+    unique_ptr<regex> value_regex;
 } InputItem;
 
+struct EditorForm {
+    FieldGraph graph;
+    vector<InputItem> inputs; // by graph index
+};
+
 typedef struct {
     GtkWidget *widget;
     bool is_new_connection;
-    unordered_map<std::string, InputItem> input_widgets;
+    EditorForm *form;
 } ThisVPNEditorWidgetPrivate;
 
 static void this_vpn_editor_widget_interface_init(NMVpnEditorInterface *iface_class);
@@ -221,123 +236,549 @@ static bool check_validity(ThisVPNEditorWidget *self, GError **error)
 {
     ThisVPNEditorWidgetPrivate *priv = (ThisVPNEditorWidgetPrivate *)this_vpn_editor_widget_get_instance_private(THIS_VPN_EDITOR_WIDGET(self));
 
-    for (const auto &pair : priv->input_widgets) {
-        string id = pair.first;
-        JsonObject *input_def_obj = pair.second.input_def_obj;
-        GtkWidget *widget = pair.second.widget;
-        string value;
-        bool is_required = json_object_get_boolean_member_with_default(input_def_obj, "required", false);
-        if (G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_SPIN_BUTTON)) {
-        } else if (G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_ENTRY) || G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_PASSWORD_ENTRY)) {
-            value = STR(gtk_editable_get_text(GTK_EDITABLE(widget)));
-            if (is_required && value.empty()) {
-                set_invalid_property_error(error, "Property %s is required", id.c_str());
-                return false;
-            }
-            int min_length = json_object_get_int_member_with_default(input_def_obj, "min_length", 0);
-            if (min_length && value.length() < min_length && !value.empty()) {
-                set_invalid_property_error(error, "Property %s must be at least %d characters long", id.c_str(), min_length);
-                return false;
-            }
-            int max_length = json_object_get_int_member_with_default(input_def_obj, "max_length", 0);
-            if (max_length && value.length() > max_length) {
-                set_invalid_property_error(error, "Property %s must be at most %d characters long", id.c_str(), max_length);
-                return false;
-            }
-            string regex_pattern = STR(json_object_get_string_member_with_default(input_def_obj, "regex", ""));
-            try {
-                if (!regex_pattern.empty() && !value.empty()) {
-                    g_debug("Checking regex: %s %s", regex_pattern.c_str(), value.c_str());
-                    regex regex_obj(regex_pattern);
-                    if (!regex_match(value, regex_obj)) {
-                        set_invalid_property_error(error, "Property %s must match regex %s", id.c_str(), regex_pattern.c_str());
-                        return false;
-                    }
-                }
-            } catch (const std::regex_error &e) {
-                g_critical("Regex Error on %s |  %s", regex_pattern.c_str(), e.what());
-            }
-
-        } else if (G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_CHECK_BUTTON)) {
-            //
-        }
+    // kept up to date by input_changed(), only the active inputs count
+    int invalid = priv->form->graph.first_invalid();
+    if (invalid >= 0) {
+        set_invalid_property_error(error, "%s", priv->form->graph[invalid].error.c_str());
+        return false;
     }
     return true;
 }
 
 static void dispose_editor_widget(GObject *object)
 {
-    g_debug("dispose_editor_widget()");
+    VPN_LOG_DEBUG("dispose_editor_widget()");
     ThisVPNEditorWidgetPrivate *priv = (ThisVPNEditorWidgetPrivate *)this_vpn_editor_widget_get_instance_private(THIS_VPN_EDITOR_WIDGET(object));
     if (priv->widget)
         gtk_widget_unparent(priv->widget);
+    delete priv->form;
+    priv->form = nullptr;
 
     G_OBJECT_CLASS(this_vpn_editor_widget_parent_class)->dispose(object);
-    g_debug("done dispose_editor_widget()");
+    VPN_LOG_DEBUG("dispose_editor_widget() done");
 }
 
 static void this_vpn_editor_widget_init(G_GNUC_UNUSED ThisVPNEditorWidget *plugin)
 {
 }
 
-static bool apply_connection_proprties(ThisVPNEditorWidget *self, NMConnection *connection, G_GNUC_UNUSED GError **error)
+// The value of an input widget, as it is saved in vpn.data
+static string get_input_widget_value(const string &id, GtkWidget *widget)
+{
+    string value;
+    if (G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_SPIN_BUTTON)) {
+        value = to_string((int)gtk_spin_button_get_value(GTK_SPIN_BUTTON(widget)));
+    } else if (G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_ENTRY) || G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_PASSWORD_ENTRY)) {
+        value = STR(gtk_editable_get_text(GTK_EDITABLE(widget)));
+    } else if (G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_CHECK_BUTTON)) {
+        value = gtk_check_button_get_active(GTK_CHECK_BUTTON(widget)) ? "true" : "false";
+    } else if (IS_LIST_VIEW_WIDGET(widget)) {
+        JsonArray *arr = json_array_new();
+#if GTK_CHECK_VERSION(4, 0, 0)
+        GtkSelectionModel *ss = gtk_list_view_get_model(GTK_LIST_VIEW(widget));
+        GtkStringList *string_list = GTK_STRING_LIST(gtk_single_selection_get_model(GTK_SINGLE_SELECTION(ss)));
+        for (int i = 0; i < g_list_model_get_n_items(G_LIST_MODEL(string_list)); i++) {
+            const char *v = gtk_string_list_get_string(string_list, i);
+#else
+        GtkTreeModel *model = gtk_tree_view_get_model(GTK_TREE_VIEW(widget));
+        GtkTreeIter iter;
+        for (gboolean valid = gtk_tree_model_get_iter_first(model, &iter); valid; valid = gtk_tree_model_iter_next(model, &iter)) {
+            char *v;
+            gtk_tree_model_get(model, &iter, 0, &v, -1);
+#endif
+            VPN_LOG_TRACE("get_input_widget_value() Get listview entry", "key", id, "entry", v);
+            json_array_add_string_element(arr, v);
+        }
+        JsonNode *n = json_node_alloc();
+        json_node_init_array(n, arr);
+        gchar *json = json_to_string(n, false);
+        value = STR(json);
+        g_free(json);
+        json_node_free(n);
+    } else if (G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_DROP_DOWN)) {
+        value = STR(gtk_dropdown_text_get_active_text(widget));
+    } else {
+        VPN_LOG_WARNING("get_input_widget_value() Unknown widget type", "key", id, "widget_type", G_OBJECT_TYPE_NAME(widget));
+    }
+    return value;
+}
+
+static void set_input_widget_value(const string &id, GtkWidget *widget, const string &value)
+{
+    GError *e = nullptr;
+    VPN_LOG_DEBUG("set_input_widget_value()", "key", id, "value", value, "widget_type", G_OBJECT_TYPE_NAME(widget));
+    if (G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_SPIN_BUTTON)) {
+        int v = stoi(value);
+        gtk_spin_button_set_value(GTK_SPIN_BUTTON(widget), v);
+    } else if (G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_ENTRY) || G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_PASSWORD_ENTRY)) {
+        gtk_editable_set_text(GTK_EDITABLE(widget), value.c_str());
+    } else if (IS_LIST_VIEW_WIDGET(widget)) {
+        JsonParser *parser = json_parser_new();
+        if (!json_parser_load_from_data(parser, value.c_str(), -1, &e)) {
+            VPN_LOG_WARNING("set_input_widget_value() Unable to parse JSON", "key", id, "value", value, "error", e->message);
+            g_error_free(e);
+            g_object_unref(parser);
+            return;
+        }
+        JsonArray *arr = json_node_get_array(json_parser_get_root(parser));
+        if (!arr) {
+            VPN_LOG_WARNING("set_input_widget_value() Expected array object", "key", id, "value", value);
+            g_object_unref(parser);
+            return;
+        }
+        vector<string> values;
+        for (int k = 0; k < json_array_get_length(arr); k++) {
+            JsonNode *n = json_array_get_element(arr, k);
+            string v = STR(json_node_get_string(n));
+            VPN_LOG_TRACE("set_input_widget_value() Insert listview entry", "key", id, "entry", v);
+            values.push_back(v);
+        }
+        g_object_unref(parser);
+        apply_vector_to_list_model(widget, values);
+    } else if (G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_CHECK_BUTTON)) {
+        bool v = value == "true";
+        gtk_check_button_set_active(GTK_CHECK_BUTTON(widget), v);
+    } else if (G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_DROP_DOWN)) {
+        VPN_LOG_TRACE("set_input_widget_value() Set dropdown", "key", id, "value", value);
+        gtk_dropdown_set_selected_value(widget, value);
+    } else {
+        VPN_LOG_WARNING("set_input_widget_value() Unhandled widget type", "key", id, "widget_type", G_OBJECT_TYPE_NAME(widget));
+    }
+}
+
+// The value of an input without connection data, as get_input_widget_value() returns it for its new widget
+static string input_default_value(JsonObject *input_def_obj, const string &type)
 {
-    NMSettingVpn *s_vpn = nm_connection_get_setting_vpn(connection);
-
-    nm_setting_vpn_foreach_data_item(
-        s_vpn,
-        [](const char *key_cstr, const char *value_cstr, gpointer user_data) {
-            GError *e = nullptr;
-            string value = STR(value_cstr);
-            string key = STR(key_cstr);
-            ThisVPNEditorWidget *self = (ThisVPNEditorWidget *)user_data;
-            ThisVPNEditorWidgetPrivate *priv = (ThisVPNEditorWidgetPrivate *)this_vpn_editor_widget_get_instance_private(THIS_VPN_EDITOR_WIDGET(self));
-            if (priv->input_widgets.find(key) == priv->input_widgets.end()) {
-                g_warning("apply_connection_proprties() No input widget for key %s", key.c_str());
-                return;
+    if (type == "integer") {
+        gint64 default_v = json_object_get_int_member_with_default(input_def_obj, "default", 0);
+        return to_string(default_v ? default_v : json_object_get_int_member_with_default(input_def_obj, "min_value", 0));
+    } else if (type == "boolean") {
+        return json_object_get_boolean_member_with_default(input_def_obj, "default", false) ? "true" : "false";
+    } else if (type == "array") {
+        JsonNode *default_node = json_object_get_member(input_def_obj, "default");
+        if (!default_node || !JSON_NODE_HOLDS_ARRAY(default_node))
+            return "[]";
+        gchar *json = json_to_string(default_node, false);
+        string value = STR(json);
+        g_free(json);
+        return value;
+    }
+    return STR(json_object_get_string_member_with_default(input_def_obj, "default", ""));
+}
+
+// A value of a condition, as the values of vpn.data compare with it
+static string condition_value(JsonNode *node)
+{
+    if (!JSON_NODE_HOLDS_VALUE(node))
+        return "";
+    GType value_type = json_node_get_value_type(node);
+    if (value_type == G_TYPE_BOOLEAN)
+        return json_node_get_boolean(node) ? "true" : "false";
+    if (value_type == G_TYPE_INT64 || value_type == G_TYPE_DOUBLE)
+        return to_string(json_node_get_int(node));
+    return STR(json_node_get_string(node));
+}
+
+// Adds "visible_if", "enabled_if" and "required_if" of an input def to the graph, see common/field-graph.h
+static bool add_input_conditions(FieldGraph &graph, int node, JsonObject *input_def_obj, string *error)
+{
+    for (int c = 0; c < FieldGraph::ConditionCount; c++) {
+        FieldGraph::Condition condition = (FieldGraph::Condition)c;
+        JsonNode *condition_node = json_object_get_member(input_def_obj, FieldGraph::condition_name(condition));
+        if (!condition_node)
+            continue;
+        if (!JSON_NODE_HOLDS_OBJECT(condition_node)) {
+            *error = graph[node].id + ": " + FieldGraph::condition_name(condition) + " must be an object";
+            return false;
+        }
+        JsonObject *condition_obj = json_node_get_object(condition_node);
+        GList *sources = json_object_get_members(condition_obj);
+        bool ok = true;
+        for (GList *l = sources; l && ok; l = l->next) {
+            const char *source = (const char *)l->data;
+            JsonNode *values_node = json_object_get_member(condition_obj, source);
+            bool negate = JSON_NODE_HOLDS_OBJECT(values_node) && json_object_has_member(json_node_get_object(values_node), "not");
+            if (negate)
+                values_node = json_object_get_member(json_node_get_object(values_node), "not");
+            vector<string> values;
+            if (JSON_NODE_HOLDS_ARRAY(values_node)) {
+                JsonArray *values_array = json_node_get_array(values_node);
+                for (int k = 0; k < json_array_get_length(values_array); k++)
+                    values.push_back(condition_value(json_array_get_element(values_array, k)));
+            } else {
+                values.push_back(condition_value(values_node));
             }
-            InputItem inp = priv->input_widgets.at(key);
-            GtkWidget *widget = inp.widget;
-            g_debug("apply_connection_proprties() widget type %s for key=%s value=%s", G_OBJECT_TYPE_NAME(widget), key.c_str(), value.c_str());
-            if (G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_SPIN_BUTTON)) {
-                int v = stoi(value);
-                gtk_spin_button_set_value(GTK_SPIN_BUTTON(widget), v);
-            } else if (G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_ENTRY) || G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_PASSWORD_ENTRY)) {
-                gtk_editable_set_text(GTK_EDITABLE(widget), value.c_str());
-            } else if (IS_LIST_VIEW_WIDGET(widget)) {
-                JsonParser *parser = json_parser_new();
-                if (!json_parser_load_from_data(parser, value.c_str(), -1, &e)) {
-                    g_warning("apply_connection_proprties() Unable to parse JSON: %s | %s", value.c_str(), e->message);
-                    return;
-                }
-                JsonArray *arr = json_node_get_array(json_parser_get_root(parser));
-                if (!arr) {
-                    g_warning("apply_connection_proprties() Expected array object: %s", value.c_str());
-                    return;
+            ok = graph.add_clause(node, condition, source, values, negate, error);
+        }
+        g_list_free(sources);
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
+// Validates an input against its schema: on its changes, and the changes of its state
+static void validate_input(EditorForm *form, int node)
+{
+    const FieldGraph::Field &field = form->graph[node];
+    InputItem &input = form->inputs[node];
+    GtkWidget *widget = input.widget;
+    string error;
+    if (widget && (G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_ENTRY) || G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_PASSWORD_ENTRY))) {
+        string value = STR(gtk_editable_get_text(GTK_EDITABLE(widget)));
+        int min_length = json_object_get_int_member_with_default(input.input_def_obj, "min_length", 0);
+        int max_length = json_object_get_int_member_with_default(input.input_def_obj, "max_length", 0);
+        if (field.required_now && value.empty()) {
+            error = "Property " + field.id + " is required";
+        } else if (min_length && value.length() < min_length && !value.empty()) {
+            error = "Property " + field.id + " must be at least " + to_string(min_length) + " characters long";
+        } else if (max_length && value.length() > max_length) {
+            error = "Property " + field.id + " must be at most " + to_string(max_length) + " characters long";
+        } else if (input.value_regex && !value.empty() && !regex_match(value, *input.value_regex)) {
+            error = "Property " + field.id + " must match regex " + STR(json_object_get_string_member(input.input_def_obj, "regex"));
+        }
+        VPN_LOG_TRACE("validate_input()", "id", field.id, "value", value, "error", error);
+    }
+    form->graph.set_valid(node, error.empty(), error);
+}
+
+static void show_input_widgets(InputItem &input, bool visible)
+{
+    for (GtkWidget *widget : {input.label, input.holder}) {
+        if (!widget)
+            continue;
+#if !GTK_CHECK_VERSION(4, 0, 0)
+        // kept hidden from gtk_widget_show_all() of the connection editor
+        gtk_widget_set_no_show_all(widget, !visible);
+        if (visible)
+            gtk_widget_show_all(widget);
+#endif
+        gtk_widget_set_visible(widget, visible);
+    }
+}
+
+static void materialize_input(ThisVPNEditorWidget *self, int node);
+
+// Brings the widgets of an input in line with its state in the graph. They are created on its first time visible.
+static void apply_input_state(ThisVPNEditorWidget *self, int node)
+{
+    ThisVPNEditorWidgetPrivate *priv = (ThisVPNEditorWidgetPrivate *)this_vpn_editor_widget_get_instance_private(THIS_VPN_EDITOR_WIDGET(self));
+    const FieldGraph::Field &field = priv->form->graph[node];
+    InputItem &input = priv->form->inputs[node];
+    VPN_LOG_TRACE("apply_input_state()", "id", field.id, "visible", field.visible, "enabled", field.enabled, "required", field.required_now);
+    if (field.visible && !input.widget)
+        materialize_input(self, node);
+    if (input.widget) {
+        show_input_widgets(input, field.visible);
+        gtk_widget_set_sensitive(input.holder, field.enabled);
+        if (input.label)
+            gtk_widget_set_sensitive(input.label, field.enabled);
+    }
+    validate_input(priv->form, node);
+}
+
+// On every change of an input widget: only the inputs whose conditions depend on it are re-evaluated
+static void input_changed(ThisVPNEditorWidget *self, int node)
+{
+    ThisVPNEditorWidgetPrivate *priv = (ThisVPNEditorWidgetPrivate *)this_vpn_editor_widget_get_instance_private(THIS_VPN_EDITOR_WIDGET(self));
+    EditorForm *form = priv->form;
+    string value = get_input_widget_value(form->graph[node].id, form->inputs[node].widget);
+    for (int dependent : form->graph.set_value(node, value))
+        apply_input_state(self, dependent);
+    validate_input(form, node);
+}
+
+static void materialize_input(ThisVPNEditorWidget *self, int node)
+{
+    ThisVPNEditorWidgetPrivate *priv = (ThisVPNEditorWidgetPrivate *)this_vpn_editor_widget_get_instance_private(THIS_VPN_EDITOR_WIDGET(self));
+    const FieldGraph::Field &field = priv->form->graph[node];
+    InputItem &input = priv->form->inputs[node];
+    JsonObject *input_def_obj = input.input_def_obj;
+    const string &id = field.id;
+    string type = STR(json_object_get_string_member_with_default(input_def_obj, "type", "string"));
+    string label = STR(json_object_get_string_member_with_default(input_def_obj, "label", ""));
+    string description = STR(json_object_get_string_member_with_default(input_def_obj, "description", ""));
+
+    GtkWidget *widget_input = nullptr;
+    GtkWidget *widget_input_holder = nullptr;
+    GObject *input_change_event_object = nullptr;
+    string input_value_change_signals = "changed";
+    if (type == "integer") {
+        gint64 min_v = json_object_get_int_member_with_default(input_def_obj, "min_value", 0);
+        gint64 max_v = json_object_get_int_member_with_default(input_def_obj, "max_value", 999999);
+        widget_input = gtk_spin_button_new_with_range(min_v, max_v, 1);
+        gint64 default_v = json_object_get_int_member_with_default(input_def_obj, "default", 0);
+        VPN_LOG_TRACE("Add input", "type", type, "id", id, "default", default_v, "min", min_v, "max", max_v);
+        if (default_v) {
+            gtk_spin_button_set_value(GTK_SPIN_BUTTON(widget_input), default_v);
+        }
+    } else if (type == "string") {
+        string default_v = STR(json_object_get_string_member_with_default(input_def_obj, "default", ""));
+        gint64 max_length = json_object_get_int_member_with_default(input_def_obj, "max_length", 128);
+        bool is_secret = json_object_get_boolean_member_with_default(input_def_obj, "is_secret", false);
+        if (is_secret) {
+            widget_input = gtk_password_entry_new_with_peek_icon();
+        } else {
+            widget_input = gtk_entry_new();
+        }
+        VPN_LOG_TRACE("Add input", "type", type, "id", id, "max_length", max_length);
+        if (!default_v.empty()) {
+            gtk_editable_set_text(GTK_EDITABLE(widget_input), default_v.c_str());
+        }
+        if (max_length) {
+            gtk_entry_set_max_length(GTK_ENTRY(widget_input), max_length);
+        }
+        if (json_object_has_member(input_def_obj, "placeholder")) {
+            gtk_entry_set_placeholder_text(GTK_ENTRY(widget_input), json_object_get_string_member_with_default(input_def_obj, "placeholder", ""));
+        }
+        // gint64 min_length = json_object_get_int_member(input_def_obj, "min_length");
+    } else if (type == "array") {
+        vector<string> default_values;
+        // check if node exists
+        if (json_object_has_member(input_def_obj, "default")) {
+            JsonArray *default_value_array = json_object_get_array_member(input_def_obj, "default");
+            if (default_value_array) {
+                for (int k = 0; k < json_array_get_length(default_value_array); k++) {
+                    JsonNode *n = json_array_get_element(default_value_array, k);
+                    default_values.push_back(STR(json_node_get_string(n)));
                 }
-                vector<string> values;
-                for (int k = 0; k < json_array_get_length(arr); k++) {
-                    JsonNode *n = json_array_get_element(arr, k);
-                    string v = STR(json_node_get_string(n));
-                    g_debug("apply_connection_proprties() Insert listview of key=%s with entry=%s", key.c_str(), v.c_str());
-                    values.push_back(v);
+            }
+        }
+#if GTK_CHECK_VERSION(4, 0, 0)
+        GtkStringList *string_list = gtk_string_list_new(nullptr);
+        for (const string v : default_values) {
+            gtk_string_list_append(string_list, v.c_str());
+        }
+        GtkSingleSelection *ss = gtk_single_selection_new(G_LIST_MODEL(string_list));
+        GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
+        g_signal_connect(factory,
+                         "setup",
+                         G_CALLBACK(+[](GtkListItemFactory *factory, GtkListItem *listitem, gpointer user_data) {
+                             GtkStringList *string_list = (GtkStringList *)user_data;
+                             GtkWidget *w = gtk_editable_label_new("");
+                             gtk_list_item_set_child(listitem, w);
+                             g_signal_connect(w,
+                                              "notify::editing",
+                                              G_CALLBACK(+[](GtkWidget *w, gpointer _, gpointer user_data) {
+                                                  GtkStringList *string_list = (GtkStringList *)((Pair *)user_data)->first;
+                                                  GtkListItem *listitem = (GtkListItem *)((Pair *)user_data)->second;
+                                                  const char *text = gtk_editable_get_text(GTK_EDITABLE(w));
+                                                  const char *additions[2];
+                                                  additions[0] = text;
+                                                  additions[1] = nullptr;
+                                                  const int pos = gtk_list_item_get_position(GTK_LIST_ITEM(listitem));
+                                                  const char *prev_text = gtk_string_list_get_string(string_list, pos);
+                                                  //   g_debug("change : %s -> %s %d", prev_text, text, pos);
+                                                  if (strcmp(prev_text, text) == 0) {
+                                                      return;
+                                                  }
+                                                  gtk_string_list_splice(string_list, pos, 1, additions);
+                                              }),
+                                              (new Pair{string_list, listitem}));
+                         }),
+                         string_list);
+
+        g_signal_connect(factory,
+                         "bind",
+                         G_CALLBACK(+[](GtkSignalListItemFactory *self, GtkListItem *listitem, gpointer user_data) {
+                             GtkWidget *w = gtk_list_item_get_child(listitem);
+                             GtkStringObject *strobj = (GtkStringObject *)gtk_list_item_get_item(listitem);
+                             const char *text = gtk_string_object_get_string(strobj);
+                             gtk_editable_set_text(GTK_EDITABLE(w), text);
+                         }),
+                         NULL);
+        g_signal_connect(factory, "unbind", G_CALLBACK(+[](GtkSignalListItemFactory *self, GtkListItem *listitem, gpointer user_data) {}), NULL);
+        g_signal_connect(factory,
+                         "teardown",
+                         G_CALLBACK(+[](GtkListItemFactory *factory, GtkListItem *listitem, gpointer user_data) {
+                             gtk_list_item_set_child(listitem, NULL);
+                         }),
+                         NULL);
+
+        GtkWidget *listview = gtk_list_view_new(GTK_SELECTION_MODEL(ss), factory);
+        gtk_list_view_set_single_click_activate(GTK_LIST_VIEW(listview), true);
+        gtk_list_view_set_enable_rubberband(GTK_LIST_VIEW(listview), true);
+        gtk_list_view_set_show_separators(GTK_LIST_VIEW(listview), true);
+        input_value_change_signals = "items-changed";
+        input_change_event_object = G_OBJECT(string_list);
+
+#else
+        input_value_change_signals = "";
+        GtkListStore *string_list = gtk_list_store_new(1, G_TYPE_STRING);
+        for (const string v : default_values) {
+            GtkTreeIter iter;
+            gtk_list_store_append(string_list, &iter);
+            gtk_list_store_set(string_list, &iter, 0, v.c_str(), -1);
+        }
+        GtkWidget *listview = gtk_tree_view_new_with_model(GTK_TREE_MODEL(string_list));
+        gtk_tree_view_set_grid_lines(GTK_TREE_VIEW(listview), GTK_TREE_VIEW_GRID_LINES_BOTH);
+        gtk_tree_view_set_reorderable(GTK_TREE_VIEW(listview), true);
+
+        GtkCellRenderer *cell_renderer = gtk_cell_renderer_text_new();
+        g_object_set(cell_renderer, "editable", true, nullptr);
+        g_object_set(cell_renderer, "ellipsize", PANGO_ELLIPSIZE_END, nullptr);
+        g_signal_connect(cell_renderer,
+                         "edited",
+                         G_CALLBACK(+[](GtkCellRendererText *cell, const gchar *path_string, const gchar *new_text, gpointer data) {
+                             GtkListStore *store = (GtkListStore *)data;
+                             GtkTreeIter iter;
+                             GtkTreePath *path = gtk_tree_path_new_from_string(path_string);
+                             gtk_tree_model_get_iter(GTK_TREE_MODEL(store), &iter, path);
+                             gtk_list_store_set(store, &iter, 0, new_text, -1);
+                             gtk_tree_path_free(path);
+                         }),
+                         string_list);
+        GtkTreeViewColumn *column = gtk_tree_view_column_new_with_attributes("Strings", cell_renderer, "text", 0, nullptr);
+        gtk_tree_view_append_column(GTK_TREE_VIEW(listview), column);
+        gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(listview), false);
+
+        input_value_change_signals = "row-changed";
+        input_change_event_object = G_OBJECT(string_list);
+#endif
+
+        GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+        GtkScrolledWindow *list_view_scrollbale_container = GTK_SCROLLED_WINDOW(gtk_scrolled_window_new_());
+        gtk_scrolled_window_set_policy(list_view_scrollbale_container, GTK_POLICY_AUTOMATIC, GTK_POLICY_NEVER);
+        gtk_scrolled_window_set_child(list_view_scrollbale_container, listview);
+        GtkWidget *frm = gtk_frame_new(nullptr);
+        gtk_frame_set_child(GTK_FRAME(frm), (GtkWidget *)list_view_scrollbale_container);
+        gtk_box_append(GTK_BOX(vbox), frm);
+
+        GtkWidget *hbox_buttons = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+        gtk_box_append(GTK_BOX(vbox), hbox_buttons);
+
+        GtkWidget *add_button = gtk_button_new_from_icon_name_("list-add-symbolic");
+        gtk_box_append(GTK_BOX(hbox_buttons), add_button);
+        struct AddButtonData {
+            string default_value;
+            gpointer listview;
+        };
+        g_signal_connect(add_button,
+                         "clicked",
+                         G_CALLBACK(+[](GtkButton *button, gpointer data) {
+                             AddButtonData *add_button_data = (AddButtonData *)data;
+                             gpointer listview = add_button_data->listview;
+                             const char *default_value = add_button_data->default_value.c_str();
+                             append_to_list_view(listview, default_value);
+                         }),
+                         (new AddButtonData{.default_value = (default_values.size() ? default_values[0] : "<edit>"), .listview = listview}));
+
+        GtkWidget *delete_button = gtk_button_new_from_icon_name_("list-remove-symbolic");
+        gtk_box_append(GTK_BOX(hbox_buttons), delete_button);
+        g_signal_connect(delete_button,
+                         "clicked",
+                         G_CALLBACK(+[](GtkButton *button, gpointer data) {
+                             remove_selected_from_list_view(data)
+                         }),
+                         listview);
+
+        widget_input = listview;
+        widget_input_holder = vbox;
+
+    } else if (type == "boolean") {
+        widget_input = gtk_check_button_new();
+        bool default_v = json_object_get_boolean_member_with_default(input_def_obj, "default", false);
+        VPN_LOG_TRACE("Add input", "type", type, "id", id, "default", default_v);
+        gtk_check_button_set_active(GTK_CHECK_BUTTON(widget_input), default_v);
+        input_value_change_signals = "toggled";
+    } else if (type == "enum") {
+        JsonArray *enum_array = json_object_get_array_member(input_def_obj, "values"); // checked by the factory
+        vector<string> enum_values;
+        for (int k = 0; k < json_array_get_length(enum_array); k++) {
+            JsonNode *enum_node = json_array_get_element(enum_array, k);
+            enum_values.push_back(STR(json_node_get_string(enum_node)));
+        }
+        string default_v = STR(json_object_get_string_member_with_default(input_def_obj, "default", ""));
+        // g_debug("Add input type=%s: id=%s default=%s enume_values: %s", type.c_str(), id.c_str(), default_v.c_str(),
+        // JOIN_STRING_VEC(enum_values).c_str());
+        int default_val_idx = -1;
+        if (!default_v.empty()) {
+            default_val_idx = enum_values.size() - 1;
+            for (; default_val_idx; default_val_idx--) {
+                if (enum_values[default_val_idx] == default_v) {
+                    break;
                 }
-                apply_vector_to_list_model(widget, values);
-            } else if (G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_CHECK_BUTTON)) {
-                bool v = value == "true";
-                gtk_check_button_set_active(GTK_CHECK_BUTTON(widget), v);
-            } else if (G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_DROP_DOWN)) {
-                g_debug("apply_connection_proprties() Set dropdown of key=%s with value=%s", key.c_str(), value.c_str());
-                gtk_dropdown_set_selected_value(widget, value);
-            } else {
-                g_warning("apply_connection_proprties() Unhandled widget type %s for key %s", G_OBJECT_TYPE_NAME(widget), key.c_str());
-                return;
             }
-        },
-        self);
-    // g_return_val_if_fail(widget != nullptr, false);
-    g_debug("apply_connection_proprties() Done");
-    return true;
+        }
+        widget_input = gtk_dropdown_new_with_vec(enum_values, default_val_idx);
+        input_value_change_signals = GTK_DROPDOWN_CHANGE_EVENT;
+    }
+    set_prefixed_widget_name(widget_input, id + ":widget");
+    gtk_widget_set_tooltip_text(widget_input, description.c_str());
+    if (input.has_connection_value) {
+        set_input_widget_value(id, widget_input, field.value);
+    }
+    string regex_pattern = STR(json_object_get_string_member_with_default(input_def_obj, "regex", ""));
+    try {
+        if (!regex_pattern.empty()) {
+            input.value_regex.reset(new regex(regex_pattern));
+        }
+    } catch (const std::regex_error &e) {
+        VPN_LOG_CRITICAL("Regex error", "id", id, "regex", regex_pattern, "error", e.what());
+    }
+    if (input_change_event_object == nullptr) {
+        input_change_event_object = G_OBJECT(widget_input);
+    }
+    string signal_name;
+    istringstream input_value_change_signals_ss(input_value_change_signals);
+    struct ChangeSignalContext {
+        int node;
+        NMVpnEditor *editor;
+        string signal_name;
+    };
+    while (getline(input_value_change_signals_ss, signal_name, ',')) {
+        if (signal_name.empty()) {
+            continue;
+        }
+        // XXX: sourcery (https://stackoverflow.com/questions/49638121/gtk-g-signal-connect-and-c-lambda-results-in-invalid-cast-errors)
+        g_signal_connect(input_change_event_object,
+                         signal_name.c_str(),
+                         G_CALLBACK(+[](GObject *object, gpointer a, gpointer b, gpointer c, gpointer d) -> void {
+                             // runs on every keystroke: logging is compiled out of release builds
+                             const char *object_type = G_OBJECT_TYPE_NAME(object);
+                             gpointer user_data = a;
+                             if (g_str_equal(object_type, "GtkDropDown")) { // gtk4
+                                 user_data = b;
+                             } else if (g_str_equal(object_type, "GtkListStore")) { // gtk3
+                                 user_data = c;
+                             } else if (g_str_equal(object_type, "GtkStringList")) { // gtk4
+                                 user_data = d;
+                             }
+                             ChangeSignalContext *ctx = (ChangeSignalContext *)user_data;
+                             VPN_LOG_TRACE("stuff_changed_cb()", "signal", ctx->signal_name, "object", object_type, "input", ctx->node);
+                             input_changed(THIS_VPN_EDITOR_WIDGET(ctx->editor), ctx->node);
+                             g_signal_emit_by_name(THIS_VPN_EDITOR_WIDGET(ctx->editor), "changed");
+                         }),
+                         (new ChangeSignalContext{.node = node, .editor = NM_VPN_EDITOR(self), .signal_name = signal_name}));
+    }
+
+    GtkWidget *lbl_input = nullptr;
+    if (!label.empty()) {
+        lbl_input = gtk_label_new(label.c_str());
+        set_prefixed_widget_name(lbl_input, id + ":label");
+        gtk_label_set_use_markup(GTK_LABEL(lbl_input), true);
+        gtk_widget_set_halign(lbl_input, GTK_ALIGN_START);
+        gtk_widget_set_tooltip_text(lbl_input, description.c_str());
+        gtk_widget_set_margin_start(lbl_input, 10);
+    }
+
+    if (widget_input_holder == nullptr) {
+        widget_input_holder = widget_input;
+    } else {
+        if (lbl_input) {
+            gtk_widget_set_valign(lbl_input, GTK_ALIGN_START);
+            gtk_widget_set_margin_top(lbl_input, 5);
+        }
+    }
+    gtk_grid_set_row_baseline_position(GTK_GRID(input.grid), input.row, GTK_BASELINE_POSITION_BOTTOM);
+    if (lbl_input) {
+        gtk_grid_attach(GTK_GRID(input.grid), lbl_input, 0, input.row, 1, 1);
+    }
+    gtk_grid_attach(GTK_GRID(input.grid), widget_input_holder, lbl_input ? 1 : 0, input.row, 1, 1);
+
+    input.widget = widget_input;
+    input.holder = widget_input_holder;
+    input.label = lbl_input;
 }
 
 G_MODULE_EXPORT NMVpnEditor *this_vpn_editor_widget_factory(G_GNUC_UNUSED NMVpnEditorPlugin *plugin, NMConnection *connection, GError **error)
@@ -345,8 +786,8 @@ G_MODULE_EXPORT NMVpnEditor *this_vpn_editor_widget_factory(G_GNUC_UNUSED NMVpnE
     NMVpnEditor *editor_obj;
     ThisVPNEditorWidgetPrivate *priv;
     NMSettingVpn *s_vpn;
-    bool is_new = false;
     GError *e = nullptr;
+    string graph_error;
 
     if (error)
         g_return_val_if_fail(*error == nullptr, nullptr);
@@ -359,7 +800,19 @@ G_MODULE_EXPORT NMVpnEditor *this_vpn_editor_widget_factory(G_GNUC_UNUSED NMVpnE
 
     priv = (ThisVPNEditorWidgetPrivate *)this_vpn_editor_widget_get_instance_private(THIS_VPN_EDITOR_WIDGET(editor_obj));
 
-    priv->input_widgets = unordered_map<std::string, InputItem>();
+    priv->form = new EditorForm();
+    EditorForm *form = priv->form;
+
+    unordered_map<string, string> connection_data;
+    s_vpn = nm_connection_get_setting_vpn(connection);
+    if (s_vpn)
+        nm_setting_vpn_foreach_data_item(
+            s_vpn,
+            [](const char *key_cstr, const char *value_cstr, gpointer user_data) {
+                (*(unordered_map<string, string> *)user_data)[STR(key_cstr)] = STR(value_cstr);
+            },
+            &connection_data);
+    priv->is_new_connection = connection_data.empty();
 
     // gtk_builder_set_translation_domain(priv->builder, GETTEXT_PACKAGE);
 
@@ -386,14 +839,13 @@ G_MODULE_EXPORT NMVpnEditor *this_vpn_editor_widget_factory(G_GNUC_UNUSED NMVpnE
         }
         string section_title = STR(json_object_get_string_member_with_default(section_obj, "section", "<unnamed>"));
         string section_description = STR(json_object_get_string_member_with_default(section_obj, "description", ""));
-        g_debug("Processing section_obj: section_title=%s", section_title.c_str());
+        VPN_LOG_DEBUG("Processing section", "section", section_title);
 
         JsonArray *input_def_array = json_object_get_array_member(section_obj, "inputs");
         if (!input_def_array) {
             g_set_error(error, EDITOR_PLUGIN_ERROR, 0, "THIS_VPN_PROVIDER_INPUT_FORM_JSON:  Missing inputs array obj at index %d", i);
             return nullptr;
         }
-        g_debug("Creating label for section: %s", section_title.c_str());
         GtkWidget *lbl_section = gtk_label_new(section_title.c_str());
         set_prefixed_widget_name(lbl_section, section_title + "Label");
         string section_markup = ("<b>" + section_title + "</b>");
@@ -405,14 +857,12 @@ G_MODULE_EXPORT NMVpnEditor *this_vpn_editor_widget_factory(G_GNUC_UNUSED NMVpnE
         gtk_widget_set_margin_top(lbl_section, 10);
         gtk_box_append(GTK_BOX(box_main), lbl_section);
 
-        g_debug("Creating grid for section: %s", section_title.c_str());
         GtkWidget *grid_section = gtk_grid_new();
         set_prefixed_widget_name(grid_section, "SectionInputsGrid");
         gtk_grid_set_column_homogeneous(GTK_GRID(grid_section), true);
         gtk_grid_set_row_spacing(GTK_GRID(grid_section), 5);
         gtk_box_append(GTK_BOX(box_main), grid_section);
 
-        g_debug("Adding input widgets to section: %s", section_title.c_str());
         for (int j = 0; j < json_array_get_length(input_def_array); j++) {
             JsonNode *input_def_node = json_array_get_element(input_def_array, j);
             JsonObject *input_def_obj = json_node_get_object(input_def_node);
@@ -428,8 +878,6 @@ G_MODULE_EXPORT NMVpnEditor *this_vpn_editor_widget_factory(G_GNUC_UNUSED NMVpnE
             }
             string id = STR(json_object_get_string_member_with_default(input_def_obj, "id", ""));
             string type = STR(json_object_get_string_member_with_default(input_def_obj, "type", "string"));
-            string label = STR(json_object_get_string_member_with_default(input_def_obj, "label", ""));
-            string description = STR(json_object_get_string_member_with_default(input_def_obj, "description", ""));
             if (id.empty()) {
                 g_set_error(error,
                             EDITOR_PLUGIN_ERROR,
@@ -440,320 +888,61 @@ G_MODULE_EXPORT NMVpnEditor *this_vpn_editor_widget_factory(G_GNUC_UNUSED NMVpnE
                             j);
                 continue;
             }
-            GtkWidget *widget_input = nullptr;
-            GtkWidget *widget_input_holder = nullptr;
-            GObject *input_change_event_object = nullptr;
-            string input_value_change_signals = "changed";
-            if (type == "integer") {
-                gint64 min_v = json_object_get_int_member_with_default(input_def_obj, "min_value", 0);
-                gint64 max_v = json_object_get_int_member_with_default(input_def_obj, "max_value", 999999);
-                widget_input = gtk_spin_button_new_with_range(min_v, max_v, 1);
-                gint64 default_v = json_object_get_int_member_with_default(input_def_obj, "default", 0);
-                g_debug("Add input type=%s: id=%s default=%d, min_v=%d max_v=%d", type.c_str(), id.c_str(), default_v, min_v, max_v);
-                if (default_v) {
-                    gtk_spin_button_set_value(GTK_SPIN_BUTTON(widget_input), default_v);
-                }
-            } else if (type == "string") {
-                string default_v = STR(json_object_get_string_member_with_default(input_def_obj, "default", ""));
-                gint64 max_length = json_object_get_int_member_with_default(input_def_obj, "max_length", 128);
-                bool is_secret = json_object_get_boolean_member_with_default(input_def_obj, "is_secret", false);
-                if (is_secret) {
-                    widget_input = gtk_password_entry_new_with_peek_icon();
-                } else {
-                    widget_input = gtk_entry_new();
-                }
-                g_debug("Add input type=%s: id=%s  max_length=%d", type.c_str(), id.c_str(), max_length);
-                if (!default_v.empty()) {
-                    gtk_editable_set_text(GTK_EDITABLE(widget_input), default_v.c_str());
-                }
-                if (max_length) {
-                    gtk_entry_set_max_length(GTK_ENTRY(widget_input), max_length);
-                }
-                if (json_object_has_member(input_def_obj, "placeholder")) {
-                    gtk_entry_set_placeholder_text(GTK_ENTRY(widget_input), json_object_get_string_member_with_default(input_def_obj, "placeholder", ""));
-                }
-                // gint64 min_length = json_object_get_int_member(input_def_obj, "min_length");
-            } else if (type == "array") {
-                vector<string> default_values;
-                // check if node exists
-                if (json_object_has_member(input_def_obj, "default")) {
-                    JsonArray *default_value_array = json_object_get_array_member(input_def_obj, "default");
-                    if (default_value_array) {
-                        for (int k = 0; k < json_array_get_length(default_value_array); k++) {
-                            JsonNode *n = json_array_get_element(default_value_array, k);
-                            default_values.push_back(STR(json_node_get_string(n)));
-                        }
-                    }
-                }
-#if GTK_CHECK_VERSION(4, 0, 0)
-                GtkStringList *string_list = gtk_string_list_new(nullptr);
-                for (const string v : default_values) {
-                    gtk_string_list_append(string_list, v.c_str());
-                }
-                GtkSingleSelection *ss = gtk_single_selection_new(G_LIST_MODEL(string_list));
-                GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
-                g_signal_connect(factory,
-                                 "setup",
-                                 G_CALLBACK(+[](GtkListItemFactory *factory, GtkListItem *listitem, gpointer user_data) {
-                                     GtkStringList *string_list = (GtkStringList *)user_data;
-                                     GtkWidget *w = gtk_editable_label_new("");
-                                     gtk_list_item_set_child(listitem, w);
-                                     g_signal_connect(w,
-                                                      "notify::editing",
-                                                      G_CALLBACK(+[](GtkWidget *w, gpointer _, gpointer user_data) {
-                                                          GtkStringList *string_list = (GtkStringList *)((Pair *)user_data)->first;
-                                                          GtkListItem *listitem = (GtkListItem *)((Pair *)user_data)->second;
-                                                          const char *text = gtk_editable_get_text(GTK_EDITABLE(w));
-                                                          const char *additions[2];
-                                                          additions[0] = text;
-                                                          additions[1] = nullptr;
-                                                          const int pos = gtk_list_item_get_position(GTK_LIST_ITEM(listitem));
-                                                          const char *prev_text = gtk_string_list_get_string(string_list, pos);
-                                                          //   g_debug("change : %s -> %s %d", prev_text, text, pos);
-                                                          if (strcmp(prev_text, text) == 0) {
-                                                              return;
-                                                          }
-                                                          gtk_string_list_splice(string_list, pos, 1, additions);
-                                                      }),
-                                                      (new Pair{string_list, listitem}));
-                                 }),
-                                 string_list);
-
-                g_signal_connect(factory,
-                                 "bind",
-                                 G_CALLBACK(+[](GtkSignalListItemFactory *self, GtkListItem *listitem, gpointer user_data) {
-                                     GtkWidget *w = gtk_list_item_get_child(listitem);
-                                     GtkStringObject *strobj = (GtkStringObject *)gtk_list_item_get_item(listitem);
-                                     const char *text = gtk_string_object_get_string(strobj);
-                                     gtk_editable_set_text(GTK_EDITABLE(w), text);
-                                 }),
-                                 NULL);
-                g_signal_connect(factory, "unbind", G_CALLBACK(+[](GtkSignalListItemFactory *self, GtkListItem *listitem, gpointer user_data) {}), NULL);
-                g_signal_connect(factory,
-                                 "teardown",
-                                 G_CALLBACK(+[](GtkListItemFactory *factory, GtkListItem *listitem, gpointer user_data) {
-                                     gtk_list_item_set_child(listitem, NULL);
-                                 }),
-                                 NULL);
-
-                GtkWidget *listview = gtk_list_view_new(GTK_SELECTION_MODEL(ss), factory);
-                gtk_list_view_set_single_click_activate(GTK_LIST_VIEW(listview), true);
-                gtk_list_view_set_enable_rubberband(GTK_LIST_VIEW(listview), true);
-                gtk_list_view_set_show_separators(GTK_LIST_VIEW(listview), true);
-                input_value_change_signals = "items-changed";
-                input_change_event_object = G_OBJECT(string_list);
-
-#else
-                input_value_change_signals = "";
-                GtkListStore *string_list = gtk_list_store_new(1, G_TYPE_STRING);
-                for (const string v : default_values) {
-                    GtkTreeIter iter;
-                    gtk_list_store_append(string_list, &iter);
-                    gtk_list_store_set(string_list, &iter, 0, v.c_str(), -1);
-                }
-                GtkWidget *listview = gtk_tree_view_new_with_model(GTK_TREE_MODEL(string_list));
-                gtk_tree_view_set_grid_lines(GTK_TREE_VIEW(listview), GTK_TREE_VIEW_GRID_LINES_BOTH);
-                gtk_tree_view_set_reorderable(GTK_TREE_VIEW(listview), true);
-
-                GtkCellRenderer *cell_renderer = gtk_cell_renderer_text_new();
-                g_object_set(cell_renderer, "editable", true, nullptr);
-                g_object_set(cell_renderer, "ellipsize", PANGO_ELLIPSIZE_END, nullptr);
-                g_signal_connect(cell_renderer,
-                                 "edited",
-                                 G_CALLBACK(+[](GtkCellRendererText *cell, const gchar *path_string, const gchar *new_text, gpointer data) {
-                                     GtkListStore *store = (GtkListStore *)data;
-                                     GtkTreeIter iter;
-                                     GtkTreePath *path = gtk_tree_path_new_from_string(path_string);
-                                     gtk_tree_model_get_iter(GTK_TREE_MODEL(store), &iter, path);
-                                     gtk_list_store_set(store, &iter, 0, new_text, -1);
-                                     gtk_tree_path_free(path);
-                                 }),
-                                 string_list);
-                GtkTreeViewColumn *column = gtk_tree_view_column_new_with_attributes("Strings", cell_renderer, "text", 0, nullptr);
-                gtk_tree_view_append_column(GTK_TREE_VIEW(listview), column);
-                gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(listview), false);
-
-                input_value_change_signals = "row-changed";
-                input_change_event_object = G_OBJECT(string_list);
-#endif
-
-                GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
-                GtkScrolledWindow *list_view_scrollbale_container = GTK_SCROLLED_WINDOW(gtk_scrolled_window_new_());
-                gtk_scrolled_window_set_policy(list_view_scrollbale_container, GTK_POLICY_AUTOMATIC, GTK_POLICY_NEVER);
-                gtk_scrolled_window_set_child(list_view_scrollbale_container, listview);
-                GtkWidget *frm = gtk_frame_new(nullptr);
-                gtk_frame_set_child(GTK_FRAME(frm), (GtkWidget *)list_view_scrollbale_container);
-                gtk_box_append(GTK_BOX(vbox), frm);
-
-                GtkWidget *hbox_buttons = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
-                gtk_box_append(GTK_BOX(vbox), hbox_buttons);
-
-                GtkWidget *add_button = gtk_button_new_from_icon_name_("list-add-symbolic");
-                gtk_box_append(GTK_BOX(hbox_buttons), add_button);
-                struct AddButtonData {
-                    string default_value;
-                    gpointer listview;
-                };
-                g_signal_connect(add_button,
-                                 "clicked",
-                                 G_CALLBACK(+[](GtkButton *button, gpointer data) {
-                                     AddButtonData *add_button_data = (AddButtonData *)data;
-                                     gpointer listview = add_button_data->listview;
-                                     const char *default_value = add_button_data->default_value.c_str();
-                                     append_to_list_view(listview, default_value);
-                                 }),
-                                 (new AddButtonData{.default_value = (default_values.size() ? default_values[0] : "<edit>"), .listview = listview}));
-
-                GtkWidget *delete_button = gtk_button_new_from_icon_name_("list-remove-symbolic");
-                gtk_box_append(GTK_BOX(hbox_buttons), delete_button);
-                g_signal_connect(delete_button,
-                                 "clicked",
-                                 G_CALLBACK(+[](GtkButton *button, gpointer data) {
-                                     remove_selected_from_list_view(data)
-                                 }),
-                                 listview);
-
-                widget_input = listview;
-                widget_input_holder = vbox;
-
-            } else if (type == "boolean") {
-                widget_input = gtk_check_button_new();
-                bool default_v = json_object_get_boolean_member_with_default(input_def_obj, "default", false);
-                g_debug("Add input type=%s: id=%s default=%d", type.c_str(), id.c_str(), default_v);
-                gtk_check_button_set_active(GTK_CHECK_BUTTON(widget_input), default_v);
-                input_value_change_signals = "toggled";
-            } else if (type == "enum") {
-                JsonArray *enum_array = json_object_get_array_member(input_def_obj, "values");
-                if (!enum_array) {
-                    g_set_error(error,
-                                EDITOR_PLUGIN_ERROR,
-                                0,
-                                "THIS_VPN_PROVIDER_INPUT_FORM_JSON: Invalid enum input def at index [%s].%d.%d",
-                                section_title.c_str(),
-                                i,
-                                j);
-                    return nullptr;
-                }
-                vector<string> enum_values;
-                for (int k = 0; k < json_array_get_length(enum_array); k++) {
-                    JsonNode *enum_node = json_array_get_element(enum_array, k);
-                    enum_values.push_back(STR(json_node_get_string(enum_node)));
-                }
-                string default_v = STR(json_object_get_string_member_with_default(input_def_obj, "default", ""));
-                // g_debug("Add input type=%s: id=%s default=%s enume_values: %s", type.c_str(), id.c_str(), default_v.c_str(),
-                // JOIN_STRING_VEC(enum_values).c_str());
-                int default_val_idx = -1;
-                if (!default_v.empty()) {
-                    default_val_idx = enum_values.size() - 1;
-                    for (; default_val_idx; default_val_idx--) {
-                        if (enum_values[default_val_idx] == default_v) {
-                            break;
-                        }
-                    }
-                }
-                widget_input = gtk_dropdown_new_with_vec(enum_values, default_val_idx);
-                input_value_change_signals = GTK_DROPDOWN_CHANGE_EVENT;
+            if (type == "enum" && !json_object_get_array_member(input_def_obj, "values")) {
+                g_set_error(error,
+                            EDITOR_PLUGIN_ERROR,
+                            0,
+                            "THIS_VPN_PROVIDER_INPUT_FORM_JSON: Invalid enum input def at index [%s].%d.%d",
+                            section_title.c_str(),
+                            i,
+                            j);
+                return nullptr;
             }
-
-            else {
-                g_warning("Found unknown type %s", type.c_str());
+            if (type != "integer" && type != "string" && type != "array" && type != "boolean" && type != "enum") {
+                VPN_LOG_WARNING("Unknown input type", "type", type, "id", id);
                 continue;
             }
-            set_prefixed_widget_name(widget_input, id + ":widget");
-            gtk_widget_set_tooltip_text(widget_input, description.c_str());
-            if (input_change_event_object == nullptr) {
-                input_change_event_object = G_OBJECT(widget_input);
-            }
-            string signal_name;
-            istringstream input_value_change_signals_ss(input_value_change_signals);
-            struct ChangeSignalContext {
-                GtkWidget *widget;
-                NMVpnEditor *editor;
-                string signal_name;
-            };
-            while (getline(input_value_change_signals_ss, signal_name, ',')) {
-                if (signal_name.empty()) {
-                    continue;
-                }
-                // XXX: sourcery (https://stackoverflow.com/questions/49638121/gtk-g-signal-connect-and-c-lambda-results-in-invalid-cast-errors)
-                g_signal_connect(input_change_event_object,
-                                 signal_name.c_str(),
-                                 G_CALLBACK(+[](GObject *object, gpointer a, gpointer b, gpointer c, gpointer d) -> void {
-                                     string object_type = G_OBJECT_TYPE_NAME(object);
-                                     g_debug("inside callback %s o=%p a=%p b=%p c=%p d=%p", object_type.c_str(), object, a, b, c, d);
-                                     gpointer user_data = a;
-                                     if (object_type == "GtkDropDown") { // gtk4
-                                         user_data = b;
-                                     } else if (object_type == "GtkListStore") { // gtk3
-                                         user_data = c;
-                                     } else if (object_type == "GtkStringList") { // gtk4
-                                         user_data = d;
-                                     }
-                                     ChangeSignalContext *ctx = (ChangeSignalContext *)user_data;
-                                     g_debug("stuff_changed_cb() signal: %s, widget: object=%s | widget= %s | name= %s",
-                                             ctx->signal_name.c_str(),
-                                             object_type.c_str(),
-                                             G_OBJECT_TYPE_NAME(ctx->widget),
-                                             gtk_widget_get_name(ctx->widget));
-                                     g_signal_emit_by_name(THIS_VPN_EDITOR_WIDGET(ctx->editor), "changed");
-                                 }),
-                                 (new ChangeSignalContext{.widget = widget_input, .editor = editor_obj, .signal_name = signal_name}));
-            }
-
-            GtkWidget *lbl_input = nullptr;
-            if (!label.empty()) {
-                lbl_input = gtk_label_new(label.c_str());
-                set_prefixed_widget_name(lbl_input, id + ":label");
-                gtk_label_set_use_markup(GTK_LABEL(lbl_input), true);
-                gtk_widget_set_halign(lbl_input, GTK_ALIGN_START);
-                gtk_widget_set_tooltip_text(lbl_input, description.c_str());
-                gtk_widget_set_margin_start(lbl_input, 10);
-            }
-
-            if (widget_input_holder == nullptr) {
-                widget_input_holder = widget_input;
-            } else {
-                if (lbl_input) {
-                    gtk_widget_set_valign(lbl_input, GTK_ALIGN_START);
-                    gtk_widget_set_margin_top(lbl_input, 5);
-                }
-            }
-            gtk_grid_set_row_baseline_position(GTK_GRID(grid_section), j, GTK_BASELINE_POSITION_BOTTOM);
-            if (lbl_input) {
-                gtk_grid_attach(GTK_GRID(grid_section), lbl_input, 0, j, 1, 1);
-            }
-            gtk_grid_attach(GTK_GRID(grid_section), widget_input_holder, lbl_input ? 1 : 0, j, 1, 1);
-
+            // the widgets are created by apply_input_state() once the input is visible
+            auto connection_value = connection_data.find(id);
             InputItem input_item = {};
-            input_item.widget = widget_input;
             input_item.input_def_obj = json_node_get_object(json_node_copy(input_def_node));
-
-            priv->input_widgets[id] = input_item;
+            input_item.grid = grid_section;
+            input_item.row = j;
+            input_item.has_connection_value = connection_value != connection_data.end();
+            if (input_item.has_connection_value) {
+                input_item.connection_value = connection_value->second;
+            }
+            form->graph.add(id,
+                            input_item.has_connection_value ? connection_value->second : input_default_value(input_def_obj, type),
+                            json_object_get_boolean_member_with_default(input_def_obj, "required", false));
+            form->inputs.push_back(move(input_item));
         }
     }
     priv->widget = main_widget;
     g_object_unref(parser);
 
-    ////////////////////////////////////////////////////////////////////////
-
-    s_vpn = nm_connection_get_setting_vpn(connection);
+    for (int i = 0; i < form->graph.size(); i++) {
+        if (!add_input_conditions(form->graph, i, form->inputs[i].input_def_obj, &graph_error)) {
+            g_set_error(error, EDITOR_PLUGIN_ERROR, 0, "THIS_VPN_PROVIDER_INPUT_FORM_JSON: %s", graph_error.c_str());
+            return nullptr;
+        }
+    }
+    if (!form->graph.compile(&graph_error)) {
+        VPN_LOG_WARNING("Ignoring input conditions", "error", graph_error);
+    }
+    for (int i = 0; i < form->graph.size(); i++) {
+        apply_input_state(THIS_VPN_EDITOR_WIDGET(editor_obj), i);
+    }
 
-    if (s_vpn)
-        nm_setting_vpn_foreach_data_item(
-            s_vpn,
-            [](const char *key_cstr, const char *value_cstr, gpointer user_data) {
-                bool *is_new = (bool *)user_data;
-                *is_new = false;
-            },
-            &is_new);
-    priv->is_new_connection = is_new;
+    ////////////////////////////////////////////////////////////////////////
 
-    if (!apply_connection_proprties(THIS_VPN_EDITOR_WIDGET(editor_obj), connection, error)) {
-        g_object_unref(editor_obj);
-        return nullptr;
+    for (const auto &pair : connection_data) {
+        if (form->graph.index(pair.first) < 0) {
+            VPN_LOG_WARNING("No input for connection data", "key", pair.first);
+        }
     }
 
-    g_debug("this_vpn_editor_widget_factory() Done | editor_obj@%p", editor_obj);
+    VPN_LOG_DEBUG("this_vpn_editor_widget_factory() Done", "editor", (const void *)editor_obj, "inputs", form->graph.size());
     return editor_obj;
 }
 
@@ -761,9 +950,10 @@ static gboolean update_connection(NMVpnEditor *iface, NMConnection *connection,
 {
     ThisVPNEditorWidget *self = THIS_VPN_EDITOR_WIDGET(iface);
     ThisVPNEditorWidgetPrivate *priv = (ThisVPNEditorWidgetPrivate *)this_vpn_editor_widget_get_instance_private(THIS_VPN_EDITOR_WIDGET(self));
+    EditorForm *form = priv->form;
     NMSettingVpn *s_vpn;
 
-    g_debug("update_connection()");
+    VPN_LOG_DEBUG("update_connection()", "inputs", form->graph.size());
 
     if (!check_validity(self, error))
         return false;
@@ -771,45 +961,22 @@ static gboolean update_connection(NMVpnEditor *iface, NMConnection *connection,
     s_vpn = NM_SETTING_VPN(nm_setting_vpn_new());
     g_object_set(s_vpn, NM_SETTING_VPN_SERVICE_TYPE, THIS_VPN_PROVIDER_DBUS_SERVICE, nullptr);
 
-    for (const auto &pair : priv->input_widgets) {
-        string id = pair.first;
-        GtkWidget *widget = pair.second.widget;
-        g_debug("update_connection_properties() Processing widget: id=%s w=%p", id.c_str(), widget);
-        string value;
-        if (G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_SPIN_BUTTON)) {
-            value = to_string((int)gtk_spin_button_get_value(GTK_SPIN_BUTTON(widget)));
-        } else if (G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_ENTRY)) {
-            value = STR(gtk_editable_get_text(GTK_EDITABLE(widget)));
-        } else if (G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_CHECK_BUTTON)) {
-            value = gtk_check_button_get_active(GTK_CHECK_BUTTON(widget)) ? "true" : "false";
-        } else if (IS_LIST_VIEW_WIDGET(widget)) {
-            JsonArray *arr = json_array_new();
-#if GTK_CHECK_VERSION(4, 0, 0)
-            GtkSelectionModel *ss = gtk_list_view_get_model(GTK_LIST_VIEW(widget));
-            GtkStringList *string_list = GTK_STRING_LIST(gtk_single_selection_get_model(GTK_SINGLE_SELECTION(ss)));
-            for (int i = 0; i < g_list_model_get_n_items(G_LIST_MODEL(string_list)); i++) {
-                const char *v = gtk_string_list_get_string(string_list, i);
-#else
-            GtkTreeModel *model = gtk_tree_view_get_model(GTK_TREE_VIEW(widget));
-            GtkTreeIter iter;
-            for (gboolean valid = gtk_tree_model_get_iter_first(model, &iter); valid; valid = gtk_tree_model_iter_next(model, &iter)) {
-                char *v;
-                gtk_tree_model_get(model, &iter, 0, &v, -1);
-#endif
-                g_debug("update_connection() get listview of key=%s with entry=%s", id.c_str(), v);
-                json_array_add_string_element(arr, v);
+    for (int i = 0; i < form->graph.size(); i++) {
+        const FieldGraph::Field &field = form->graph[i];
+        if (!field.visible) {
+            continue; // hidden by its conditions
+        }
+        if (!field.enabled) {
+            // disabled by its conditions: keeps the value the connection has, if any
+            if (!form->inputs[i].connection_value.empty()) {
+                nm_setting_vpn_add_data_item(s_vpn, field.id.c_str(), form->inputs[i].connection_value.c_str());
             }
-            JsonNode *n = json_node_alloc();
-            json_node_init_array(n, arr);
-            value = STR(json_to_string(n, false));
-        } else if (G_TYPE_CHECK_INSTANCE_TYPE((widget), GTK_TYPE_DROP_DOWN)) {
-            value = STR(gtk_dropdown_text_get_active_text(widget));
-        } else {
-            g_warning("update_connection() Unknown widget type for key %s : %s", id.c_str(), G_OBJECT_TYPE_NAME(widget));
+            continue;
         }
+        string value = get_input_widget_value(field.id, form->inputs[i].widget);
         if (!value.empty()) {
-            g_debug("Set key=%s value=%s", id.c_str(), value.c_str());
-            nm_setting_vpn_add_data_item(s_vpn, id.c_str(), value.c_str());
+            VPN_LOG_TRACE("update_connection() Set", "key", field.id, "value", value);
+            nm_setting_vpn_add_data_item(s_vpn, field.id.c_str(), value.c_str());
         }
     }
     nm_connection_add_setting(connection, NM_SETTING(s_vpn));
@@ -830,7 +997,7 @@ static void this_vpn_editor_widget_interface_init(NMVpnEditorInterface *iface_cl
     iface_class->get_widget = [](NMVpnEditor *iface) -> GObject * {
         ThisVPNEditorWidget *self = THIS_VPN_EDITOR_WIDGET(iface);
         ThisVPNEditorWidgetPrivate *priv = (ThisVPNEditorWidgetPrivate *)this_vpn_editor_widget_get_instance_private(THIS_VPN_EDITOR_WIDGET(self));
-        g_debug("get_widget() iface=%s widget=%s", G_OBJECT_TYPE_NAME(iface), priv->widget ? G_OBJECT_TYPE_NAME(priv->widget) : "null");
+        VPN_LOG_DEBUG("get_widget()", "iface", G_OBJECT_TYPE_NAME(iface), "widget", priv->widget ? G_OBJECT_TYPE_NAME(priv->widget) : "null");
         return G_OBJECT(priv->widget);
     };
     iface_class->update_connection = update_connection;
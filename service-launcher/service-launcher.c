@@ -0,0 +1,131 @@
+// nm-<provider>-service: what NetworkManager D-Bus activates. Execs the Python plugin-service, like
+// plugin-service/provider-exec does for development, without a shell, realpath/readlink processes or a PATH
+// lookup for the interpreter.
+
+#include <errno.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef VPN_BUNDLE_PYTHON
+#define VPN_BUNDLE_PYTHON "/usr/bin/python3"
+#endif
+
+static bool is_file(const char *dir, const char *name, int mode)
+{
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path))
+        return false;
+    return access(path, mode) == 0;
+}
+
+// Directory of the plugin-service package: where this executable is installed, else the install dir
+static bool find_module_dir(char *module_dir, size_t size)
+{
+    char exe[PATH_MAX];
+    ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (n > 0) {
+        exe[n] = '\0';
+        snprintf(module_dir, size, "%s", dirname(exe));
+        if (is_file(module_dir, "__main__.py", R_OK))
+            return true;
+    }
+#ifdef VPN_BUNDLE_PLUGIN_SERVICE_DIR
+    snprintf(module_dir, size, "%s", VPN_BUNDLE_PLUGIN_SERVICE_DIR);
+    return is_file(module_dir, "__main__.py", R_OK);
+#else
+    return false;
+#endif
+}
+
+int main(int argc, char **argv)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    char launch_us[32];
+    snprintf(launch_us, sizeof(launch_us), "%lld", (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000);
+    // reported by the service as the start of its startup (see main() of plugin-service/service.py)
+    setenv("VPN_BUNDLE_LAUNCH_US", launch_us, 1);
+
+    char module_dir[PATH_MAX];
+    if (!find_module_dir(module_dir, sizeof(module_dir))) {
+        fprintf(stderr, "nm-vpn-bundle: plugin-service not found\n");
+        return 1;
+    }
+    char module_dir_copy[PATH_MAX];
+    snprintf(module_dir_copy, sizeof(module_dir_copy), "%s", module_dir);
+    const char *module_name = basename(module_dir_copy);
+    char module_parent[PATH_MAX];
+    snprintf(module_parent, sizeof(module_parent), "%s", module_dir);
+    dirname(module_parent);
+
+    char python[PATH_MAX + 32];
+    bool dev_mode = is_file(module_parent, ".venv/bin/python", X_OK);
+    if (dev_mode)
+        snprintf(python, sizeof(python), "%s/.venv/bin/python", module_parent);
+    else
+        snprintf(python, sizeof(python), "%s", VPN_BUNDLE_PYTHON);
+    if (is_file(module_dir, ".dev", F_OK))
+        dev_mode = true;
+    if (dev_mode) {
+        setenv("VPN_BUNDLE_DEV_MODE", "true", 1);
+        fprintf(stderr, " >>>>  Running in Dev Mode | PYTHON_BIN=(%s) | module_dir=%s | exe=%s |\n", python, module_dir,
+                argv[0]);
+    }
+
+    bool has_provider = false;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--provider", strlen("--provider")) == 0)
+            has_provider = true;
+    }
+    // nm-<provider>-service
+    char provider[NAME_MAX + 1];
+    snprintf(provider, sizeof(provider), "%s", basename(argv[0]));
+    char *provider_id = provider;
+    if (strncmp(provider_id, "nm-", 3) == 0)
+        provider_id += 3;
+    size_t len = strlen(provider_id), suffix_len = strlen("-service");
+    if (len > suffix_len && strcmp(provider_id + len - suffix_len, "-service") == 0)
+        provider_id[len - suffix_len] = '\0';
+
+    // python -s -m <module name> [--provider <provider>] <args>
+    char **python_argv = calloc(argc + 6, sizeof(char *));
+    int n = 0;
+    python_argv[n++] = python;
+    python_argv[n++] = "-s";
+    python_argv[n++] = "-m";
+    python_argv[n++] = (char *)module_name;
+    if (!has_provider) {
+        python_argv[n++] = "--provider";
+        python_argv[n++] = provider_id;
+    }
+    for (int i = 1; i < argc; i++)
+        python_argv[n++] = argv[i];
+    python_argv[n] = NULL;
+
+    if (chdir(module_parent) != 0) {
+        fprintf(stderr, "nm-vpn-bundle: chdir(%s): %s\n", module_parent, strerror(errno));
+        return 1;
+    }
+    const char *pythonpath = getenv("PYTHONPATH");
+    if (pythonpath && *pythonpath) {
+        char *new_pythonpath = malloc(strlen(module_parent) + strlen(pythonpath) + 2);
+        sprintf(new_pythonpath, "%s:%s", module_parent, pythonpath);
+        setenv("PYTHONPATH", new_pythonpath, 1);
+    } else {
+        setenv("PYTHONPATH", module_parent, 1);
+    }
+
+    execv(python, python_argv);
+    if (errno == ENOENT) { // eg: another interpreter location than at build time
+        python_argv[0] = "python3";
+        execvp(python_argv[0], python_argv);
+    }
+    fprintf(stderr, "nm-vpn-bundle: exec %s: %s\n", python_argv[0], strerror(errno));
+    return 127;
+}